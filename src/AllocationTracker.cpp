@@ -0,0 +1,117 @@
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef TRACK_ALLOCATIONS
+namespace
+{
+	// Every block is prefixed with its size so operator delete can keep the live byte count. 16 bytes keeps the
+	// alignment malloc guarantees.
+	const size_t ALLOCATION_HEADER = 16;
+
+	std::atomic<size_t> allocationCount(0);
+	std::atomic<size_t> allocatedBytes(0);
+	std::atomic<size_t> liveBytes(0);
+	std::atomic<size_t> peakLiveBytes(0);
+
+	void* TrackedAllocate(size_t size) noexcept
+	{
+		unsigned char* block = static_cast<unsigned char*>(std::malloc(size + ALLOCATION_HEADER));
+		if (!block) return nullptr;
+		*reinterpret_cast<size_t*>(block) = size;
+
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+		size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+		size_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+		while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+		return block + ALLOCATION_HEADER;
+	}
+
+	void TrackedFree(void* pointer) noexcept
+	{
+		if (!pointer) return;
+		unsigned char* block = static_cast<unsigned char*>(pointer) - ALLOCATION_HEADER;
+		liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+		std::free(block);
+	}
+
+	void* TrackedNew(size_t size)
+	{
+		void* pointer = TrackedAllocate(size ? size : 1);
+		if (!pointer) throw std::bad_alloc();
+		return pointer;
+	}
+}
+
+void* operator new(size_t size) { return TrackedNew(size); }
+void* operator new[](size_t size) { return TrackedNew(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return TrackedAllocate(size ? size : 1); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return TrackedAllocate(size ? size : 1); }
+void operator delete(void* pointer) noexcept { TrackedFree(pointer); }
+void operator delete[](void* pointer) noexcept { TrackedFree(pointer); }
+void operator delete(void* pointer, size_t) noexcept { TrackedFree(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { TrackedFree(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { TrackedFree(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { TrackedFree(pointer); }
+
+AllocationScope::AllocationScope(const char* phase, bool log)
+	: phase(phase), log(log)
+{
+	startAllocations = allocationCount.load();
+	startBytes = allocatedBytes.load();
+	startLiveBytes = liveBytes.load();
+	outerPeakBytes = peakLiveBytes.exchange(startLiveBytes); // measure this phase's peak from here
+}
+
+AllocationScope::~AllocationScope()
+{
+	if (log)
+	{
+		AllocationStats phaseStats = stats();
+		std::cout << "DEBUG LOG: ALLOCATIONS " << phase << ": " << phaseStats.allocations << " allocations, "
+			<< phaseStats.bytes / 1024 << " KB allocated, peak +" << phaseStats.peakBytes / 1024 << " KB" << std::endl;
+	}
+
+	// Hand the peak back to an enclosing scope
+	size_t peak = peakLiveBytes.load();
+	while (outerPeakBytes > peak && !peakLiveBytes.compare_exchange_weak(peak, outerPeakBytes)) {}
+}
+
+AllocationStats AllocationScope::stats() const
+{
+	AllocationStats result;
+	result.allocations = allocationCount.load() - startAllocations;
+	result.bytes = allocatedBytes.load() - startBytes;
+	size_t peak = peakLiveBytes.load();
+	result.peakBytes = peak > startLiveBytes ? peak - startLiveBytes : 0;
+	return result;
+}
+
+bool AllocationTrackingEnabled()
+{
+	return true;
+}
+#else
+AllocationScope::AllocationScope(const char* phase, bool log)
+	: phase(phase), log(log), startAllocations(0), startBytes(0), startLiveBytes(0), outerPeakBytes(0)
+{
+}
+
+AllocationScope::~AllocationScope()
+{
+}
+
+AllocationStats AllocationScope::stats() const
+{
+	return AllocationStats();
+}
+
+bool AllocationTrackingEnabled()
+{
+	return false;
+}
+#endif
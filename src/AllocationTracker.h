@@ -0,0 +1,43 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include <cstddef>
+
+/// <summary>
+/// Heap allocations made while an AllocationScope was open. The peak is the largest growth of live heap memory
+/// above what was live when the scope opened.
+/// </summary>
+struct AllocationStats
+{
+	size_t allocations = 0;
+	size_t bytes = 0;
+	size_t peakBytes = 0;
+};
+
+/// <summary>
+/// Measures the allocations of one load phase. The counters are process wide (worker threads included) and only exist
+/// in builds with TRACK_ALLOCATIONS defined, which replaces the global operator new/ delete; otherwise scopes are free
+/// and report zeros. Scopes may nest, but should not overlap across threads.
+/// </summary>
+class AllocationScope
+{
+public:
+	explicit AllocationScope(const char* phase, bool log = true);
+	~AllocationScope();
+	AllocationScope(const AllocationScope&) = delete;
+	AllocationScope& operator=(const AllocationScope&) = delete;
+
+	AllocationStats stats() const;
+
+private:
+	const char* phase;
+	bool log;
+	size_t startAllocations;
+	size_t startBytes;
+	size_t startLiveBytes;
+	size_t outerPeakBytes;
+};
+
+bool AllocationTrackingEnabled();
+
+#endif
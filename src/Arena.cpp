@@ -0,0 +1,148 @@
+#include "Arena.h"
+
+#include <cstdint>
+#include <new>
+
+struct Arena::Block
+{
+	Block* previous;
+	size_t capacity;
+	std::atomic<size_t> used;
+};
+
+namespace
+{
+	// Block data starts after the header, aligned for any fundamental type
+	template <class Block>
+	size_t BlockHeaderSize()
+	{
+		return (sizeof(Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+	}
+}
+
+Arena::Arena(size_t blockSize)
+	: root(this), head(nullptr), blockSize(blockSize), freeBlocks(nullptr), reservedBytes(0), blocks(0)
+{
+}
+
+Arena::Arena(Arena* parent)
+	: root(parent ? parent->root : this), head(nullptr), blockSize(parent ? parent->blockSize : ARENA_BLOCK_SIZE), freeBlocks(nullptr),
+	reservedBytes(0), blocks(0)
+{
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+/// <summary>
+/// Carve an aligned allocation out of the current block, starting a new block when it is full. The fast path is a
+/// single atomic add; only threads that run off the end of a block take the lock.
+/// </summary>
+/// <param name="size"> bytes needed. </param>
+/// <param name="alignment"> power of two. </param>
+void* Arena::allocate(size_t size, size_t alignment)
+{
+	const size_t headerSize = BlockHeaderSize<Block>();
+	size_t padded = size + alignment - 1;
+	while (true)
+	{
+		Block* block = head.load(std::memory_order_acquire);
+		if (block)
+		{
+			size_t offset = block->used.fetch_add(padded, std::memory_order_relaxed);
+			if (offset + padded <= block->capacity)
+			{
+				uintptr_t address = reinterpret_cast<uintptr_t>(block) + headerSize + offset;
+				return reinterpret_cast<void*>((address + alignment - 1) & ~uintptr_t(alignment - 1));
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(growMutex);
+		if (head.load(std::memory_order_acquire) != block) continue; // another thread already started a new block
+
+		Block* next = root->obtainBlock(padded > blockSize ? padded : blockSize);
+		next->previous = block;
+		head.store(next, std::memory_order_release);
+	}
+}
+
+/// <summary>
+/// Drop everything allocated from this arena. A child hands its blocks back to the root for reuse, the root frees all
+/// of its blocks. Nothing allocated from the arena may be used afterwards.
+/// </summary>
+void Arena::release()
+{
+	Block* chain = head.exchange(nullptr);
+	if (root != this)
+	{
+		root->recycleBlocks(chain);
+		return;
+	}
+
+	// Free the blocks in use as well as the ones recycled by children
+	std::lock_guard<std::mutex> lock(freeMutex);
+	Block* chains[2] = { chain, freeBlocks };
+	for (Block* block : chains)
+	{
+		while (block)
+		{
+			Block* previous = block->previous;
+			block->~Block();
+			::operator delete(block);
+			block = previous;
+		}
+	}
+	freeBlocks = nullptr;
+	reservedBytes = 0;
+	blocks = 0;
+}
+
+/// <summary>
+/// Root only: reuse a recycled block that is large enough, or reserve a new one from the heap.
+/// </summary>
+Arena::Block* Arena::obtainBlock(size_t capacity)
+{
+	{
+		std::lock_guard<std::mutex> lock(freeMutex);
+		for (Block** link = &freeBlocks; *link; link = &(*link)->previous)
+		{
+			Block* block = *link;
+			if (block->capacity < capacity) continue;
+			*link = block->previous;
+			block->used.store(0, std::memory_order_relaxed);
+			return block;
+		}
+	}
+
+	Block* block = new (::operator new(BlockHeaderSize<Block>() + capacity)) Block();
+	block->capacity = capacity;
+	block->used.store(0, std::memory_order_relaxed);
+	reservedBytes += capacity;
+	blocks++;
+	return block;
+}
+
+void Arena::recycleBlocks(Block* chain)
+{
+	std::lock_guard<std::mutex> lock(freeMutex);
+	while (chain)
+	{
+		Block* previous = chain->previous;
+		chain->previous = freeBlocks;
+		freeBlocks = chain;
+		chain = previous;
+	}
+}
+
+Arena* Arena::current()
+{
+	return currentSlot();
+}
+
+Arena*& Arena::currentSlot()
+{
+	static thread_local Arena* slot = nullptr;
+	return slot;
+}
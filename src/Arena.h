@@ -0,0 +1,115 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Size of the blocks an Arena reserves from the heap (larger requests get a block of their own)
+const size_t ARENA_BLOCK_SIZE = 1024 * 1024;
+
+/// <summary>
+/// Bump allocator for temporary load data. Allocating is an atomic add on the current block, so worker threads can
+/// share one arena; individual frees do nothing, every block is released at once when the arena is destroyed.
+/// A child arena (e.g. one per mesh processed in parallel) takes its blocks from its parent and hands them back when it
+/// is destroyed, so short-lived temporaries reuse the same memory instead of piling up until the end of the load.
+/// </summary>
+class Arena
+{
+public:
+	explicit Arena(size_t blockSize = ARENA_BLOCK_SIZE);
+	explicit Arena(Arena* parent); // a null parent gives a standalone arena
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t alignment);
+	void release();
+
+	// Totals of the root arena, child arenas included
+	size_t bytesReserved() const { return root->reservedBytes.load(); }
+	size_t blockCount() const { return root->blocks.load(); }
+
+	// Arena that ArenaAllocators created on this thread draw from (see ArenaScope), or nullptr for the heap
+	static Arena* current();
+
+private:
+	struct Block;
+
+	Arena* root;
+	std::atomic<Block*> head;
+	std::mutex growMutex;
+	size_t blockSize;
+
+	// Root only: blocks handed back by released child arenas, and the heap totals
+	std::mutex freeMutex;
+	Block* freeBlocks;
+	std::atomic<size_t> reservedBytes;
+	std::atomic<size_t> blocks;
+
+	Block* obtainBlock(size_t capacity);
+	void recycleBlocks(Block* chain);
+
+	friend class ArenaScope;
+	static Arena*& currentSlot();
+};
+
+/// <summary>
+/// Makes an arena the current one on this thread for the lifetime of the scope. Parallel jobs open their own scope
+/// with the arena of the thread that started them.
+/// </summary>
+class ArenaScope
+{
+public:
+	explicit ArenaScope(Arena* arena) : previous(Arena::currentSlot()) { Arena::currentSlot() = arena; }
+	~ArenaScope() { Arena::currentSlot() = previous; }
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+	Arena* previous;
+};
+
+/// <summary>
+/// STL allocator over an Arena. A default constructed allocator binds to the current arena of the constructing
+/// thread and falls back to the heap when there is none, so containers using it work outside of a load as well.
+/// Containers must not outlive the arena they were created under.
+/// </summary>
+template <class T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+
+	Arena* arena;
+
+	ArenaAllocator() noexcept : arena(Arena::current()) {}
+	explicit ArenaAllocator(Arena* arena) noexcept : arena(arena) {}
+	template <class U> ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+	T* allocate(size_t count)
+	{
+		if (arena) return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+		return static_cast<T*>(::operator new(count * sizeof(T)));
+	}
+
+	void deallocate(T* pointer, size_t)
+	{
+		if (!arena) ::operator delete(pointer);
+	}
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+template <class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+using ArenaHashMap = std::unordered_map<Key, Value, Hash, Equal, ArenaAllocator<std::pair<const Key, Value>>>;
+
+#endif
@@ -0,0 +1,66 @@
+#include "AssetIOSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include "AssetPack.h"
+
+bool AssetIOSystem::Exists(const char* pFile) const
+{
+	return AssetExists(pFile);
+}
+
+char AssetIOSystem::getOsSeparator() const
+{
+#ifdef _WIN32
+	return '\\';
+#else
+	return '/';
+#endif
+}
+
+/// <summary>
+/// Read the whole file up front; importers only ever open their inputs for reading.
+/// </summary>
+Assimp::IOStream* AssetIOSystem::Open(const char* pFile, const char* pMode)
+{
+	if (std::strchr(pMode, 'w') || std::strchr(pMode, 'a')) return nullptr;
+
+	std::vector<unsigned char> contents;
+	if (!ReadAssetFile(pFile, contents)) return nullptr;
+	return new AssetIOStream(std::move(contents));
+}
+
+void AssetIOSystem::Close(Assimp::IOStream* pFile)
+{
+	delete pFile;
+}
+
+size_t AssetIOStream::Read(void* pvBuffer, size_t pSize, size_t pCount)
+{
+	if (pSize == 0) return 0;
+	size_t count = std::min(pCount, (contents.size() - position) / pSize);
+	if (count) std::memcpy(pvBuffer, contents.data() + position, count * pSize);
+	position += count * pSize;
+	return count;
+}
+
+size_t AssetIOStream::Write(const void*, size_t, size_t)
+{
+	return 0;
+}
+
+aiReturn AssetIOStream::Seek(size_t pOffset, aiOrigin pOrigin)
+{
+	size_t target;
+	switch (pOrigin)
+	{
+	case aiOrigin_SET: target = pOffset; break;
+	case aiOrigin_CUR: target = position + pOffset; break;
+	case aiOrigin_END: target = contents.size() - pOffset; break;
+	default: return aiReturn_FAILURE;
+	}
+
+	if (target > contents.size()) return aiReturn_FAILURE;
+	position = target;
+	return aiReturn_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#ifndef ASSETIOSYSTEM_H
+#define ASSETIOSYSTEM_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <vector>
+
+/// <summary>
+/// ASSIMP file system that reads through the asset functions, so models (and the material libraries they reference)
+/// are found in the mounted asset pack before falling back to loose files. Read only.
+/// </summary>
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* pFile) const override;
+	char getOsSeparator() const override;
+	Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override;
+	void Close(Assimp::IOStream* pFile) override;
+};
+
+// A whole file held in memory
+class AssetIOStream : public Assimp::IOStream
+{
+public:
+	explicit AssetIOStream(std::vector<unsigned char>&& contents) : contents(std::move(contents)) {}
+
+	size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override;
+	size_t Write(const void* pvBuffer, size_t pSize, size_t pCount) override;
+	aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override;
+	size_t Tell() const override { return position; }
+	size_t FileSize() const override { return contents.size(); }
+	void Flush() override {}
+
+private:
+	std::vector<unsigned char> contents;
+	size_t position = 0;
+};
+
+#endif
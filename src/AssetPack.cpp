@@ -0,0 +1,439 @@
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+namespace
+{
+	const char ASSET_PACK_MAGIC[4] = { 'M', 'D', 'P', 'K' };
+	const uint32_t ASSET_PACK_VERSION = 1;
+
+	const size_t PACK_BLOCK_SIZE = 64 * 1024;
+
+	// LZ block codec parameters: 4 byte minimum match, 64 KB window, 2^14 entry hash table
+	const size_t LZ_MIN_MATCH = 4;
+	const size_t LZ_MAX_OFFSET = 65535;
+	const int LZ_HASH_BITS = 14;
+
+	// Files with at least this many blocks are decompressed on the ThreadPool
+	const uint32_t PARALLEL_DECOMPRESS_BLOCKS = 4;
+
+	struct PackHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t blockCount;
+		uint32_t namesSize;
+		uint32_t padding;
+		uint64_t tocOffset; // entries, then blocks, then the name characters
+	};
+
+	AssetPack mountedPack;
+	bool packMounted = false;
+
+	std::string PackKey(const std::string& path)
+	{
+		std::string key = TextureCache::normalizePath(path);
+		std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return key;
+	}
+
+	uint32_t Read32(const unsigned char* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	void WriteLength(std::vector<unsigned char>& out, size_t length)
+	{
+		while (length >= 255) { out.push_back(255); length -= 255; }
+		out.push_back(static_cast<unsigned char>(length));
+	}
+
+	/// <summary>
+	/// Compress one block into LZ sequences: [token][literal length+][literals][offset:16][match length+].
+	/// The token holds the literal length and match length - 4 in its high/ low nibble, 15 meaning more length bytes
+	/// follow. The final sequence carries literals only.
+	/// </summary>
+	void CompressBlock(const unsigned char* src, size_t size, std::vector<unsigned char>& out)
+	{
+		std::vector<int64_t> table(size_t(1) << LZ_HASH_BITS, -1);
+		size_t anchor = 0, i = 0;
+
+		auto emit = [&](size_t literalEnd, size_t offset, size_t matchLength)
+		{
+			size_t literalLength = literalEnd - anchor;
+			size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+			out.push_back(static_cast<unsigned char>(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+			if (literalLength >= 15) WriteLength(out, literalLength - 15);
+			out.insert(out.end(), src + anchor, src + literalEnd);
+			if (!matchLength) return;
+
+			out.push_back(static_cast<unsigned char>(offset & 0xff));
+			out.push_back(static_cast<unsigned char>(offset >> 8));
+			if (matchCode >= 15) WriteLength(out, matchCode - 15);
+		};
+
+		while (i + LZ_MIN_MATCH <= size)
+		{
+			uint32_t sequence = Read32(src + i);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+			int64_t candidate = table[hash];
+			table[hash] = static_cast<int64_t>(i);
+
+			if (candidate >= 0 && i - size_t(candidate) <= LZ_MAX_OFFSET && Read32(src + candidate) == sequence)
+			{
+				size_t length = LZ_MIN_MATCH;
+				while (i + length < size && src[candidate + length] == src[i + length]) length++;
+
+				emit(i, i - size_t(candidate), length);
+				i += length;
+				anchor = i;
+			}
+			else i++;
+		}
+		emit(size, 0, 0);
+	}
+
+	bool ReadLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+	{
+		unsigned char byte;
+		do
+		{
+			if (in >= end) return false;
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	/// <summary>
+	/// Decompress one block. Every length and offset is validated, so a corrupt pack fails instead of overrunning.
+	/// </summary>
+	bool DecompressBlock(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize)
+	{
+		const unsigned char* in = src;
+		const unsigned char* inEnd = src + srcSize;
+		unsigned char* out = dst;
+		unsigned char* outEnd = dst + dstSize;
+
+		while (in < inEnd)
+		{
+			unsigned char token = *in++;
+			size_t literalLength = token >> 4;
+			if (literalLength == 15 && !ReadLength(in, inEnd, literalLength)) return false;
+			if (literalLength > size_t(inEnd - in) || literalLength > size_t(outEnd - out)) return false;
+			std::memcpy(out, in, literalLength);
+			in += literalLength;
+			out += literalLength;
+			if (in == inEnd) break; // final literal-only sequence
+
+			if (inEnd - in < 2) return false;
+			size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+			in += 2;
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !ReadLength(in, inEnd, matchLength)) return false;
+			matchLength += LZ_MIN_MATCH;
+			if (offset == 0 || offset > size_t(out - dst) || matchLength > size_t(outEnd - out)) return false;
+
+			const unsigned char* match = out - offset;
+			for (size_t i = 0; i < matchLength; i++) out[i] = match[i]; // may overlap for repeating patterns
+			out += matchLength;
+		}
+		return out == outEnd;
+	}
+}
+
+struct AssetPack::Entry
+{
+	uint64_t size;
+	uint32_t firstBlock;
+	uint32_t blockCount;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+};
+
+// A block is stored raw when compression did not make it smaller (compressedSize == rawSize)
+struct AssetPack::Block
+{
+	uint64_t offset;
+	uint32_t compressedSize;
+	uint32_t rawSize;
+};
+
+/// <summary>
+/// Map the pack and validate its table of contents.
+/// </summary>
+/// <returns> false if the file is missing, not a pack, or its table of contents is out of bounds. </returns>
+bool AssetPack::open(const std::string& path)
+{
+	close();
+	if (!file.open(path)) return false;
+
+	const unsigned char* data = file.data();
+	size_t size = file.size();
+	PackHeader header;
+	if (size < sizeof(header)) { close(); return false; }
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC)) != 0 || header.version != ASSET_PACK_VERSION)
+	{
+		close(); return false;
+	}
+
+	uint64_t tocSize = uint64_t(header.entryCount) * sizeof(Entry) + uint64_t(header.blockCount) * sizeof(Block) + header.namesSize;
+	if (header.tocOffset % 8 != 0 || header.tocOffset > size || tocSize > size - header.tocOffset) { close(); return false; }
+
+	entries = reinterpret_cast<const Entry*>(data + header.tocOffset);
+	blocks = reinterpret_cast<const Block*>(entries + header.entryCount);
+	names = reinterpret_cast<const char*>(blocks + header.blockCount);
+	entryTotal = header.entryCount;
+	blockTotal = header.blockCount;
+	namesSize = header.namesSize;
+
+	for (uint32_t i = 0; i < entryTotal; i++)
+	{
+		const Entry& entry = entries[i];
+		bool valid = uint64_t(entry.firstBlock) + entry.blockCount <= blockTotal && uint64_t(entry.nameOffset) + entry.nameLength <= namesSize;
+		uint64_t blockBytes = 0;
+		for (uint32_t b = 0; valid && b < entry.blockCount; b++)
+		{
+			const Block& block = blocks[entry.firstBlock + b];
+			valid = block.offset <= header.tocOffset && block.compressedSize <= header.tocOffset - block.offset && block.rawSize <= PACK_BLOCK_SIZE;
+			blockBytes += block.rawSize;
+		}
+		if (!valid || blockBytes != entry.size) { close(); return false; }
+	}
+	return true;
+}
+
+void AssetPack::close()
+{
+	file.close();
+	entries = nullptr;
+	blocks = nullptr;
+	names = nullptr;
+	entryTotal = blockTotal = namesSize = 0;
+}
+
+/// <summary>
+/// Binary search the table of contents, which the packer sorted by key.
+/// </summary>
+const AssetPack::Entry* AssetPack::find(const std::string& path) const
+{
+	if (!entries) return nullptr;
+	std::string key = PackKey(path);
+
+	const Entry* end = entries + entryTotal;
+	const Entry* found = std::lower_bound(entries, end, key, [this](const Entry& entry, const std::string& k)
+	{
+		return k.compare(0, std::string::npos, names + entry.nameOffset, entry.nameLength) > 0;
+	});
+	if (found == end || key.compare(0, std::string::npos, names + found->nameOffset, found->nameLength) != 0) return nullptr;
+	return found;
+}
+
+bool AssetPack::contains(const std::string& path) const
+{
+	return find(path) != nullptr;
+}
+
+/// <summary>
+/// Decompress a whole file out of the pack. Large files decompress their blocks in parallel.
+/// </summary>
+/// <returns> false if the file is not in the pack or its data is corrupt. </returns>
+bool AssetPack::read(const std::string& path, std::vector<unsigned char>& out) const
+{
+	const Entry* entry = find(path);
+	if (!entry) return false;
+
+	out.resize(size_t(entry->size));
+	std::vector<size_t> outputOffsets(entry->blockCount);
+	size_t offset = 0;
+	for (uint32_t b = 0; b < entry->blockCount; b++)
+	{
+		outputOffsets[b] = offset;
+		offset += blocks[entry->firstBlock + b].rawSize;
+	}
+
+	std::atomic<bool> valid(true);
+	auto decompress = [&](size_t b)
+	{
+		const Block& block = blocks[entry->firstBlock + b];
+		const unsigned char* source = file.data() + block.offset;
+		unsigned char* target = out.data() + outputOffsets[b];
+		if (block.compressedSize == block.rawSize) std::memcpy(target, source, block.rawSize);
+		else if (!DecompressBlock(source, block.compressedSize, target, block.rawSize)) valid = false;
+	};
+
+	if (entry->blockCount >= PARALLEL_DECOMPRESS_BLOCKS) ThreadPool::shared().parallelFor(entry->blockCount, decompress);
+	else for (uint32_t b = 0; b < entry->blockCount; b++) decompress(b);
+
+	if (!valid)
+	{
+		std::cerr << "ERROR::ASSET_PACK::Corrupt data for " << path << std::endl;
+		out.clear();
+	}
+	return valid;
+}
+
+/// <summary>
+/// Offline packer: compress every file block by block and write the pack with its sorted table of contents.
+/// </summary>
+/// <param name="packPath"> pack file to write. </param>
+/// <param name="files"> loose files to store, under the same relative paths the demo loads them with. </param>
+/// <returns> false if any file could not be read or the pack could not be written. </returns>
+bool BuildAssetPack(const std::string& packPath, const std::vector<std::string>& files)
+{
+	struct PackedFile
+	{
+		std::string key;
+		std::vector<unsigned char> data;
+	};
+
+	std::vector<PackedFile> packed;
+	packed.reserve(files.size());
+	for (const std::string& path : files)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in) { std::cerr << "ERROR::ASSET_PACK::Could not read " << path << std::endl; return false; }
+		PackedFile entry;
+		entry.key = PackKey(path);
+		entry.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		packed.push_back(std::move(entry));
+	}
+	std::sort(packed.begin(), packed.end(), [](const PackedFile& a, const PackedFile& b) { return a.key < b.key; });
+	for (size_t i = 1; i < packed.size(); i++)
+	{
+		if (packed[i].key == packed[i - 1].key) { std::cerr << "ERROR::ASSET_PACK::Duplicate entry " << packed[i].key << std::endl; return false; }
+	}
+
+	std::vector<unsigned char> body(sizeof(PackHeader), 0);
+	std::vector<AssetPack::Entry> entries;
+	std::vector<AssetPack::Block> blocks;
+	std::string names;
+	size_t rawBytes = 0;
+	std::vector<unsigned char> compressed;
+
+	for (const PackedFile& file : packed)
+	{
+		AssetPack::Entry entry = {};
+		entry.size = file.data.size();
+		entry.firstBlock = static_cast<uint32_t>(blocks.size());
+		entry.nameOffset = static_cast<uint32_t>(names.size());
+		entry.nameLength = static_cast<uint32_t>(file.key.size());
+		names += file.key;
+
+		for (size_t offset = 0; offset < file.data.size(); offset += PACK_BLOCK_SIZE)
+		{
+			size_t rawSize = std::min(PACK_BLOCK_SIZE, file.data.size() - offset);
+			compressed.clear();
+			CompressBlock(file.data.data() + offset, rawSize, compressed);
+
+			AssetPack::Block block = {};
+			block.offset = body.size();
+			block.rawSize = static_cast<uint32_t>(rawSize);
+			if (compressed.size() < rawSize)
+			{
+				block.compressedSize = static_cast<uint32_t>(compressed.size());
+				body.insert(body.end(), compressed.begin(), compressed.end());
+			}
+			else
+			{
+				block.compressedSize = block.rawSize;
+				body.insert(body.end(), file.data.begin() + offset, file.data.begin() + offset + rawSize);
+			}
+			blocks.push_back(block);
+			entry.blockCount++;
+		}
+		entries.push_back(entry);
+		rawBytes += file.data.size();
+	}
+
+	PackHeader header = {};
+	std::memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC));
+	header.version = ASSET_PACK_VERSION;
+	header.entryCount = static_cast<uint32_t>(entries.size());
+	header.blockCount = static_cast<uint32_t>(blocks.size());
+	header.namesSize = static_cast<uint32_t>(names.size());
+	body.resize((body.size() + 7) & ~size_t(7), 0); // the table of contents is read in place
+	header.tocOffset = body.size();
+	std::memcpy(body.data(), &header, sizeof(header));
+
+	std::string tempPath = packPath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out) return false;
+		out.write(reinterpret_cast<const char*>(body.data()), body.size());
+		out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPack::Entry));
+		out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(AssetPack::Block));
+		out.write(names.data(), names.size());
+		if (!out) { out.close(); std::remove(tempPath.c_str()); return false; }
+	}
+	std::remove(packPath.c_str()); // rename() does not overwrite on Windows
+	if (std::rename(tempPath.c_str(), packPath.c_str()) != 0) return false;
+
+	std::cout << "DEBUG LOG: PACKED " << entries.size() << " FILES (" << rawBytes / 1024 << " KB -> " << body.size() / 1024 << " KB) INTO " << packPath << std::endl;
+	return true;
+}
+
+bool MountAssetPack(const std::string& packPath)
+{
+	packMounted = mountedPack.open(packPath);
+	if (packMounted) std::cout << "DEBUG LOG: MOUNTED ASSET PACK " << packPath << " (" << mountedPack.entryCount() << " files)" << std::endl;
+	return packMounted;
+}
+
+const AssetPack* MountedAssetPack()
+{
+	return packMounted ? &mountedPack : nullptr;
+}
+
+bool AssetExists(const std::string& path)
+{
+	if (packMounted && mountedPack.contains(path)) return true;
+	std::ifstream in(path, std::ios::binary);
+	return static_cast<bool>(in);
+}
+
+/// <summary>
+/// Read a whole asset, from the mounted pack if it contains it, otherwise from the loose file on disk.
+/// </summary>
+bool ReadAssetFile(const std::string& path, std::vector<unsigned char>& out)
+{
+	if (packMounted && mountedPack.read(path, out)) return true;
+
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in) return false;
+	out.resize(static_cast<size_t>(in.tellg()));
+	in.seekg(0);
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(out.data()), out.size()));
+}
+
+bool ReadAssetText(const std::string& path, std::string& out)
+{
+	std::vector<unsigned char> bytes;
+	if (!ReadAssetFile(path, bytes)) return false;
+	out.assign(bytes.begin(), bytes.end());
+	return true;
+}
+
+/// <summary>
+/// stbi_load() for assets: decodes the image from memory, so it works for packed and loose files alike.
+/// Free the result with stbi_image_free().
+/// </summary>
+unsigned char* LoadImageAsset(const std::string& path, int* width, int* height, int* channels)
+{
+	std::vector<unsigned char> bytes;
+	if (!ReadAssetFile(path, bytes) || bytes.empty()) return nullptr;
+	return stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), width, height, channels, 0);
+}
@@ -0,0 +1,55 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+/// <summary>
+/// Read-only asset pack ("assets.pak"): many files stored back to back in one file, found through a sorted table of
+/// contents and split into independently LZ compressed 64 KB blocks. The whole pack is one memory mapping, so reading
+/// a file is a binary search plus decompressing its blocks. Paths are matched case insensitively, with '/' and '\\'
+/// treated the same.
+/// </summary>
+class AssetPack
+{
+public:
+	bool open(const std::string& path);
+	void close();
+
+	bool contains(const std::string& path) const;
+	bool read(const std::string& path, std::vector<unsigned char>& out) const;
+	size_t entryCount() const { return entries ? entryTotal : 0; }
+
+private:
+	struct Entry;
+	struct Block;
+	friend bool BuildAssetPack(const std::string& packPath, const std::vector<std::string>& files);
+
+	MappedFile file;
+	const Entry* entries = nullptr;
+	const Block* blocks = nullptr;
+	const char* names = nullptr;
+	uint32_t entryTotal = 0;
+	uint32_t blockTotal = 0;
+	uint32_t namesSize = 0;
+
+	const Entry* find(const std::string& path) const;
+};
+
+// Write a pack containing the given files, stored under their paths as given (e.g. "shaders\\vertexShader.VERT")
+bool BuildAssetPack(const std::string& packPath, const std::vector<std::string>& files);
+
+// Process-wide pack that the asset functions below look in before falling back to loose files.
+// Mount it before any loading starts; reads are thread safe afterwards.
+bool MountAssetPack(const std::string& packPath);
+const AssetPack* MountedAssetPack();
+
+bool AssetExists(const std::string& path);
+bool ReadAssetFile(const std::string& path, std::vector<unsigned char>& out);
+bool ReadAssetText(const std::string& path, std::string& out);
+unsigned char* LoadImageAsset(const std::string& path, int* width, int* height, int* channels);
+
+#endif
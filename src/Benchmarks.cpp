@@ -0,0 +1,660 @@
+#include "Benchmarks.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AllocationTracker.h"
+#include "Arena.h"
+#include "DrawBatch.h"
+#include "FrustumCulling.h"
+#include "GLStateCache.h"
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "model.h"
+#include "ModelCache.h"
+#include "ObjLoader.h"
+#include "SceneLoader.h"
+#include "Shader.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "UniformBuffers.h"
+#include "VertexQuantization.h"
+
+namespace
+{
+	const int BENCHMARK_ITERATIONS = 10;
+
+	const char* BENCHMARK_MODELS[] =
+	{
+		"assets\\models\\brick_wall\\brick_wall.obj",
+		"assets\\models\\brick_wall\\brick_wall_highres.obj",
+	};
+
+	// Side length (in quads) of the generated grid meshes used for the OBJ throughput benchmark
+	const int SYNTHETIC_GRID_SIZES[] = { 256, 1024 };
+
+	// Generated model with many small meshes, for the scratch arena and draw submission benchmarks
+	const int SYNTHETIC_PROP_COUNT = 2000;
+	const int SYNTHETIC_PROP_GRID_SIZE = 12;
+
+	// Copies of the props model laid out side by side for the frustum culling benchmark, 25 x 2000 meshes
+	const int FRUSTUM_CULL_COPIES = 25;
+
+	double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count();
+	}
+
+	double TimeModelLoads(const char* path, const ModelLoadOptions& options, int iterations)
+	{
+		double totalMs = 0.0;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			Model model(path, options);
+			TextureLoader::instance().finishAll(); // count background texture decoding as part of the load
+			totalMs += ElapsedMs(start);
+		}
+		return totalMs / iterations;
+	}
+
+	/// <summary>
+	/// Compare a cold ASSIMP import against a warm load from the binary mesh cache.
+	/// </summary>
+	void BenchmarkMeshCache(const char* path)
+	{
+		ModelLoadOptions coldOptions;
+		coldOptions.useMeshCache = false;
+		double coldMs = TimeModelLoads(path, coldOptions, BENCHMARK_ITERATIONS);
+
+		ModelLoadOptions warmOptions;
+		{ Model primeCache(path, warmOptions); } // make sure an up to date cache exists before timing
+		double warmMs = TimeModelLoads(path, warmOptions, BENCHMARK_ITERATIONS);
+
+		std::cout << "\n---------------- MESH CACHE BENCHMARK ----------------" << std::endl;
+		std::cout << " > Model: " << path << std::endl;
+		std::cout << " > Cold ASSIMP import: " << std::fixed << std::setprecision(3) << coldMs << " ms" << std::endl;
+		std::cout << " > Warm cached load: " << warmMs << " ms" << std::endl;
+		std::cout << " > Speedup: " << std::setprecision(2) << (warmMs > 0.0 ? coldMs / warmMs : 0.0) << "x" << std::endl;
+	}
+
+	/// <summary>
+	/// Write a flat grid of gridSize x gridSize quads (with positions, UVs and normals) the way Blender exports it.
+	/// </summary>
+	std::string WriteSyntheticObj(int gridSize)
+	{
+		std::string path = "bench_synthetic_" + std::to_string(gridSize) + ".obj";
+		std::ofstream out(path, std::ios::binary);
+		out << std::fixed << std::setprecision(6);
+		out << "o Synthetic_Grid\n";
+		for (int y = 0; y <= gridSize; y++)
+			for (int x = 0; x <= gridSize; x++)
+				out << "v " << x * 0.01f << " " << y * 0.01f << " " << 0.0f << "\n";
+		for (int y = 0; y <= gridSize; y++)
+			for (int x = 0; x <= gridSize; x++)
+				out << "vt " << float(x) / gridSize << " " << float(y) / gridSize << "\n";
+		out << "vn 0.0000 0.0000 1.0000\n";
+		out << "usemtl Brick\n";
+		for (int y = 0; y < gridSize; y++)
+		{
+			for (int x = 0; x < gridSize; x++)
+			{
+				int a = y * (gridSize + 1) + x + 1;
+				int b = a + 1, c = a + gridSize + 2, d = a + gridSize + 1;
+				out << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+			}
+		}
+		return path;
+	}
+
+	/// <summary>
+	/// Write propCount separate objects (each a gridSize x gridSize quad grid), so importing produces many small meshes.
+	/// </summary>
+	std::string WriteSyntheticPropsObj(int propCount, int gridSize)
+	{
+		std::string path = "bench_props_" + std::to_string(propCount) + ".obj";
+		std::ofstream out(path, std::ios::binary);
+		out << std::fixed << std::setprecision(6);
+		out << "vn 0.0000 0.0000 1.0000\n";
+		int vertexBase = 0;
+		for (int prop = 0; prop < propCount; prop++)
+		{
+			out << "o Prop_" << prop << "\nusemtl Brick\n";
+			for (int y = 0; y <= gridSize; y++)
+				for (int x = 0; x <= gridSize; x++)
+					out << "v " << prop * 0.2f + x * 0.01f << " " << y * 0.01f << " " << (x * y % 7) * 0.001f << "\n";
+			for (int y = 0; y <= gridSize; y++)
+				for (int x = 0; x <= gridSize; x++)
+					out << "vt " << float(x) / gridSize << " " << float(y) / gridSize << "\n";
+			for (int y = 0; y < gridSize; y++)
+			{
+				for (int x = 0; x < gridSize; x++)
+				{
+					int a = vertexBase + y * (gridSize + 1) + x + 1;
+					int b = a + 1, c = a + gridSize + 2, d = a + gridSize + 1;
+					out << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+				}
+			}
+			vertexBase += (gridSize + 1) * (gridSize + 1);
+		}
+		return path;
+	}
+
+	/// <summary>
+	/// Time the CPU side of an import (OBJ parsing, optimization and LOD generation) with its temporaries on the heap
+	/// and in a scratch Arena, the way Model::loadModel runs it.
+	/// </summary>
+	void BenchmarkScratchArena(const std::string& path)
+	{
+		auto importOnce = [&path]()
+		{
+			ObjModelData data;
+			LoadObjFile(path, data);
+			Arena* arena = Arena::current();
+			ThreadPool::shared().parallelFor(data.meshes.size(), [&](size_t i)
+			{
+				Arena meshScratch(arena);
+				ArenaScope scratch(arena ? &meshScratch : nullptr);
+				OptimizeMesh(data.meshes[i]);
+				GenerateLods(data.meshes[i]);
+			});
+			return data.meshes.size();
+		};
+
+		double heapMs = 0.0, arenaMs = 0.0;
+		size_t meshCount = 0, arenaBytes = 0;
+		for (int i = 0; i < BENCHMARK_ITERATIONS; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			meshCount = importOnce();
+			heapMs += ElapsedMs(start);
+
+			start = std::chrono::high_resolution_clock::now();
+			{
+				Arena scratch;
+				ArenaScope scope(&scratch);
+				importOnce();
+				arenaBytes = scratch.bytesReserved();
+			}
+			arenaMs += ElapsedMs(start);
+		}
+		heapMs /= BENCHMARK_ITERATIONS;
+		arenaMs /= BENCHMARK_ITERATIONS;
+
+		std::cout << "\n---------------- SCRATCH ARENA BENCHMARK ----------------" << std::endl;
+		std::cout << " > Model: " << path << " (" << meshCount << " meshes)" << std::endl;
+		std::cout << " > Heap temporaries: " << std::fixed << std::setprecision(3) << heapMs << " ms" << std::endl;
+		std::cout << " > Arena temporaries: " << arenaMs << " ms (" << arenaBytes / 1024 << " KB reserved)" << std::endl;
+	}
+
+	/// <summary>
+	/// Compare the parsing throughput of the built-in OBJ loader against ASSIMP's import (without GL uploads).
+	/// </summary>
+	void BenchmarkObjLoader(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) { std::cerr << "Benchmark model not found: " << path << std::endl; return; }
+		double megabytes = static_cast<double>(file.tellg()) / (1024.0 * 1024.0);
+
+		double objMs = 0.0;
+		size_t objTriangles = 0;
+		for (int i = 0; i < BENCHMARK_ITERATIONS; i++)
+		{
+			ObjModelData data;
+			auto start = std::chrono::high_resolution_clock::now();
+			LoadObjFile(path, data);
+			objMs += ElapsedMs(start);
+			objTriangles = data.triangleCount;
+		}
+		objMs /= BENCHMARK_ITERATIONS;
+
+		double assimpMs = 0.0;
+		size_t assimpTriangles = 0;
+		for (int i = 0; i < BENCHMARK_ITERATIONS; i++)
+		{
+			Assimp::Importer import;
+			auto start = std::chrono::high_resolution_clock::now();
+			const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+			assimpMs += ElapsedMs(start);
+			assimpTriangles = 0;
+			for (unsigned int m = 0; scene && m < scene->mNumMeshes; m++)
+				assimpTriangles += scene->mMeshes[m]->mNumFaces;
+		}
+		assimpMs /= BENCHMARK_ITERATIONS;
+
+		std::cout << "\n---------------- OBJ LOADER BENCHMARK ----------------" << std::endl;
+		std::cout << " > Model: " << path << " (" << std::fixed << std::setprecision(2) << megabytes << " MB)" << std::endl;
+		std::cout << " > Built-in OBJ loader: " << std::setprecision(3) << objMs << " ms, "
+			<< std::setprecision(1) << megabytes / (objMs / 1000.0) << " MB/s, "
+			<< objTriangles / (objMs / 1000.0) / 1e6 << " M triangles/s" << std::endl;
+		std::cout << " > ASSIMP: " << std::setprecision(3) << assimpMs << " ms, "
+			<< std::setprecision(1) << megabytes / (assimpMs / 1000.0) << " MB/s, "
+			<< assimpTriangles / (assimpMs / 1000.0) / 1e6 << " M triangles/s" << std::endl;
+	}
+
+	/// <summary>
+	/// Measure the vertex memory saved by the quantized layout and the worst error it introduces, using the CPU decoder.
+	/// </summary>
+	void BenchmarkVertexQuantization(const char* path)
+	{
+		ModelLoadOptions options;
+		options.asyncTextures = false;
+		Model model(path, options);
+
+		size_t floatBytes = 0, quantizedBytes = 0;
+		float positionError = 0.0f, normalError = 0.0f, texCoordError = 0.0f;
+		for (const Mesh& mesh : model.meshes)
+		{
+			QuantizationParams params = ComputeQuantization(mesh.vertices.data(), mesh.vertices.size());
+			std::vector<QuantizedVertex> packed;
+			std::vector<Vertex> decoded;
+			QuantizeVertices(mesh.vertices.data(), mesh.vertices.size(), params, packed);
+			DecodeVertices(packed.data(), packed.size(), params, decoded);
+
+			floatBytes += mesh.vertices.size() * sizeof(Vertex);
+			quantizedBytes += packed.size() * sizeof(QuantizedVertex);
+			for (size_t i = 0; i < decoded.size(); i++)
+			{
+				positionError = glm::max(positionError, glm::length(decoded[i].Position - mesh.vertices[i].Position));
+				normalError = glm::max(normalError, glm::length(decoded[i].Normal - glm::normalize(mesh.vertices[i].Normal)));
+				texCoordError = glm::max(texCoordError, glm::length(decoded[i].TexCoords - mesh.vertices[i].TexCoords));
+			}
+		}
+
+		std::cout << "\n---------------- VERTEX QUANTIZATION ----------------" << std::endl;
+		std::cout << " > Model: " << path << std::endl;
+		std::cout << " > Vertex memory: " << floatBytes / 1024 << " KB -> " << quantizedBytes / 1024 << " KB" << std::endl;
+		std::cout << " > Max error: position " << std::scientific << std::setprecision(2) << positionError
+			<< ", normal " << normalError << ", texCoords " << texCoordError << std::fixed << std::endl;
+	}
+
+	/// <summary>
+	/// Place the same model many times, once as separate Models and once through the ModelCache.
+	/// </summary>
+	void BenchmarkModelCache(const char* path)
+	{
+		const int instanceCount = 100;
+		ModelLoadOptions options;
+		options.asyncTextures = false;
+
+		size_t separateBytes = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			std::vector<std::unique_ptr<Model>> separate;
+			for (int i = 0; i < instanceCount; i++)
+			{
+				separate.emplace_back(new Model(path, options));
+				for (const Mesh& mesh : separate.back()->meshes) separateBytes += mesh.uploadSize();
+			}
+		}
+		double separateMs = ElapsedMs(start);
+
+		size_t sharedBytes = 0;
+		start = std::chrono::high_resolution_clock::now();
+		{
+			std::vector<ModelInstance> instances(instanceCount);
+			for (ModelInstance& instance : instances)
+				instance.model = ModelCache::instance().acquire(path, options);
+			for (const Mesh& mesh : instances[0].model->meshes) sharedBytes += mesh.uploadSize();
+		}
+		double sharedMs = ElapsedMs(start);
+
+		std::cout << "\n---------------- MODEL CACHE BENCHMARK ----------------" << std::endl;
+		std::cout << " > Model: " << path << " x " << instanceCount << std::endl;
+		std::cout << " > Separate models: " << std::fixed << std::setprecision(3) << separateMs << " ms, " << separateBytes / 1024 << " KB of GPU buffers" << std::endl;
+		std::cout << " > Shared through ModelCache: " << sharedMs << " ms, " << sharedBytes / 1024 << " KB of GPU buffers" << std::endl;
+	}
+
+	/// <summary>
+	/// Load a model once per residency policy and compare the geometry memory left in system RAM and on the GPU.
+	/// </summary>
+	void BenchmarkGeometryResidency(const char* path)
+	{
+		const GeometryResidency policies[] = { GeometryResidency::Full, GeometryResidency::PositionsOnly, GeometryResidency::GpuOnly };
+		const char* policyNames[] = { "Full", "Positions only", "GPU only" };
+
+		std::cout << "\n---------------- GEOMETRY RESIDENCY ----------------" << std::endl;
+		std::cout << " > Model: " << path << std::endl;
+		for (int i = 0; i < 3; i++)
+		{
+			ModelLoadOptions options;
+			options.asyncTextures = false;
+			options.residency = policies[i];
+			Model model(path, options);
+			GeometryMemory memory = model.memoryUsage();
+			std::cout << " > " << policyNames[i] << ": CPU " << memory.cpuBytes / 1024 << " KB, GPU " << memory.gpuBytes / 1024 << " KB" << std::endl;
+		}
+	}
+
+	/// <summary>
+	/// CPU meshlet culling of the model's full detail meshes from a few typical demo views: how many triangles are left
+	/// and how long the culling pass takes.
+	/// </summary>
+	void BenchmarkMeshletCulling(const char* path)
+	{
+		struct CullingView
+		{
+			const char* name;
+			glm::vec3 eye;
+			glm::vec3 target;
+		};
+		const CullingView views[] =
+		{
+			{ "Front", glm::vec3(0.0f, 0.5f, 3.0f), glm::vec3(0.0f, 0.5f, 0.0f) },
+			{ "Close, partly off-screen", glm::vec3(0.8f, 0.5f, 0.8f), glm::vec3(1.0f, 0.5f, 0.0f) },
+			{ "Grazing angle", glm::vec3(2.5f, 0.5f, 0.6f), glm::vec3(0.0f, 0.5f, 0.0f) },
+			{ "Behind", glm::vec3(0.0f, 0.5f, -3.0f), glm::vec3(0.0f, 0.5f, 0.0f) },
+		};
+		const int CULL_ITERATIONS = 1000;
+
+		ModelLoadOptions options;
+		options.asyncTextures = false;
+		Model model(path, options);
+
+		size_t meshletCount = 0, triangleCount = 0;
+		for (const Mesh& mesh : model.meshes)
+		{
+			meshletCount += mesh.meshlets.size();
+			triangleCount += mesh.lods[0].indexCount / 3;
+		}
+
+		std::cout << "\n---------------- MESHLET CULLING ----------------" << std::endl;
+		std::cout << " > Model: " << path << std::endl;
+		std::cout << " > " << meshletCount << " meshlets, " << std::setprecision(1)
+			<< (meshletCount ? float(triangleCount) / meshletCount : 0.0f) << " triangles per meshlet" << std::endl;
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f);
+		for (const CullingView& view : views)
+		{
+			MeshletCullView cull = MakeMeshletCullView(glm::mat4(1.0f), glm::lookAt(view.eye, view.target, glm::vec3(0.0f, 1.0f, 0.0f)), projection,
+				0.0f, true);
+			size_t visibleTriangles = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < CULL_ITERATIONS; i++)
+			{
+				visibleTriangles = 0;
+				for (const Mesh& mesh : model.meshes)
+					for (const Meshlet& meshlet : mesh.meshlets)
+						if (IsMeshletVisible(meshlet, cull)) visibleTriangles += meshlet.indexCount / 3;
+			}
+			double cullUs = ElapsedMs(start) * 1000.0 / CULL_ITERATIONS;
+			std::cout << " > " << view.name << ": " << visibleTriangles << " / " << triangleCount << " triangles drawn ("
+				<< std::setprecision(1) << (triangleCount ? 100.0 * visibleTriangles / triangleCount : 0.0) << "%), cull "
+				<< std::setprecision(2) << cullUs << " us" << std::endl;
+		}
+	}
+
+	/// <summary>
+	/// The uniforms set per culled mesh on the meshlet culling shader, set three ways: looking the location up with
+	/// glGetUniformLocation on every call (what the setters used to do), through the string setters and the location
+	/// table, and through constexpr UniformIds that skip hashing the name at runtime.
+	/// </summary>
+	void BenchmarkUniformUpdates()
+	{
+		const char* names[] = { "cameraPosition", "margin", "cullBackfaces", "meshletCount", "firstCommand", "firstIndex", "baseVertex", "drawId" };
+		constexpr UniformId ids[] = { UniformId("cameraPosition"), UniformId("margin"), UniformId("cullBackfaces"), UniformId("meshletCount"),
+			UniformId("firstCommand"), UniformId("firstIndex"), UniformId("baseVertex"), UniformId("drawId") };
+		const int UNIFORM_COUNT = 8;
+		const int UNIFORM_ITERATIONS = 100000;
+		glm::vec3 value(1.0f, 2.0f, 3.0f);
+
+		Shader shader("shaders\\meshletCull.COMP");
+		shader.use();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < UNIFORM_ITERATIONS; i++)
+		{
+			glUniform3fv(glGetUniformLocation(shader.ID, std::string(names[0]).c_str()), 1, &value[0]);
+			glUniform1f(glGetUniformLocation(shader.ID, std::string(names[1]).c_str()), 0.5f);
+			glUniform1i(glGetUniformLocation(shader.ID, std::string(names[2]).c_str()), 1);
+			for (int k = 3; k < UNIFORM_COUNT; k++)
+				glUniform1i(glGetUniformLocation(shader.ID, std::string(names[k]).c_str()), i + k);
+		}
+		glFinish();
+		double lookupMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < UNIFORM_ITERATIONS; i++)
+		{
+			shader.setVec3(names[0], value);
+			shader.setFloat(names[1], 0.5f);
+			shader.setBool(names[2], true);
+			for (int k = 3; k < UNIFORM_COUNT; k++)
+				shader.setInt(names[k], i + k);
+		}
+		glFinish();
+		double stringMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < UNIFORM_ITERATIONS; i++)
+		{
+			shader.setVec3(ids[0], value);
+			shader.setFloat(ids[1], 0.5f);
+			shader.setBool(ids[2], true);
+			for (int k = 3; k < UNIFORM_COUNT; k++)
+				shader.setInt(ids[k], i + k);
+		}
+		glFinish();
+		double idMs = ElapsedMs(start);
+
+		double sets = double(UNIFORM_ITERATIONS) * UNIFORM_COUNT;
+		std::cout << "\n---------------- UNIFORM UPDATES ----------------" << std::endl;
+		std::cout << " > " << UNIFORM_COUNT << " uniforms x " << UNIFORM_ITERATIONS << " culled meshes" << std::endl;
+		std::cout << " > glGetUniformLocation per set: " << std::fixed << std::setprecision(1) << lookupMs * 1e6 / sets << " ns per set" << std::endl;
+		std::cout << " > String setters, cached location: " << stringMs * 1e6 / sets << " ns per set" << std::endl;
+		std::cout << " > Constexpr UniformId: " << idMs * 1e6 / sets << " ns per set" << std::endl;
+		shader.release();
+	}
+
+	/// <summary>
+	/// Draw a model with many small meshes through a DrawBatch: flushed once per frame, so all meshes go out in one
+	/// multi-draw, and flushed after every mesh, which costs about what one draw call per mesh did.
+	/// </summary>
+	void BenchmarkDrawSubmission(const std::string& path)
+	{
+		const int DRAW_FRAMES = 100;
+
+		ModelLoadOptions options;
+		options.asyncTextures = false;
+		options.useMeshCache = false;
+		Model model(path.c_str(), options);
+		Shader shader("shaders\\vertexShader.VERT", "shaders\\fragmentShader.FRAG", "shaders\\geometryShader.GEO");
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		SceneUniforms::instance().setCamera(view, glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f), glm::vec3(0.0f, 0.0f, 5.0f));
+		DrawBatch batch;
+		DrawBatchStats stats;
+		GLStateCache& gl = GLStateCache::instance();
+
+		glFinish();
+		gl.beginFrame();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < DRAW_FRAMES; frame++)
+		{
+			model.Draw(batch, shader);
+			stats = batch.flush();
+		}
+		glFinish();
+		double batchedMs = ElapsedMs(start) / DRAW_FRAMES;
+		GLStateStats batchedState = gl.frame();
+
+		DrawInstance instance = { &shader, MakeDrawRecord(glm::mat4(1.0f), model.modelCenter), glm::mat4(0.0f) };
+		size_t multiDraws = 0;
+		gl.beginFrame();
+		start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < DRAW_FRAMES; frame++)
+		{
+			multiDraws = 0;
+			for (Mesh& mesh : model.meshes)
+			{
+				mesh.Draw(batch, instance);
+				multiDraws += batch.flush().multiDraws;
+			}
+		}
+		glFinish();
+		double perMeshMs = ElapsedMs(start) / DRAW_FRAMES;
+		GLStateStats perMeshState = gl.frame();
+
+		std::cout << "\n---------------- DRAW SUBMISSION ----------------" << std::endl;
+		std::cout << " > Model: " << path << " (" << model.meshes.size() << " meshes)" << std::endl;
+		std::cout << " > Batched: " << stats.records << " draw records, " << stats.commands << " commands, " << stats.multiDraws
+			<< " multi-draw calls, " << std::fixed << std::setprecision(3) << batchedMs << " ms per frame" << std::endl;
+		std::cout << " > Flushed per mesh: " << multiDraws << " multi-draw calls, " << perMeshMs << " ms per frame" << std::endl;
+		std::cout << " > State changes per frame: " << batchedState.issued / DRAW_FRAMES << " issued, " << batchedState.skipped / DRAW_FRAMES
+			<< " skipped batched; " << perMeshState.issued / DRAW_FRAMES << " issued, " << perMeshState.skipped / DRAW_FRAMES
+			<< " skipped flushed per mesh" << std::endl;
+		batch.release();
+		shader.release();
+	}
+
+	/// <summary>
+	/// Cull the mesh bounds of many copies of a model against a view that sees part of them, with the SIMD pass and
+	/// with the scalar one. Also checks that both agree.
+	/// </summary>
+	void BenchmarkFrustumCulling(const std::string& path)
+	{
+		const int CULL_ITERATIONS = 100;
+
+		ModelLoadOptions options;
+		options.asyncTextures = false;
+		options.useMeshCache = false;
+		Model model(path.c_str(), options);
+
+		BoundsSet bounds;
+		for (int copy = 0; copy < FRUSTUM_CULL_COPIES; copy++)
+		{
+			glm::vec3 offset(float(copy % 5) * 4.0f, 0.0f, -float(copy / 5) * 4.0f);
+			for (const Mesh& mesh : model.meshes)
+				bounds.add(mesh.boundsMin + offset, mesh.boundsMax + offset, mesh.boundsRadius);
+		}
+
+		glm::mat4 view = glm::lookAt(glm::vec3(8.0f, 1.0f, 4.0f), glm::vec3(4.0f, 0.0f, -4.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		MeshletCullView cull = MakeMeshletCullView(glm::mat4(1.0f), view, glm::perspective(glm::radians(45.0f), 1920.0f / 1080.0f, 0.1f, 100.0f),
+			0.0f, false);
+		std::vector<uint8_t> simdVisible, scalarVisible;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < CULL_ITERATIONS; i++)
+			bounds.cull(cull.planes, cull.margin, simdVisible);
+		double simdUs = ElapsedMs(start) * 1000.0 / CULL_ITERATIONS;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < CULL_ITERATIONS; i++)
+			bounds.cullScalar(cull.planes, cull.margin, scalarVisible);
+		double scalarUs = ElapsedMs(start) * 1000.0 / CULL_ITERATIONS;
+
+		size_t visible = 0;
+		for (size_t i = 0; i < bounds.size(); i++)
+			visible += IsBoundsVisible(simdVisible, i);
+
+		std::cout << "\n---------------- FRUSTUM CULLING ----------------" << std::endl;
+		std::cout << " > " << bounds.size() << " mesh bounds (" << FRUSTUM_CULL_COPIES << " copies of " << path << "), " << visible << " visible" << std::endl;
+		std::cout << " > SIMD: " << std::fixed << std::setprecision(2) << simdUs << " us, scalar: " << scalarUs << " us ("
+			<< std::setprecision(1) << (simdUs > 0.0 ? scalarUs / simdUs : 0.0) << "x)" << std::endl;
+		if (simdVisible != scalarVisible) std::cerr << "ERROR::BENCHMARK::SIMD and scalar frustum culling disagree" << std::endl;
+	}
+
+	/// <summary>
+	/// Load every benchmark model one after another, then all of them at once through the SceneLoader job graph.
+	/// The mesh cache is off so both runs parse and process every model.
+	/// </summary>
+	void BenchmarkSceneLoad()
+	{
+		ModelLoadOptions options;
+		options.useMeshCache = false;
+		options.optimizeMeshes = true;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			std::vector<std::unique_ptr<Model>> models;
+			for (const char* path : BENCHMARK_MODELS)
+				models.emplace_back(new Model(path, options));
+			TextureLoader::instance().finishAll();
+		}
+		double sequentialMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		{
+			SceneLoader loader(options);
+			std::vector<ModelHandle> models;
+			for (const char* path : BENCHMARK_MODELS)
+				models.push_back(loader.add(path));
+			loader.start();
+			loader.finish();
+			TextureLoader::instance().finishAll();
+		}
+		double concurrentMs = ElapsedMs(start);
+
+		std::cout << "\n---------------- SCENE LOAD BENCHMARK ----------------" << std::endl;
+		std::cout << " > " << sizeof(BENCHMARK_MODELS) / sizeof(BENCHMARK_MODELS[0]) << " models, " << ThreadPool::shared().size() << " worker threads" << std::endl;
+		std::cout << " > One after another: " << std::fixed << std::setprecision(3) << sequentialMs << " ms" << std::endl;
+		std::cout << " > SceneLoader job graph: " << concurrentMs << " ms" << std::endl;
+	}
+
+	/// <summary>
+	/// Count the heap allocations and peak heap growth of a full (uncached) load, per vertex of the loaded model, so
+	/// loads of different sizes can be compared. Needs a TRACK_ALLOCATIONS build.
+	/// </summary>
+	void BenchmarkLoadAllocations(const std::string& path)
+	{
+		ModelLoadOptions options;
+		options.useMeshCache = false;
+		options.asyncTextures = false;
+
+		AllocationScope allocations("benchmark load", false);
+		Model model(path.c_str(), options);
+		AllocationStats stats = allocations.stats();
+		double vertices = model.totalVertices > 0 ? double(model.totalVertices) : 1.0;
+
+		std::cout << "\n---------------- LOAD ALLOCATIONS ----------------" << std::endl;
+		std::cout << " > Model: " << path << " (" << model.totalVertices << " vertices)" << std::endl;
+		std::cout << " > " << stats.allocations << " allocations, " << stats.bytes / 1024 << " KB allocated, peak +" << stats.peakBytes / 1024 << " KB" << std::endl;
+		std::cout << " > Per vertex: " << std::fixed << std::setprecision(1) << stats.bytes / vertices << " bytes allocated, "
+			<< stats.peakBytes / vertices << " bytes peak (a Vertex is " << sizeof(Vertex) << " bytes)" << std::endl;
+	}
+}
+
+void RunBenchmarks()
+{
+	for (const char* path : BENCHMARK_MODELS)
+		BenchmarkMeshCache(path);
+
+	for (const char* path : BENCHMARK_MODELS)
+		BenchmarkObjLoader(path);
+
+	for (const char* path : BENCHMARK_MODELS)
+		BenchmarkVertexQuantization(path);
+
+	for (const char* path : BENCHMARK_MODELS)
+		BenchmarkModelCache(path);
+
+	for (const char* path : BENCHMARK_MODELS)
+		BenchmarkGeometryResidency(path);
+
+	for (const char* path : BENCHMARK_MODELS)
+		BenchmarkMeshletCulling(path);
+
+	BenchmarkUniformUpdates();
+
+	BenchmarkSceneLoad();
+
+	for (int gridSize : SYNTHETIC_GRID_SIZES)
+	{
+		std::string path = WriteSyntheticObj(gridSize);
+		BenchmarkObjLoader(path);
+		if (AllocationTrackingEnabled()) BenchmarkLoadAllocations(path);
+		std::remove(path.c_str());
+	}
+
+	std::string propsPath = WriteSyntheticPropsObj(SYNTHETIC_PROP_COUNT, SYNTHETIC_PROP_GRID_SIZE);
+	BenchmarkScratchArena(propsPath);
+	BenchmarkDrawSubmission(propsPath);
+	BenchmarkFrustumCulling(propsPath);
+	std::remove(propsPath.c_str());
+}
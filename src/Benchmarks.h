@@ -0,0 +1,9 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+/// <summary>
+/// Load-time benchmarks, run with "--bench" instead of the demo. They need a current OpenGL context.
+/// </summary>
+void RunBenchmarks();
+
+#endif
@@ -0,0 +1,278 @@
+#include "DrawBatch.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include "GeometryArena.h"
+#include "GLStateCache.h"
+#include "mesh.h"
+#include "Shader.h"
+
+namespace
+{
+	// meshletCull.COMP
+	constexpr UniformId FRUSTUM_PLANES_UNIFORM("frustumPlanes");
+	constexpr UniformId CAMERA_POSITION_UNIFORM("cameraPosition");
+	constexpr UniformId MARGIN_UNIFORM("margin");
+	constexpr UniformId CULL_BACKFACES_UNIFORM("cullBackfaces");
+	constexpr UniformId MESHLET_COUNT_UNIFORM("meshletCount");
+	constexpr UniformId FIRST_COMMAND_UNIFORM("firstCommand");
+	constexpr UniformId FIRST_INDEX_UNIFORM("firstIndex");
+	constexpr UniformId BASE_VERTEX_UNIFORM("baseVertex");
+	constexpr UniformId DRAW_ID_UNIFORM("drawId");
+
+	static_assert(sizeof(DrawRecord) == 256, "DrawRecord must match the std430 layout of DrawRecord in the scene shaders");
+
+	// Bits of the sort key, from the most significant down: program, state, depth
+	const unsigned int SORT_PROGRAM_BITS = 12;
+	const unsigned int SORT_STATE_BITS = 20;
+	const unsigned int SORT_DEPTH_BITS = 32;
+	static_assert(SORT_PROGRAM_BITS + SORT_STATE_BITS + SORT_DEPTH_BITS == 64, "The sort key fields must fill 64 bits");
+
+	/// <summary>
+	/// The bits of a non-negative float compare like the float itself, so depth sorts as an integer.
+	/// </summary>
+	uint32_t DepthBits(float depth)
+	{
+		if (!(depth > 0.0f)) depth = 0.0f; // behind the camera or NaN
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits;
+	}
+}
+
+/// <summary>
+/// A record for drawing with the given model matrix, without any material: the mesh drawn fills in the rest.
+/// </summary>
+DrawRecord MakeDrawRecord(const glm::mat4& model, const glm::vec3& modelCenter)
+{
+	DrawRecord record = {};
+	record.model = model;
+	record.normalMatrix = glm::transpose(glm::inverse(model));
+	record.positionScale = glm::vec4(1.0f);
+	record.modelCenter = glm::vec4(modelCenter, 1.0f);
+	record.diffuseLayer = record.specularLayer = -1;
+	return record;
+}
+
+bool DrawState::operator==(const DrawState& other) const
+{
+	return program == other.program && arena == other.arena && diffuseTexture == other.diffuseTexture && specularTexture == other.specularTexture
+		&& diffuseArray == other.diffuseArray && specularArray == other.specularArray;
+}
+
+DrawBatch::DrawBatch()
+	: lastState(0), recordBuffer(0), commandBuffer(0), drawIdBuffer(0), drawIdCapacity(0)
+{
+}
+
+/// <summary>
+/// Add a record to this frame's draw table.
+/// </summary>
+/// <returns> the draw ID the record's draws are submitted with. </returns>
+unsigned int DrawBatch::addRecord(const DrawRecord& record)
+{
+	records.push_back(record);
+	return static_cast<unsigned int>(records.size() - 1);
+}
+
+/// <summary>
+/// Queue one indexed draw. A draw that continues the index range of the previous one with the same state and record
+/// is merged into it.
+/// </summary>
+/// <param name="firstIndex"> first index in the arena's index buffer. </param>
+/// <param name="baseVertex"> added to every index, the first vertex of the mesh in the arena. </param>
+/// <param name="depth"> view space distance of the draw, draws with the same state go out nearest first. </param>
+void DrawBatch::addDraw(const DrawState& state, unsigned int drawId, unsigned int firstIndex, unsigned int indexCount, int baseVertex, float depth)
+{
+	if (indexCount == 0) return;
+	if (!draws.empty() && draws.back().cull < 0 && draws.back().state == state)
+	{
+		DrawElementsIndirectCommand& last = commands.back();
+		if (last.baseInstance == drawId && last.baseVertex == baseVertex && last.firstIndex + last.count == firstIndex)
+		{
+			last.count += indexCount;
+			return;
+		}
+		draws.back().commandCount++;
+	}
+	else
+	{
+		PendingDraw draw = { state, sortKey(state, depth), commands.size(), 1, -1 };
+		draws.push_back(draw);
+	}
+	DrawElementsIndirectCommand command = { indexCount, 1, firstIndex, baseVertex, drawId };
+	commands.push_back(command);
+}
+
+/// <summary>
+/// Queue a mesh whose meshlets are culled on the GPU: at flush time the cull shader writes one command per meshlet
+/// straight into the batch's indirect buffer (empty if the meshlet is culled), so nothing is read back.
+/// </summary>
+/// <param name="firstIndex"> first index of the mesh in the arena's index buffer, meshlet ranges are relative to it. </param>
+void DrawBatch::addCulledDraw(const DrawState& state, unsigned int drawId, unsigned int firstIndex, int baseVertex, const GpuMeshletCull& cull,
+	float depth)
+{
+	if (cull.meshletCount == 0) return;
+	PendingCull pending = { cull, drawId, firstIndex, baseVertex, 0 };
+	culls.push_back(pending);
+	PendingDraw draw = { state, sortKey(state, depth), 0, cull.meshletCount, static_cast<int>(culls.size() - 1) };
+	draws.push_back(draw);
+}
+
+/// <summary>
+/// Pack a draw's sort key: its program in the top bits, then its state (numbered in order of first use this frame,
+/// which stands for the arena and texture set), then its depth. Sorting by the key keeps every program's draws
+/// together, and within them every state's, so binds happen once per group, and each group goes out front to back.
+/// A program name or state count too large for its field only costs extra groups, never a wrong bind: groups are
+/// split wherever the full state changes.
+/// </summary>
+uint64_t DrawBatch::sortKey(const DrawState& state, float depth)
+{
+	if (lastState >= states.size() || !(states[lastState] == state))
+	{
+		lastState = std::find(states.begin(), states.end(), state) - states.begin();
+		if (lastState == states.size()) states.push_back(state);
+	}
+	uint64_t program = std::min<uint64_t>(state.program, (1ull << SORT_PROGRAM_BITS) - 1);
+	uint64_t stateIndex = std::min<uint64_t>(lastState, (1ull << SORT_STATE_BITS) - 1);
+	return (program << (SORT_STATE_BITS + SORT_DEPTH_BITS)) | (stateIndex << SORT_DEPTH_BITS) | DepthBits(depth);
+}
+
+/// <summary>
+/// Draw everything queued since the last flush and empty the batch. Draws are sorted by their key, grouped by their
+/// state, and every group is one glMultiDrawElementsIndirect.
+/// </summary>
+DrawBatchStats DrawBatch::flush()
+{
+	DrawBatchStats stats;
+	states.clear();
+	lastState = 0;
+	if (draws.empty())
+	{
+		records.clear();
+		return stats;
+	}
+
+	// Sort the draws and lay their commands out in that order, so every group is one contiguous range
+	order.resize(draws.size());
+	for (size_t i = 0; i < draws.size(); i++)
+		order[i] = std::make_pair(draws[i].key, i);
+	std::sort(order.begin(), order.end());
+	sorted.clear();
+	for (const auto& entry : order)
+	{
+		const PendingDraw& draw = draws[entry.second];
+		if (draw.cull >= 0)
+		{
+			culls[draw.cull].firstCommand = sorted.size();
+			sorted.resize(sorted.size() + draw.commandCount, DrawElementsIndirectCommand());
+		}
+		else sorted.insert(sorted.end(), commands.begin() + draw.firstCommand, commands.begin() + draw.firstCommand + draw.commandCount);
+	}
+
+	// Both tables are rewritten every frame, orphaning the old storage avoids waiting for draws still reading it
+	if (!recordBuffer) glGenBuffers(1, &recordBuffer);
+	if (!commandBuffer) glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, recordBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(DrawRecord), records.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sorted.size() * sizeof(DrawElementsIndirectCommand), sorted.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	ensureDrawIds(records.size());
+	if (!culls.empty()) runGpuCulls();
+
+	// Everything is bound through the cache, so state already set by the previous group or frame is not bound again
+	GLStateCache& gl = GLStateCache::instance();
+	gl.bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_RECORD_BINDING, recordBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	GeometryArena* idsAttached = nullptr;
+	size_t position = 0;
+	for (size_t i = 0; i < order.size();)
+	{
+		const DrawState& state = draws[order[i].second].state;
+		size_t count = 0;
+		for (; i < order.size() && draws[order[i].second].state == state; i++)
+			count += draws[order[i].second].commandCount;
+
+		gl.useProgram(state.program);
+		gl.bindVertexArray(state.arena->vertexArray());
+		if (state.arena != idsAttached) // vertex array state, set once per arena and flush
+		{
+			glBindVertexBuffer(DRAW_ID_VERTEX_BINDING, drawIdBuffer, 0, sizeof(unsigned int));
+			idsAttached = state.arena;
+		}
+		if (state.diffuseTexture) gl.bindTexture(DIFFUSE_TEXTURE_UNIT, GL_TEXTURE_2D, state.diffuseTexture);
+		if (state.specularTexture) gl.bindTexture(SPECULAR_TEXTURE_UNIT, GL_TEXTURE_2D, state.specularTexture);
+		if (state.diffuseArray) gl.bindTexture(TEXTURE_ARRAY_UNIT, GL_TEXTURE_2D_ARRAY, state.diffuseArray);
+		if (state.specularArray) gl.bindTexture(TEXTURE_ARRAY_UNIT + 1, GL_TEXTURE_2D_ARRAY, state.specularArray);
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(position * sizeof(DrawElementsIndirectCommand)),
+			static_cast<GLsizei>(count), 0);
+		position += count;
+		stats.multiDraws++;
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	stats.records = records.size();
+	stats.commands = sorted.size();
+	records.clear();
+	commands.clear();
+	draws.clear();
+	culls.clear();
+	return stats;
+}
+
+/// <summary>
+/// Run meshletCull.COMP for every mesh queued with addCulledDraw, writing into its range of the command buffer.
+/// </summary>
+void DrawBatch::runGpuCulls()
+{
+	GLStateCache& gl = GLStateCache::instance();
+	gl.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+	for (const PendingCull& pending : culls)
+	{
+		Shader& cullShader = *pending.cull.cullShader;
+		const MeshletCullView& view = pending.cull.view;
+		cullShader.use();
+		cullShader.setVec4Array(FRUSTUM_PLANES_UNIFORM, view.planes, 6);
+		cullShader.setVec3(CAMERA_POSITION_UNIFORM, view.cameraPosition);
+		cullShader.setFloat(MARGIN_UNIFORM, view.margin);
+		cullShader.setBool(CULL_BACKFACES_UNIFORM, view.cullBackfaces);
+		cullShader.setInt(MESHLET_COUNT_UNIFORM, static_cast<int>(pending.cull.meshletCount));
+		cullShader.setInt(FIRST_COMMAND_UNIFORM, static_cast<int>(pending.firstCommand));
+		cullShader.setInt(FIRST_INDEX_UNIFORM, static_cast<int>(pending.firstIndex));
+		cullShader.setInt(BASE_VERTEX_UNIFORM, pending.baseVertex);
+		cullShader.setInt(DRAW_ID_UNIFORM, static_cast<int>(pending.drawId));
+		gl.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pending.cull.meshletBuffer);
+		glDispatchCompute((pending.cull.meshletCount + 63) / 64, 1, 1); // 64 meshlets per work group
+	}
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+/// <summary>
+/// Make the draw ID stream (0, 1, 2, ...) long enough for count records. It only ever grows.
+/// </summary>
+void DrawBatch::ensureDrawIds(size_t count)
+{
+	if (count <= drawIdCapacity) return;
+	drawIdCapacity = std::max(count, drawIdCapacity * 2);
+	std::vector<unsigned int> ids(drawIdCapacity);
+	std::iota(ids.begin(), ids.end(), 0u);
+	if (!drawIdBuffer) glGenBuffers(1, &drawIdBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(unsigned int), ids.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DrawBatch::release()
+{
+	GLStateCache::instance().bufferDeleted(recordBuffer);
+	GLStateCache::instance().bufferDeleted(commandBuffer);
+	if (recordBuffer) glDeleteBuffers(1, &recordBuffer);
+	if (commandBuffer) glDeleteBuffers(1, &commandBuffer);
+	if (drawIdBuffer) glDeleteBuffers(1, &drawIdBuffer);
+	recordBuffer = commandBuffer = drawIdBuffer = 0;
+	drawIdCapacity = 0;
+}
@@ -0,0 +1,159 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshletBuilder.h"
+
+class GeometryArena;
+class Shader;
+
+// Shader storage binding of the draw record table, see DrawRecords in the scene shaders
+const unsigned int DRAW_RECORD_BINDING = 2;
+
+/// <summary>
+/// Material values of a draw, laid out like DrawMaterial in the scene shaders (std430).
+/// </summary>
+struct DrawMaterial
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	float shininess;
+	int hasDiffuseTex;
+	int hasSpecularTex;
+	int padding;
+};
+
+/// <summary>
+/// Everything the scene shaders need to know about one draw, looked up by its draw ID. Laid out like DrawRecord in the
+/// scene shaders (std430): vec3s are stored as vec4 and the struct is padded to a multiple of 16 bytes.
+/// </summary>
+struct DrawRecord
+{
+	glm::mat4 model;
+	glm::mat4 normalMatrix;   // transpose(inverse(model)), only the upper 3x3 is used
+	DrawMaterial material;
+	glm::vec4 positionOffset; // dequantization of the compact vertex layout, see VertexQuantization.h
+	glm::vec4 positionScale;
+	glm::vec4 modelCenter;    // center of the implosion in geometryShader.GEO
+	int diffuseLayer;         // texture array layers, -1 if the texture is not packed
+	int specularLayer;
+	int quantized;
+	int padding;
+};
+
+DrawRecord MakeDrawRecord(const glm::mat4& model, const glm::vec3& modelCenter);
+
+/// <summary>
+/// A model instance as it is queued into a batch: the program drawing it, its record (see MakeDrawRecord) and the
+/// matrix taking its object space to view space, which orders its meshes front to back.
+/// </summary>
+struct DrawInstance
+{
+	Shader* shader;
+	DrawRecord record;
+	glm::mat4 modelView;
+};
+
+// Laid out like the std430 struct in meshletCull.COMP and as glMultiDrawElementsIndirect reads it
+struct DrawElementsIndirectCommand
+{
+	unsigned int count, instanceCount, firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+/// <summary>
+/// The GL state a draw needs bound. Draws with the same state go out together in one multi-draw.
+/// </summary>
+struct DrawState
+{
+	unsigned int program = 0;
+	GeometryArena* arena = nullptr;
+	unsigned int diffuseTexture = 0;  // GL_TEXTURE_2D on DIFFUSE_TEXTURE_UNIT, 0 if none
+	unsigned int specularTexture = 0; // GL_TEXTURE_2D on SPECULAR_TEXTURE_UNIT
+	unsigned int diffuseArray = 0;    // GL_TEXTURE_2D_ARRAY on TEXTURE_ARRAY_UNIT
+	unsigned int specularArray = 0;   // GL_TEXTURE_2D_ARRAY on the unit after it
+
+	bool operator==(const DrawState& other) const;
+};
+
+/// <summary>
+/// A mesh's meshlets, culled into indirect draws by meshletCull.COMP when the batch is flushed.
+/// </summary>
+struct GpuMeshletCull
+{
+	unsigned int meshletBuffer; // the mesh's meshlets, laid out like Meshlet in meshletCull.COMP
+	unsigned int meshletCount;
+	MeshletCullView view;
+	Shader* cullShader;
+};
+
+struct DrawBatchStats
+{
+	size_t records = 0;    // draw IDs used
+	size_t commands = 0;   // indirect draw commands, including those a culling pass may leave empty
+	size_t multiDraws = 0; // glMultiDrawElementsIndirect calls
+};
+
+/// <summary>
+/// The render queue of a frame. Collects the draws and submits them with as few glMultiDrawElementsIndirect calls as
+/// the bound state allows: one per program, GeometryArena and texture set, so a whole scene whose textures are packed
+/// into texture arrays goes out in a single call. Draws are ordered by a packed sort key (see flush), and all binds go
+/// through GLStateCache. Each draw's record lands in a shader storage table and its draw ID reaches the shaders as a
+/// per-instance attribute picked by the command's baseInstance. Models queue into the batch from Model::Draw, and
+/// flush() draws everything queued. GL thread only.
+/// </summary>
+class DrawBatch
+{
+public:
+	DrawBatch();
+
+	unsigned int addRecord(const DrawRecord& record);
+	void addDraw(const DrawState& state, unsigned int drawId, unsigned int firstIndex, unsigned int indexCount, int baseVertex, float depth = 0.0f);
+	void addCulledDraw(const DrawState& state, unsigned int drawId, unsigned int firstIndex, int baseVertex, const GpuMeshletCull& cull,
+		float depth = 0.0f);
+	DrawBatchStats flush();
+	bool empty() const { return records.empty(); }
+	void release();
+
+private:
+	struct PendingDraw
+	{
+		DrawState state;
+		uint64_t key;        // see SortKey in DrawBatch.cpp
+		size_t firstCommand; // into commands, unless culled on the GPU
+		size_t commandCount;
+		int cull;            // index into culls, -1 if the commands were built on the CPU
+	};
+
+	struct PendingCull
+	{
+		GpuMeshletCull cull;
+		unsigned int drawId;
+		unsigned int firstIndex;
+		int baseVertex;
+		size_t firstCommand; // where the culling pass writes its commands, set by flush()
+	};
+
+	std::vector<DrawRecord> records;
+	std::vector<DrawElementsIndirectCommand> commands;    // in submission order
+	std::vector<PendingDraw> draws;
+	std::vector<PendingCull> culls;
+	std::vector<DrawState> states;                        // distinct states queued this frame, in order of first use
+	size_t lastState;                                     // index into states of the previous draw's state
+	std::vector<std::pair<uint64_t, size_t>> order;       // sort key and index of every draw, reused every flush
+	std::vector<DrawElementsIndirectCommand> sorted;      // commands in the order they are drawn, reused every flush
+	unsigned int recordBuffer, commandBuffer, drawIdBuffer;
+	size_t drawIdCapacity;
+
+	uint64_t sortKey(const DrawState& state, float depth);
+	void runGpuCulls();
+	void ensureDrawIds(size_t count);
+};
+
+#endif
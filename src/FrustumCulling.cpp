@@ -0,0 +1,160 @@
+#include "FrustumCulling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_USE_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_USE_SSE2 1
+#endif
+
+namespace
+{
+	const int FRUSTUM_PLANES = 6;
+
+	/// <summary>
+	/// Lanes of the last block that hold a volume, the rest are masked out of the result.
+	/// </summary>
+	uint8_t UsedLanes(size_t block, size_t count)
+	{
+		size_t used = std::min(BOUNDS_BLOCK_SIZE, count - block * BOUNDS_BLOCK_SIZE);
+		return static_cast<uint8_t>((1u << used) - 1);
+	}
+}
+
+void BoundsSet::clear()
+{
+	blocks.clear();
+	count = 0;
+}
+
+/// <summary>
+/// Append a volume: the box [minBounds, maxBounds] and a sphere of the given radius around the box's center.
+/// </summary>
+void BoundsSet::add(const glm::vec3& minBounds, const glm::vec3& maxBounds, float radius)
+{
+	size_t lane = count % BOUNDS_BLOCK_SIZE;
+	if (lane == 0) blocks.push_back(BoundsBlock());
+	BoundsBlock& block = blocks.back();
+	glm::vec3 center = (minBounds + maxBounds) * 0.5f;
+	glm::vec3 extent = (maxBounds - minBounds) * 0.5f;
+	block.centerX[lane] = center.x;
+	block.centerY[lane] = center.y;
+	block.centerZ[lane] = center.z;
+	block.extentX[lane] = extent.x;
+	block.extentY[lane] = extent.y;
+	block.extentZ[lane] = extent.z;
+	block.radius[lane] = radius;
+	count++;
+}
+
+/// <summary>
+/// Test every volume against the frustum. A volume is outside a plane when dot(normal, center) + w is below minus its
+/// effective radius: the smaller of the sphere radius and the box's projected half size |normal| . extent, grown by
+/// margin.
+/// </summary>
+/// <param name="planes"> six planes with inward pointing, normalized normals, in the volumes' space (see
+/// MakeMeshletCullView). </param>
+/// <param name="margin"> distance vertices may still be moved by after culling. </param>
+/// <param name="visible"> filled with one mask per block, see IsBoundsVisible. </param>
+void BoundsSet::cull(const glm::vec4* planes, float margin, std::vector<uint8_t>& visible) const
+{
+#if defined(CULL_USE_AVX)
+	visible.resize(blocks.size());
+	const __m256 marginV = _mm256_set1_ps(margin);
+	const __m256 zero = _mm256_setzero_ps();
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		const BoundsBlock& block = blocks[b];
+		__m256 cx = _mm256_loadu_ps(block.centerX), cy = _mm256_loadu_ps(block.centerY), cz = _mm256_loadu_ps(block.centerZ);
+		__m256 ex = _mm256_loadu_ps(block.extentX), ey = _mm256_loadu_ps(block.extentY), ez = _mm256_loadu_ps(block.extentZ);
+		__m256 radius = _mm256_loadu_ps(block.radius);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < FRUSTUM_PLANES; p++)
+		{
+			const glm::vec4& plane = planes[p];
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			__m256 boxRadius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::fabs(plane.x))),
+				_mm256_mul_ps(ey, _mm256_set1_ps(std::fabs(plane.y)))), _mm256_mul_ps(ez, _mm256_set1_ps(std::fabs(plane.z))));
+			__m256 reach = _mm256_add_ps(_mm256_min_ps(boxRadius, radius), marginV);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_GE_OQ));
+		}
+		visible[b] = static_cast<uint8_t>(_mm256_movemask_ps(inside)) & UsedLanes(b, count);
+	}
+#elif defined(CULL_USE_SSE2)
+	visible.resize(blocks.size());
+	const __m128 marginV = _mm_set1_ps(margin);
+	const __m128 zero = _mm_setzero_ps();
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		const BoundsBlock& block = blocks[b];
+		int mask = 0;
+		for (size_t half = 0; half < BOUNDS_BLOCK_SIZE; half += 4) // eight volumes as two groups of four
+		{
+			__m128 cx = _mm_loadu_ps(block.centerX + half), cy = _mm_loadu_ps(block.centerY + half), cz = _mm_loadu_ps(block.centerZ + half);
+			__m128 ex = _mm_loadu_ps(block.extentX + half), ey = _mm_loadu_ps(block.extentY + half), ez = _mm_loadu_ps(block.extentZ + half);
+			__m128 radius = _mm_loadu_ps(block.radius + half);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < FRUSTUM_PLANES; p++)
+			{
+				const glm::vec4& plane = planes[p];
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				__m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane.y)))),
+					_mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane.z))));
+				__m128 reach = _mm_add_ps(_mm_min_ps(boxRadius, radius), marginV);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+			}
+			mask |= _mm_movemask_ps(inside) << half;
+		}
+		visible[b] = static_cast<uint8_t>(mask) & UsedLanes(b, count);
+	}
+#else
+	cullScalar(planes, margin, visible);
+#endif
+}
+
+/// <summary>
+/// The same test as cull(), one volume at a time.
+/// </summary>
+void BoundsSet::cullScalar(const glm::vec4* planes, float margin, std::vector<uint8_t>& visible) const
+{
+	visible.assign(blocks.size(), 0);
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		const BoundsBlock& block = blocks[b];
+		uint8_t mask = 0;
+		for (size_t lane = 0; lane < BOUNDS_BLOCK_SIZE; lane++)
+		{
+			bool inside = true;
+			for (int p = 0; p < FRUSTUM_PLANES && inside; p++)
+			{
+				const glm::vec4& plane = planes[p];
+				float distance = block.centerX[lane] * plane.x + block.centerY[lane] * plane.y + block.centerZ[lane] * plane.z + plane.w;
+				float boxRadius = block.extentX[lane] * std::fabs(plane.x) + block.extentY[lane] * std::fabs(plane.y) + block.extentZ[lane] * std::fabs(plane.z);
+				inside = distance + std::min(boxRadius, block.radius[lane]) + margin >= 0.0f;
+			}
+			if (inside) mask |= static_cast<uint8_t>(1u << lane);
+		}
+		visible[b] = mask & UsedLanes(b, count);
+	}
+}
+
+/// <summary>
+/// Box only test for a single volume, e.g. a whole model before its meshes are culled.
+/// </summary>
+bool IsBoxVisible(const glm::vec4* planes, float margin, const glm::vec3& minBounds, const glm::vec3& maxBounds)
+{
+	glm::vec3 center = (minBounds + maxBounds) * 0.5f;
+	glm::vec3 extent = (maxBounds - minBounds) * 0.5f;
+	for (int p = 0; p < FRUSTUM_PLANES; p++)
+	{
+		glm::vec3 normal(planes[p]);
+		if (glm::dot(normal, center) + planes[p].w + glm::dot(glm::abs(normal), extent) + margin < 0.0f) return false;
+	}
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef FRUSTUMCULLING_H
+#define FRUSTUMCULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Bounding volumes tested together, one per SIMD lane with AVX
+const size_t BOUNDS_BLOCK_SIZE = 8;
+
+/// <summary>
+/// Eight bounding volumes in SoA layout: an axis aligned box as center and half extents, and the radius of a bounding
+/// sphere around the same center. Lanes past the end of a BoundsSet are zero and never reported visible.
+/// </summary>
+struct BoundsBlock
+{
+	float centerX[BOUNDS_BLOCK_SIZE], centerY[BOUNDS_BLOCK_SIZE], centerZ[BOUNDS_BLOCK_SIZE];
+	float extentX[BOUNDS_BLOCK_SIZE], extentY[BOUNDS_BLOCK_SIZE], extentZ[BOUNDS_BLOCK_SIZE];
+	float radius[BOUNDS_BLOCK_SIZE];
+};
+
+/// <summary>
+/// Bounding volumes culled against a frustum a block at a time. Each volume counts as outside a plane when its box or
+/// its sphere is, whichever is tighter along the plane's normal, so one dot product per plane tests both. cull() uses
+/// AVX when the build enables it, SSE2 otherwise, and falls back to cullScalar() without either.
+/// </summary>
+class BoundsSet
+{
+public:
+	BoundsSet() : count(0) {}
+
+	void clear();
+	void add(const glm::vec3& minBounds, const glm::vec3& maxBounds, float radius);
+	size_t size() const { return count; }
+
+	void cull(const glm::vec4* planes, float margin, std::vector<uint8_t>& visible) const;
+	void cullScalar(const glm::vec4* planes, float margin, std::vector<uint8_t>& visible) const;
+
+private:
+	std::vector<BoundsBlock> blocks;
+	size_t count;
+};
+
+/// <summary>
+/// Whether volume index passed the cull that filled visible: bit index % 8 of the mask of block index / 8.
+/// </summary>
+inline bool IsBoundsVisible(const std::vector<uint8_t>& visible, size_t index)
+{
+	return (visible[index / BOUNDS_BLOCK_SIZE] >> (index % BOUNDS_BLOCK_SIZE)) & 1;
+}
+
+bool IsBoxVisible(const glm::vec4* planes, float margin, const glm::vec3& minBounds, const glm::vec3& maxBounds);
+
+#endif
@@ -0,0 +1,145 @@
+#include "GLStateCache.h"
+
+#include <glad/glad.h>
+
+namespace
+{
+	// Never a GL name, so the first bind after invalidate() always goes through
+	const unsigned int UNKNOWN = ~0u;
+
+	/// <summary>
+	/// Slot of a texture target in GLStateCache::textures, -1 for targets the cache does not track.
+	/// </summary>
+	int TargetSlot(unsigned int target)
+	{
+		if (target == GL_TEXTURE_2D) return 0;
+		if (target == GL_TEXTURE_2D_ARRAY) return 1;
+		return -1;
+	}
+}
+
+GLStateCache& GLStateCache::instance()
+{
+	static GLStateCache cache;
+	return cache;
+}
+
+GLStateCache::GLStateCache()
+	: frames(0)
+{
+	invalidate();
+}
+
+void GLStateCache::useProgram(unsigned int program)
+{
+	if (changed(this->program, program)) glUseProgram(program);
+}
+
+void GLStateCache::bindVertexArray(unsigned int vertexArray)
+{
+	if (changed(this->vertexArray, vertexArray)) glBindVertexArray(vertexArray);
+}
+
+/// <summary>
+/// Bind a texture to a unit, switching the active texture unit only if the bind is issued. The active unit is left
+/// wherever the last issued bind put it: code that binds with glBindTexture directly must bind through here instead.
+/// </summary>
+void GLStateCache::bindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+	int slot = TargetSlot(target);
+	if (unit >= GL_STATE_TEXTURE_UNITS || slot < 0)
+	{
+		activeTexture(unit);
+		glBindTexture(target, texture);
+		current.issued++;
+		return;
+	}
+	if (!changed(textures[unit][slot], texture)) return;
+	activeTexture(unit);
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::bindBufferBase(unsigned int target, unsigned int index, unsigned int buffer)
+{
+	unsigned int* bindings = target == GL_UNIFORM_BUFFER ? uniformBuffers : target == GL_SHADER_STORAGE_BUFFER ? storageBuffers : nullptr;
+	if (!bindings || index >= GL_STATE_BUFFER_BINDINGS)
+	{
+		glBindBufferBase(target, index, buffer);
+		current.issued++;
+		return;
+	}
+	if (changed(bindings[index], buffer)) glBindBufferBase(target, index, buffer);
+}
+
+/// <summary>
+/// A deleted program stays in use until another one is, but its name must not match a later program's.
+/// </summary>
+void GLStateCache::programDeleted(unsigned int program)
+{
+	if (this->program == program) this->program = UNKNOWN;
+}
+
+/// <summary>
+/// GL binds 0 wherever a deleted texture was bound.
+/// </summary>
+void GLStateCache::textureDeleted(unsigned int texture)
+{
+	for (auto& unit : textures)
+		for (unsigned int& bound : unit)
+			if (bound == texture) bound = 0;
+}
+
+void GLStateCache::bufferDeleted(unsigned int buffer)
+{
+	for (unsigned int i = 0; i < GL_STATE_BUFFER_BINDINGS; i++)
+	{
+		if (uniformBuffers[i] == buffer) uniformBuffers[i] = 0;
+		if (storageBuffers[i] == buffer) storageBuffers[i] = 0;
+	}
+}
+
+/// <summary>
+/// Forget everything, the next bind of each state is issued.
+/// </summary>
+void GLStateCache::invalidate()
+{
+	program = vertexArray = activeUnit = UNKNOWN;
+	for (auto& unit : textures)
+		for (unsigned int& bound : unit)
+			bound = UNKNOWN;
+	for (unsigned int i = 0; i < GL_STATE_BUFFER_BINDINGS; i++)
+		uniformBuffers[i] = storageBuffers[i] = UNKNOWN;
+}
+
+/// <summary>
+/// Close the counters of the frame that just ended and start counting the next one.
+/// </summary>
+void GLStateCache::beginFrame()
+{
+	previous = current;
+	overall.issued += current.issued;
+	overall.skipped += current.skipped;
+	current = GLStateStats();
+	frames++;
+}
+
+void GLStateCache::activeTexture(unsigned int unit)
+{
+	if (changed(activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+/// <summary>
+/// Record a bind of value over bound.
+/// </summary>
+/// <returns> true if the value differs and the bind has to be issued. </returns>
+bool GLStateCache::changed(unsigned int& bound, unsigned int value)
+{
+	if (bound == value)
+	{
+		current.skipped++;
+		return false;
+	}
+	bound = value;
+	current.issued++;
+	return true;
+}
@@ -0,0 +1,59 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include <cstddef>
+
+// Texture units and indexed buffer binding points the cache tracks. Binds outside of them always reach GL.
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+const unsigned int GL_STATE_BUFFER_BINDINGS = 16;
+
+struct GLStateStats
+{
+	size_t issued = 0;  // state changes that reached GL
+	size_t skipped = 0; // binds dropped because the state was already set
+};
+
+/// <summary>
+/// Shadow copy of the GL binding state the renderer changes most: the current program, the vertex array, 2D and 2D
+/// array textures per unit and the indexed uniform/ shader storage buffer bindings. Binding through the cache only
+/// calls GL when the value actually changes, so callers can bind what they need unconditionally. Anything that binds
+/// these behind the cache's back must call invalidate(), and deleting a texture or buffer must be reported, since GL
+/// unbinds deleted objects and their names get reused. GL thread only.
+/// </summary>
+class GLStateCache
+{
+public:
+	static GLStateCache& instance();
+
+	void useProgram(unsigned int program);
+	void bindVertexArray(unsigned int vertexArray);
+	void bindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+	void bindBufferBase(unsigned int target, unsigned int index, unsigned int buffer);
+
+	void programDeleted(unsigned int program);
+	void textureDeleted(unsigned int texture);
+	void bufferDeleted(unsigned int buffer);
+	void invalidate();
+
+	void beginFrame();
+	const GLStateStats& frame() const { return current; }
+	const GLStateStats& lastFrame() const { return previous; }
+	const GLStateStats& total() const { return overall; }
+	size_t frameCount() const { return frames; }
+
+private:
+	unsigned int program;
+	unsigned int vertexArray;
+	unsigned int activeUnit;
+	unsigned int textures[GL_STATE_TEXTURE_UNITS][2];       // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY
+	unsigned int uniformBuffers[GL_STATE_BUFFER_BINDINGS];
+	unsigned int storageBuffers[GL_STATE_BUFFER_BINDINGS];
+	GLStateStats current, previous, overall;
+	size_t frames;
+
+	GLStateCache();
+	void activeTexture(unsigned int unit);
+	bool changed(unsigned int& bound, unsigned int value);
+};
+
+#endif
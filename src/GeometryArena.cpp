@@ -0,0 +1,209 @@
+#include "GeometryArena.h"
+
+#include <glad/glad.h>
+#include <iostream>
+#include <iterator>
+#include "GLStateCache.h"
+#include "mesh.h"
+
+/// <summary>
+/// Take the first free range that is large enough.
+/// </summary>
+/// <returns> false if no free range fits, grow() and try again. </returns>
+bool RangeAllocator::allocate(size_t count, size_t& offset)
+{
+	if (count == 0)
+	{
+		offset = 0;
+		return true;
+	}
+	for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+	{
+		if (range->second < count) continue;
+		offset = range->first;
+		size_t remaining = range->second - count;
+		freeRanges.erase(range);
+		if (remaining > 0) freeRanges[offset + count] = remaining;
+		used += count;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t count)
+{
+	if (count == 0) return;
+	used -= count;
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && offset + count == next->first) // merge with the range after it
+	{
+		count += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) // and with the range before it
+		{
+			previous->second += count;
+			return;
+		}
+	}
+	freeRanges[offset] = count;
+}
+
+/// <summary>
+/// Add [size(), newCapacity) to the free ranges.
+/// </summary>
+void RangeAllocator::grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity) return;
+	size_t added = newCapacity - capacity;
+	used += added; // free() takes it off again
+	free(capacity, added);
+	capacity = newCapacity;
+}
+
+GeometryArena& GeometryArena::forLayout(bool quantized)
+{
+	// Separate statics, so an arena's buffers are only created once a mesh with its layout exists
+	if (quantized)
+	{
+		static GeometryArena quantizedArena(true);
+		return quantizedArena;
+	}
+	static GeometryArena floatArena(false);
+	return floatArena;
+}
+
+/// <summary>
+/// Create the empty buffers and the vertex array for either the Vertex or the QuantizedVertex layout. Attribute 3 is
+/// the per-draw ID: one value per instance, so a draw's baseInstance picks it from the buffer DrawBatch attaches to
+/// DRAW_ID_VERTEX_BINDING.
+/// </summary>
+GeometryArena::GeometryArena(bool quantized)
+	: VAO(0), VBO(0), EBO(0), quantized(quantized), stride(quantized ? sizeof(QuantizedVertex) : sizeof(Vertex))
+{
+	glGenVertexArrays(1, &VAO);
+	GLStateCache::instance().bindVertexArray(VAO);
+	if (quantized)
+	{
+		// Positions as unorm16 relative to the mesh bounds, octahedral snorm16 normals, half float texCoords
+		glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position));
+		glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(QuantizedVertex, normal));
+		glVertexAttribFormat(2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, texCoords));
+	}
+	else
+	{
+		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position));
+		glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal));
+		glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords));
+	}
+	for (GLuint attribute = 0; attribute < 3; attribute++)
+	{
+		glVertexAttribBinding(attribute, 0);
+		glEnableVertexAttribArray(attribute);
+	}
+
+	glVertexAttribIFormat(3, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(3, DRAW_ID_VERTEX_BINDING);
+	glVertexBindingDivisor(DRAW_ID_VERTEX_BINDING, 1);
+	glEnableVertexAttribArray(3);
+
+	growBuffer(VBO, vertices, stride, GEOMETRY_ARENA_INITIAL_VERTICES);
+	growBuffer(EBO, indices, sizeof(unsigned int), GEOMETRY_ARENA_INITIAL_INDICES);
+}
+
+/// <summary>
+/// Reserve room for a mesh's vertices and indices, growing the buffers if needed. The contents are undefined until
+/// written with writeVertices()/ writeIndices().
+/// </summary>
+GeometryAllocation GeometryArena::allocate(size_t vertexCount, size_t indexCount)
+{
+	size_t vertexOffset, indexOffset;
+	if (!vertices.allocate(vertexCount, vertexOffset))
+	{
+		growBuffer(VBO, vertices, stride, vertices.size() + vertexCount);
+		vertices.allocate(vertexCount, vertexOffset);
+	}
+	if (!indices.allocate(indexCount, indexOffset))
+	{
+		growBuffer(EBO, indices, sizeof(unsigned int), indices.size() + indexCount);
+		indices.allocate(indexCount, indexOffset);
+	}
+
+	GeometryAllocation allocation;
+	allocation.firstVertex = static_cast<unsigned int>(vertexOffset);
+	allocation.vertexCount = static_cast<unsigned int>(vertexCount);
+	allocation.firstIndex = static_cast<unsigned int>(indexOffset);
+	allocation.indexCount = static_cast<unsigned int>(indexCount);
+	return allocation;
+}
+
+/// <summary>
+/// Give the allocation's ranges back. The buffers never shrink.
+/// </summary>
+void GeometryArena::free(const GeometryAllocation& allocation)
+{
+	vertices.free(allocation.firstVertex, allocation.vertexCount);
+	indices.free(allocation.firstIndex, allocation.indexCount);
+}
+
+/// <summary>
+/// Copy bytes into the allocation's vertices, starting byteOffset bytes into them.
+/// </summary>
+void GeometryArena::writeVertices(const GeometryAllocation& allocation, size_t byteOffset, size_t bytes, const void* data)
+{
+	// GL_COPY_WRITE_BUFFER leaves the element array binding of whatever VAO is bound alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * stride + byteOffset, bytes, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GeometryArena::writeIndices(const GeometryAllocation& allocation, size_t byteOffset, size_t bytes, const void* data)
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * sizeof(unsigned int) + byteOffset, bytes, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+/// <summary>
+/// Read the allocation's first count vertices back, in the arena's vertex layout.
+/// </summary>
+void GeometryArena::readVertices(const GeometryAllocation& allocation, size_t count, void* out) const
+{
+	glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, allocation.firstVertex * stride, count * stride, out);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+/// <summary>
+/// Replace the buffer with one at least twice as large (and with room for minimumCount elements), copying the
+/// contents over on the GPU and pointing the vertex array at it.
+/// </summary>
+void GeometryArena::growBuffer(unsigned int& buffer, RangeAllocator& ranges, size_t elementSize, size_t minimumCount)
+{
+	size_t newCount = ranges.size() * 2;
+	if (newCount < minimumCount) newCount = minimumCount;
+
+	unsigned int grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCount * elementSize, nullptr, GL_STATIC_DRAW);
+	if (buffer)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, ranges.size() * elementSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		std::cout << "DEBUG LOG: GEOMETRY ARENA (" << (quantized ? "QUANTIZED" : "FLOAT") << ") GREW TO " << newCount * elementSize / 1024
+			<< " KB OF " << (&ranges == &vertices ? "VERTICES" : "INDICES") << std::endl;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	buffer = grown;
+	ranges.grow(newCount);
+
+	GLStateCache::instance().bindVertexArray(VAO);
+	if (&ranges == &vertices) glBindVertexBuffer(0, VBO, 0, static_cast<GLsizei>(stride));
+	else glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+}
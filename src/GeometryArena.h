@@ -0,0 +1,79 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <cstddef>
+#include <map>
+
+// Capacity each arena starts with. Both buffers double whenever an allocation does not fit.
+const size_t GEOMETRY_ARENA_INITIAL_VERTICES = 256 * 1024;
+const size_t GEOMETRY_ARENA_INITIAL_INDICES = 1024 * 1024;
+
+// Vertex buffer binding the per-draw ID stream is attached to (see DrawBatch), read as attribute 3
+const unsigned int DRAW_ID_VERTEX_BINDING = 1;
+
+/// <summary>
+/// A mesh's share of an arena: vertices [firstVertex, firstVertex + vertexCount) of the vertex buffer and indices
+/// [firstIndex, firstIndex + indexCount) of the index buffer. The indices stay relative to the mesh's first vertex,
+/// draws add firstVertex as their base vertex.
+/// </summary>
+struct GeometryAllocation
+{
+	unsigned int firstVertex = 0;
+	unsigned int vertexCount = 0;
+	unsigned int firstIndex = 0;
+	unsigned int indexCount = 0;
+};
+
+/// <summary>
+/// First-fit allocator of element ranges, with neighbouring free ranges merged on free.
+/// </summary>
+class RangeAllocator
+{
+public:
+	RangeAllocator() : capacity(0), used(0) {}
+	bool allocate(size_t count, size_t& offset);
+	void free(size_t offset, size_t count);
+	void grow(size_t newCapacity);
+	size_t size() const { return capacity; }
+	size_t usedCount() const { return used; }
+
+private:
+	std::map<size_t, size_t> freeRanges; // offset -> count
+	size_t capacity;
+	size_t used;
+};
+
+/// <summary>
+/// One vertex buffer, one index buffer and the vertex array reading them, shared by every mesh with the same vertex
+/// layout (see forLayout). Meshes are suballocated into the buffers, so all of them can be drawn with one vertex array
+/// bound and a single multi-draw. Growing moves the contents into larger buffers but keeps every allocation's offsets,
+/// so meshes never have to be told. GL thread only.
+/// </summary>
+class GeometryArena
+{
+public:
+	static GeometryArena& forLayout(bool quantized);
+
+	GeometryAllocation allocate(size_t vertexCount, size_t indexCount);
+	void free(const GeometryAllocation& allocation);
+	void writeVertices(const GeometryAllocation& allocation, size_t byteOffset, size_t bytes, const void* data);
+	void writeIndices(const GeometryAllocation& allocation, size_t byteOffset, size_t bytes, const void* data);
+	void readVertices(const GeometryAllocation& allocation, size_t count, void* out) const;
+
+	unsigned int vertexArray() const { return VAO; }
+	size_t vertexStride() const { return stride; }
+	size_t capacityBytes() const { return vertices.size() * stride + indices.size() * sizeof(unsigned int); }
+	size_t usedBytes() const { return vertices.usedCount() * stride + indices.usedCount() * sizeof(unsigned int); }
+
+private:
+	unsigned int VAO, VBO, EBO;
+	bool quantized;
+	size_t stride;
+	RangeAllocator vertices;
+	RangeAllocator indices;
+
+	explicit GeometryArena(bool quantized);
+	void growBuffer(unsigned int& buffer, RangeAllocator& ranges, size_t elementSize, size_t minimumCount);
+};
+
+#endif
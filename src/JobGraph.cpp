@@ -0,0 +1,159 @@
+#include "JobGraph.h"
+
+#include <chrono>
+#include "ThreadPool.h"
+
+JobGraph::JobGraph()
+	: state(std::make_shared<State>()), started(false)
+{
+}
+
+/// <summary>
+/// Jobs may capture data owned by whoever built the graph, so a started graph is run to the end before it goes away.
+/// </summary>
+JobGraph::~JobGraph()
+{
+	if (started) wait();
+}
+
+/// <summary>
+/// Add a job. Only valid before start().
+/// </summary>
+/// <param name="work"></param>
+/// <param name="thread"> Main for anything that touches GL. </param>
+/// <param name="dependencies"> jobs that have to finish first, all added earlier. </param>
+/// <returns> id to pass as a dependency of later jobs. </returns>
+JobGraph::JobId JobGraph::add(std::function<void()> work, JobThread thread, const std::vector<JobId>& dependencies)
+{
+	JobId id = state->jobs.size();
+	Job job;
+	job.work = std::move(work);
+	job.thread = thread;
+	job.waitingOn = dependencies.size();
+	state->jobs.push_back(std::move(job));
+	for (JobId dependency : dependencies)
+		state->jobs[dependency].dependents.push_back(id);
+	return id;
+}
+
+/// <summary>
+/// Start every job without dependencies. The graph cannot be changed afterwards.
+/// </summary>
+void JobGraph::start()
+{
+	if (started) return;
+	started = true;
+
+	std::vector<JobId> roots;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->remaining = state->jobs.size();
+		for (JobId id = 0; id < state->jobs.size(); id++)
+		{
+			if (state->jobs[id].waitingOn > 0) continue;
+			if (state->jobs[id].thread == JobThread::Main) state->mainReady.push_back(id);
+			else roots.push_back(id);
+		}
+	}
+	for (JobId id : roots)
+		dispatch(state, id);
+}
+
+/// <summary>
+/// Run the main thread jobs that are ready, until none are left or the time budget is used up (at least one job is run
+/// if any is ready, so a single long job can overrun the budget).
+/// </summary>
+/// <param name="budgetMs"> time this call may spend running jobs. </param>
+/// <returns> true once every job of the graph has finished. </returns>
+bool JobGraph::runMainThreadJobs(double budgetMs)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	while (runNextMainThreadJob())
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		if (elapsed.count() >= budgetMs) break;
+	}
+	return finished();
+}
+
+/// <summary>
+/// Block until the whole graph has finished, running main thread jobs as they become ready.
+/// </summary>
+void JobGraph::wait()
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->condition.wait(lock, [this]() { return state->remaining == 0 || !state->mainReady.empty(); });
+			if (state->remaining == 0) return;
+		}
+		runNextMainThreadJob();
+	}
+}
+
+/// <summary>
+/// Skip every job that has not started yet (jobs already running still finish), e.g. when the GL context is gone.
+/// wait() then returns as soon as the running jobs are done.
+/// </summary>
+void JobGraph::cancel()
+{
+	state->cancelled = true;
+}
+
+bool JobGraph::finished() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return started && state->remaining == 0;
+}
+
+size_t JobGraph::jobCount() const
+{
+	return state->jobs.size();
+}
+
+bool JobGraph::runNextMainThreadJob()
+{
+	JobId id;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		if (state->mainReady.empty()) return false;
+		id = state->mainReady.front();
+		state->mainReady.pop_front();
+	}
+	runJob(state, id);
+	return true;
+}
+
+void JobGraph::dispatch(const std::shared_ptr<State>& state, JobId id)
+{
+	ThreadPool::shared().submit([state, id]() { runJob(state, id); });
+}
+
+void JobGraph::runJob(const std::shared_ptr<State>& state, JobId id)
+{
+	if (!state->cancelled) state->jobs[id].work();
+	finishJob(state, id);
+}
+
+/// <summary>
+/// Mark a job as done and release the dependents it was the last dependency of.
+/// </summary>
+void JobGraph::finishJob(const std::shared_ptr<State>& state, JobId id)
+{
+	std::vector<JobId> ready;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		for (JobId dependent : state->jobs[id].dependents)
+		{
+			if (--state->jobs[dependent].waitingOn > 0) continue;
+			if (state->jobs[dependent].thread == JobThread::Main) state->mainReady.push_back(dependent);
+			else ready.push_back(dependent);
+		}
+		state->remaining--;
+	}
+	state->condition.notify_all();
+
+	for (JobId dependent : ready)
+		dispatch(state, dependent);
+}
@@ -0,0 +1,75 @@
+#ifndef JOBGRAPH_H
+#define JOBGRAPH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Where a job of a JobGraph runs
+enum class JobThread
+{
+	Worker, // on the shared ThreadPool, no GL calls
+	Main    // on the thread that owns the GL context, inside runMainThreadJobs()/ wait()
+};
+
+/// <summary>
+/// Jobs with dependencies between them. A job becomes runnable once every job it depends on has finished: worker jobs
+/// are then submitted to the shared ThreadPool, main thread jobs are queued until the GL thread calls
+/// runMainThreadJobs() or wait(). Jobs are added before start() and each runs exactly once.
+/// </summary>
+class JobGraph
+{
+public:
+	typedef size_t JobId;
+
+	JobGraph();
+	~JobGraph();
+	JobGraph(const JobGraph&) = delete;
+	JobGraph& operator=(const JobGraph&) = delete;
+
+	JobId add(std::function<void()> work, JobThread thread = JobThread::Worker, const std::vector<JobId>& dependencies = std::vector<JobId>());
+	void start();
+
+	// GL thread only
+	bool runMainThreadJobs(double budgetMs);
+	void wait();
+	void cancel();
+
+	bool finished() const;
+	size_t jobCount() const;
+
+private:
+	struct Job
+	{
+		std::function<void()> work;
+		JobThread thread;
+		size_t waitingOn;             // unfinished dependencies, guarded by State::mutex
+		std::vector<JobId> dependents;
+	};
+
+	// Shared with the worker jobs in flight
+	struct State
+	{
+		std::vector<Job> jobs;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<JobId> mainReady;
+		size_t remaining = 0;
+		std::atomic<bool> cancelled{ false }; // jobs that have not started yet are skipped
+	};
+
+	std::shared_ptr<State> state;
+	bool started;
+
+	static void dispatch(const std::shared_ptr<State>& state, JobId id);
+	static void runJob(const std::shared_ptr<State>& state, JobId id);
+	static void finishJob(const std::shared_ptr<State>& state, JobId id);
+	bool runNextMainThreadJob();
+};
+
+#endif
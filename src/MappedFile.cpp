@@ -0,0 +1,96 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+bool GetFileStamp(const std::string& path, uint64_t& size, int64_t& modifiedTime)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0) return false;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return false;
+#endif
+	size = static_cast<uint64_t>(info.st_size);
+	modifiedTime = static_cast<int64_t>(info.st_mtime);
+	return true;
+}
+
+MappedFile::MappedFile()
+	: bytes(nullptr), length(0)
+{
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+/// <summary>
+/// Map the file at the given path into memory. Empty files are treated as a failure since they cannot be mapped.
+/// </summary>
+/// <param name="path"></param>
+/// <returns> true if the file is now mapped. </returns>
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) { close(); return false; }
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL) { close(); return false; }
+
+	bytes = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (bytes == nullptr) { close(); return false; }
+	length = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) { ::close(fd); return false; }
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps its own reference to the file
+	if (mapping == MAP_FAILED) return false;
+
+	madvise(mapping, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+	bytes = static_cast<const unsigned char*>(mapping);
+	length = static_cast<size_t>(info.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (bytes) UnmapViewOfFile(bytes);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+	bytes = nullptr;
+	length = 0;
+}
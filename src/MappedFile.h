@@ -0,0 +1,38 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Size and modification time of a file on disk, used to detect stale derived files (mesh caches, cooked textures)
+bool GetFileStamp(const std::string& path, uint64_t& size, int64_t& modifiedTime);
+
+/// <summary>
+/// Read-only memory mapping of a whole file. The mapping is released when the object is closed or destroyed.
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return bytes != nullptr; }
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const unsigned char* bytes;
+	size_t length;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
+
+#endif
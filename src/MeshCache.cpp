@@ -0,0 +1,284 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "Arena.h"
+
+namespace
+{
+	const char MESH_CACHE_MAGIC[4] = { 'M', 'D', 'M', 'C' };
+	const uint32_t MESH_CACHE_VERSION = 3;
+
+	// Every section of the file starts on this boundary, so vertex and index arrays can be read in place
+	const size_t MESH_CACHE_ALIGNMENT = 16;
+
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceSize;
+		int64_t sourceModifiedTime;
+		uint32_t flags;
+		uint32_t meshCount;
+		uint32_t totalVertices;
+		float modelCenter[3];
+		float minBounds[3];
+		float maxBounds[3];
+	};
+
+	struct MeshRecordHeader
+	{
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t textureCount;
+		float ambient[3];
+		float diffuse[3];
+		float specular[3];
+		float shininess;
+		uint32_t lodCount;
+		uint32_t padding[2];
+	};
+
+	size_t AlignUp(size_t offset)
+	{
+		return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+	}
+
+	void Append(ArenaVector<char>& buffer, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+
+	void AppendString(ArenaVector<char>& buffer, const std::string& str)
+	{
+		uint32_t length = static_cast<uint32_t>(str.size());
+		Append(buffer, &length, sizeof(length));
+		Append(buffer, str.data(), str.size());
+	}
+
+	void Pad(ArenaVector<char>& buffer)
+	{
+		buffer.resize(AlignUp(buffer.size()), 0);
+	}
+
+	/// <summary>
+	/// Bounds-checked sequential reader over the mapped cache file.
+	/// </summary>
+	class CacheCursor
+	{
+	public:
+		CacheCursor(const unsigned char* data, size_t size) : data(data), size(size), offset(0) {}
+
+		const void* take(size_t bytes)
+		{
+			if (bytes > size - offset) return nullptr;
+			const void* result = data + offset;
+			offset += bytes;
+			return result;
+		}
+
+		bool readString(std::string& str)
+		{
+			const void* lengthPtr = take(sizeof(uint32_t));
+			if (!lengthPtr) return false;
+			uint32_t length;
+			std::memcpy(&length, lengthPtr, sizeof(length));
+			const void* chars = take(length);
+			if (!chars) return false;
+			str.assign(static_cast<const char*>(chars), length);
+			return true;
+		}
+
+		bool align()
+		{
+			size_t aligned = AlignUp(offset);
+			if (aligned > size) return false;
+			offset = aligned;
+			return true;
+		}
+
+	private:
+		const unsigned char* data;
+		size_t size;
+		size_t offset;
+	};
+}
+
+std::string MeshCachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+/// <summary>
+/// Map the cache file for the given source asset and validate it against the asset on disk.
+/// </summary>
+/// <param name="sourcePath"> path of the original model file. </param>
+/// <param name="flags"> MESH_CACHE_FLAG_* the caller would have processed the model with. </param>
+/// <returns> false if there is no cache, it is from another version/ flag set, or the source asset has changed since. </returns>
+bool MeshCacheReader::open(const std::string& sourcePath, unsigned int flags)
+{
+	meshes.clear();
+
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime;
+	if (!GetFileStamp(sourcePath, sourceSize, sourceModifiedTime)) return false;
+	if (!file.open(MeshCachePath(sourcePath))) return false;
+
+	CacheCursor cursor(file.data(), file.size());
+	const MeshCacheHeader* header = static_cast<const MeshCacheHeader*>(cursor.take(sizeof(MeshCacheHeader)));
+	if (!header || std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+		header->version != MESH_CACHE_VERSION || header->flags != flags)
+	{
+		file.close(); return false;
+	}
+
+	// Stale cache: the source asset was re-exported after the cache was written
+	if (header->sourceSize != sourceSize || header->sourceModifiedTime != sourceModifiedTime)
+	{
+		file.close(); return false;
+	}
+
+	totalVertices = header->totalVertices;
+	modelCenter = glm::vec3(header->modelCenter[0], header->modelCenter[1], header->modelCenter[2]);
+	minBounds = glm::vec3(header->minBounds[0], header->minBounds[1], header->minBounds[2]);
+	maxBounds = glm::vec3(header->maxBounds[0], header->maxBounds[1], header->maxBounds[2]);
+
+	meshes.resize(header->meshCount);
+	for (CachedMesh& mesh : meshes)
+	{
+		const MeshRecordHeader* record = static_cast<const MeshRecordHeader*>(cursor.take(sizeof(MeshRecordHeader)));
+		if (!record) { meshes.clear(); file.close(); return false; }
+
+		mesh.vertexCount = record->vertexCount;
+		mesh.indexCount = record->indexCount;
+		mesh.material.ambient = glm::vec3(record->ambient[0], record->ambient[1], record->ambient[2]);
+		mesh.material.diffuse = glm::vec3(record->diffuse[0], record->diffuse[1], record->diffuse[2]);
+		mesh.material.specular = glm::vec3(record->specular[0], record->specular[1], record->specular[2]);
+		mesh.material.shininess = record->shininess;
+
+		mesh.textures.resize(record->textureCount);
+		for (Texture& texture : mesh.textures)
+		{
+			texture.id = 0;
+			if (!cursor.readString(texture.type) || !cursor.readString(texture.path)) { meshes.clear(); file.close(); return false; }
+		}
+
+		bool valid = cursor.align();
+		mesh.vertices = valid ? static_cast<const Vertex*>(cursor.take(sizeof(Vertex) * size_t(mesh.vertexCount))) : nullptr;
+		valid = valid && mesh.vertices && cursor.align();
+		mesh.indices = valid ? static_cast<const unsigned int*>(cursor.take(sizeof(unsigned int) * size_t(mesh.indexCount))) : nullptr;
+		valid = valid && mesh.indices && cursor.align();
+		const MeshLod* lods = valid ? static_cast<const MeshLod*>(cursor.take(sizeof(MeshLod) * size_t(record->lodCount))) : nullptr;
+		valid = valid && (lods || record->lodCount == 0) && cursor.align();
+		if (!valid) { meshes.clear(); file.close(); return false; }
+
+		mesh.lods.assign(lods, lods + record->lodCount);
+		for (const MeshLod& lod : mesh.lods)
+		{
+			if (size_t(lod.indexOffset) + lod.indexCount > mesh.indexCount) { meshes.clear(); file.close(); return false; }
+		}
+	}
+
+	return true;
+}
+
+namespace
+{
+	/// <summary>
+	/// Serialize the processed meshes, material values, texture paths and bounds of a model next to its source asset.
+	/// The file is written under a temporary name first so a crash mid-write never leaves a truncated cache behind.
+	/// Works on uploaded Meshes as well as on CPU-side MeshData, which have the same members.
+	/// </summary>
+	/// <returns> true if the cache file was written. </returns>
+	template <class MeshType>
+	bool WriteMeshCacheFile(const std::string& sourcePath, unsigned int flags, const std::vector<MeshType>& meshes, unsigned int totalVertices,
+		const glm::vec3& modelCenter, const glm::vec3& minBounds, const glm::vec3& maxBounds)
+	{
+		MeshCacheHeader header = {};
+		std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+		header.version = MESH_CACHE_VERSION;
+		if (!GetFileStamp(sourcePath, header.sourceSize, header.sourceModifiedTime)) return false;
+		header.flags = flags;
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.totalVertices = totalVertices;
+		for (int i = 0; i < 3; i++)
+		{
+			header.modelCenter[i] = modelCenter[i];
+			header.minBounds[i] = minBounds[i];
+			header.maxBounds[i] = maxBounds[i];
+		}
+
+		// Size the buffer exactly up front, so large meshes are not copied again by the vector growing
+		size_t fileSize = sizeof(header);
+		for (const MeshType& mesh : meshes)
+		{
+			fileSize += sizeof(MeshRecordHeader);
+			for (const Texture& texture : mesh.textures)
+				fileSize += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+			fileSize = AlignUp(AlignUp(fileSize) + mesh.vertices.size() * sizeof(Vertex));
+			fileSize = AlignUp(fileSize + mesh.indices.size() * sizeof(unsigned int));
+			fileSize = AlignUp(fileSize + mesh.lods.size() * sizeof(MeshLod));
+		}
+
+		ArenaVector<char> buffer;
+		buffer.reserve(fileSize);
+		Append(buffer, &header, sizeof(header));
+
+		for (const MeshType& mesh : meshes)
+		{
+			MeshRecordHeader record = {};
+			record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+			record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+			record.textureCount = static_cast<uint32_t>(mesh.textures.size());
+			for (int i = 0; i < 3; i++)
+			{
+				record.ambient[i] = mesh.material.ambient[i];
+				record.diffuse[i] = mesh.material.diffuse[i];
+				record.specular[i] = mesh.material.specular[i];
+			}
+			record.shininess = mesh.material.shininess;
+			record.lodCount = static_cast<uint32_t>(mesh.lods.size());
+			Append(buffer, &record, sizeof(record));
+
+			for (const Texture& texture : mesh.textures)
+			{
+				AppendString(buffer, texture.type);
+				AppendString(buffer, texture.path);
+			}
+
+			Pad(buffer);
+			Append(buffer, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+			Pad(buffer);
+			Append(buffer, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+			Pad(buffer);
+			Append(buffer, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+			Pad(buffer);
+		}
+
+		std::string cachePath = MeshCachePath(sourcePath);
+		std::string tempPath = cachePath + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out) return false;
+			out.write(buffer.data(), buffer.size());
+			if (!out) { out.close(); std::remove(tempPath.c_str()); return false; }
+		}
+
+		std::remove(cachePath.c_str()); // rename() does not overwrite on Windows
+		return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+	}
+}
+
+bool WriteMeshCache(const std::string& sourcePath, unsigned int flags, const std::vector<Mesh>& meshes, unsigned int totalVertices,
+	const glm::vec3& modelCenter, const glm::vec3& minBounds, const glm::vec3& maxBounds)
+{
+	return WriteMeshCacheFile(sourcePath, flags, meshes, totalVertices, modelCenter, minBounds, maxBounds);
+}
+
+bool WriteMeshCache(const std::string& sourcePath, unsigned int flags, const std::vector<MeshData>& meshes, unsigned int totalVertices,
+	const glm::vec3& modelCenter, const glm::vec3& minBounds, const glm::vec3& maxBounds)
+{
+	return WriteMeshCacheFile(sourcePath, flags, meshes, totalVertices, modelCenter, minBounds, maxBounds);
+}
@@ -0,0 +1,56 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh.h"
+#include "MappedFile.h"
+
+/// <summary>
+/// A mesh as stored in the cache file. Vertex and index pointers point straight into the memory mapping
+/// and are only valid while the owning MeshCacheReader is alive. Textures only carry their type and path.
+/// </summary>
+struct CachedMesh
+{
+	const Vertex* vertices;
+	uint32_t vertexCount;
+	const unsigned int* indices;
+	uint32_t indexCount;
+	Material material;
+	std::vector<Texture> textures;
+	std::vector<MeshLod> lods;
+};
+
+/// <summary>
+/// Versioned binary cache of a processed model, written next to the source asset (e.g. "brick_wall.obj.meshcache").
+/// The cache stores the source file's size and modification time, so an edited asset invalidates it automatically.
+/// </summary>
+class MeshCacheReader
+{
+public:
+	unsigned int totalVertices;
+	glm::vec3 modelCenter;
+	glm::vec3 minBounds;
+	glm::vec3 maxBounds;
+	std::vector<CachedMesh> meshes;
+
+	bool open(const std::string& sourcePath, unsigned int flags);
+
+private:
+	MappedFile file;
+};
+
+// Flags describing how the cached geometry was produced
+const unsigned int MESH_CACHE_FLAG_OBJ_LOADER = 1u << 0;
+const unsigned int MESH_CACHE_FLAG_OPTIMIZED = 1u << 1;
+const unsigned int MESH_CACHE_FLAG_LODS = 1u << 2;
+
+std::string MeshCachePath(const std::string& sourcePath);
+bool WriteMeshCache(const std::string& sourcePath, unsigned int flags, const std::vector<Mesh>& meshes, unsigned int totalVertices,
+	const glm::vec3& modelCenter, const glm::vec3& minBounds, const glm::vec3& maxBounds);
+bool WriteMeshCache(const std::string& sourcePath, unsigned int flags, const std::vector<MeshData>& meshes, unsigned int totalVertices,
+	const glm::vec3& modelCenter, const glm::vec3& minBounds, const glm::vec3& maxBounds);
+
+#endif
@@ -0,0 +1,332 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "Arena.h"
+
+namespace
+{
+	// Size of the simulated FIFO cache, and of the LRU cache the reordering optimizes for
+	const unsigned int CACHE_SIZE = 32;
+
+	// Overdraw reordering is rejected if it makes the ACMR worse than this factor
+	const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+	// Scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	struct VertexKeyHash
+	{
+		size_t operator()(const Vertex& vertex) const
+		{
+			uint32_t words[sizeof(Vertex) / 4];
+			std::memcpy(words, &vertex, sizeof(Vertex));
+			uint64_t hash = 14695981039346656037ull;
+			for (uint32_t word : words)
+			{
+				hash ^= word;
+				hash *= 1099511628211ull;
+			}
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	// Bitwise equality, so only truly identical vertices are merged (and -0.0/ NaN can't break the hash map)
+	struct VertexKeyEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; }
+	};
+
+	float VertexScore(int cachePosition, unsigned int remainingTriangles)
+	{
+		if (remainingTriangles == 0) return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3) score = LAST_TRIANGLE_SCORE; // used by the previous triangle, no matter which order
+			else
+			{
+				float scaler = 1.0f / (CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Boost vertices with few triangles left, so lone triangles don't get stranded
+		score += VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	void RemapIndices(std::vector<unsigned int>& indices, const ArenaVector<unsigned int>& remap)
+	{
+		for (unsigned int& index : indices)
+			index = remap[index];
+	}
+}
+
+/// <summary>
+/// Simulate a FIFO post-transform cache (CACHE_SIZE entries) to count how many vertices would be shaded.
+/// </summary>
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	VertexCacheStats stats;
+	stats.triangles = indices.size() / 3;
+	stats.vertices = vertexCount;
+
+	ArenaVector<size_t> insertedAt(vertexCount, 0); // 0 = never in the cache
+	size_t timestamp = CACHE_SIZE + 1;
+	for (unsigned int index : indices)
+	{
+		if (index >= vertexCount) continue;
+		if (insertedAt[index] == 0 || timestamp - insertedAt[index] > CACHE_SIZE)
+		{
+			insertedAt[index] = timestamp++;
+			stats.misses++;
+		}
+	}
+	return stats;
+}
+
+/// <summary>
+/// Merge vertices whose position, normal and texture coordinates are bit-for-bit identical.
+/// ASSIMP's OBJ import emits one vertex per face corner, so this usually shrinks the vertex buffer a lot.
+/// </summary>
+void WeldVertices(MeshData& mesh)
+{
+	ArenaHashMap<Vertex, unsigned int, VertexKeyHash, VertexKeyEqual> unique;
+	unique.reserve(mesh.vertices.size());
+
+	ArenaVector<unsigned int> remap(mesh.vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		auto inserted = unique.emplace(mesh.vertices[i], static_cast<unsigned int>(welded.size()));
+		if (inserted.second) welded.push_back(mesh.vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+
+	RemapIndices(mesh.indices, remap);
+	mesh.vertices.swap(welded);
+}
+
+/// <summary>
+/// Reorder triangles for post-transform cache locality (Forsyth's algorithm). Vertices are kept as they are.
+/// </summary>
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// Triangle adjacency per vertex
+	ArenaVector<unsigned int> remaining(vertexCount, 0);
+	for (unsigned int index : indices) remaining[index]++;
+
+	ArenaVector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+	ArenaVector<unsigned int> adjacency(indices.size());
+	ArenaVector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+	ArenaVector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	ArenaVector<float> triangleScore(triangleCount);
+	ArenaVector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	ArenaVector<unsigned int> cache, nextCache;
+	cache.reserve(CACHE_SIZE + 3);
+	nextCache.reserve(CACHE_SIZE + 3);
+	size_t scanCursor = 0;
+
+	int best = -1;
+	while (output.size() < indices.size())
+	{
+		// Nothing adjacent to the cache is left: fall back to the best remaining triangle
+		if (best < 0)
+		{
+			float bestScore = -1.0f;
+			for (size_t t = scanCursor; t < triangleCount; t++)
+			{
+				if (emitted[t]) { if (t == scanCursor) scanCursor++; continue; }
+				if (triangleScore[t] > bestScore) { bestScore = triangleScore[t]; best = static_cast<int>(t); }
+			}
+			if (best < 0) break;
+		}
+
+		// Emit the triangle and push its vertices to the front of the cache
+		emitted[best] = true;
+		nextCache.clear();
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[best * 3 + k];
+			output.push_back(v);
+			nextCache.push_back(v);
+
+			// Remove the triangle from the vertex's adjacency list
+			unsigned int begin = adjacencyOffset[v], end = begin + remaining[v];
+			for (unsigned int a = begin; a < end; a++)
+			{
+				if (adjacency[a] == static_cast<unsigned int>(best)) { std::swap(adjacency[a], adjacency[end - 1]); break; }
+			}
+			remaining[v]--;
+		}
+		for (unsigned int v : cache)
+			if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2]) nextCache.push_back(v);
+
+		// Vertices falling out of the cache lose their cache score, and so do their triangles for the fallback scan
+		for (size_t i = CACHE_SIZE; i < nextCache.size(); i++)
+		{
+			unsigned int v = nextCache[i];
+			vertexScore[v] = VertexScore(-1, remaining[v]);
+			unsigned int begin = adjacencyOffset[v], end = begin + remaining[v];
+			for (unsigned int a = begin; a < end; a++)
+			{
+				unsigned int t = adjacency[a];
+				triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+			}
+		}
+		if (nextCache.size() > CACHE_SIZE) nextCache.resize(CACHE_SIZE);
+		cache.swap(nextCache);
+
+		// Rescore the cached vertices and their triangles, and pick the best one of those next
+		for (size_t i = 0; i < cache.size(); i++) vertexScore[cache[i]] = VertexScore(static_cast<int>(i), remaining[cache[i]]);
+
+		best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int v : cache)
+		{
+			unsigned int begin = adjacencyOffset[v], end = begin + remaining[v];
+			for (unsigned int a = begin; a < end; a++)
+			{
+				unsigned int t = adjacency[a];
+				float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				triangleScore[t] = score;
+				if (score > bestScore) { bestScore = score; best = static_cast<int>(t); }
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+/// <summary>
+/// Reorder the (vertex cache optimized) triangles so that outward facing clusters come first, which lets them occlude
+/// the rest of the mesh and cuts fragment shading. Clusters are split where the cache simulation hits a triangle with
+/// three misses, so cache locality within a cluster is kept. The new order is dropped if it hurts the ACMR too much.
+/// </summary>
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2) return;
+
+	// 1. Split into clusters at hard cache boundaries
+	ArenaVector<size_t> clusterStarts;
+	ArenaVector<size_t> insertedAt(vertices.size(), 0);
+	size_t timestamp = CACHE_SIZE + 1;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			if (insertedAt[v] == 0 || timestamp - insertedAt[v] > CACHE_SIZE) { insertedAt[v] = timestamp++; misses++; }
+		}
+		if (t == 0 || misses == 3) clusterStarts.push_back(t);
+	}
+	if (clusterStarts.size() < 2) return;
+	clusterStarts.push_back(triangleCount);
+
+	// 2. Sort the clusters by how much their average normal points away from the mesh centroid
+	glm::vec3 meshCentroid(0.0f);
+	for (const Vertex& vertex : vertices) meshCentroid += vertex.Position;
+	meshCentroid /= float(std::max<size_t>(1, vertices.size()));
+
+	size_t clusterCount = clusterStarts.size() - 1;
+	ArenaVector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const glm::vec3& a = vertices[indices[t * 3]].Position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& p = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 faceNormal = glm::cross(b - a, p - a);
+			float faceArea = glm::length(faceNormal);
+			centroid += (a + b + p) * (faceArea / 3.0f);
+			normal += faceNormal;
+			area += faceArea;
+		}
+		centroid = area > 0.0f ? centroid / area : vertices[indices[clusterStarts[c] * 3]].Position;
+		float normalLength = glm::length(normal);
+		sortKey[c] = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+	}
+
+	ArenaVector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> reordered;
+	reordered.reserve(indices.size());
+	for (size_t c : order)
+		reordered.insert(reordered.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+
+	// 3. Keep the new order only if the vertex cache efficiency stays close to the original
+	float acmrBefore = AnalyzeVertexCache(indices, vertices.size()).acmr();
+	float acmrAfter = AnalyzeVertexCache(reordered, vertices.size()).acmr();
+	if (acmrAfter <= acmrBefore * OVERDRAW_ACMR_THRESHOLD) indices.swap(reordered);
+}
+
+/// <summary>
+/// Reorder the vertex buffer in the order the index buffer first references each vertex, so vertex fetches walk
+/// through memory linearly. Vertices that no triangle uses are dropped.
+/// </summary>
+void OptimizeVertexFetch(MeshData& mesh)
+{
+	const unsigned int unused = ~0u;
+	ArenaVector<unsigned int> remap(mesh.vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(mesh.vertices.size());
+
+	for (unsigned int& index : mesh.indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<unsigned int>(reordered.size());
+			reordered.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(reordered);
+}
+
+/// <summary>
+/// Full optimization pass for a freshly imported mesh. Safe to run on worker threads.
+/// </summary>
+/// <returns> vertex cache statistics before and after. </returns>
+MeshOptimizationReport OptimizeMesh(MeshData& mesh)
+{
+	MeshOptimizationReport report;
+	report.before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+	WeldVertices(mesh);
+	OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+	OptimizeOverdraw(mesh.indices, mesh.vertices);
+	OptimizeVertexFetch(mesh);
+
+	report.after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+	return report;
+}
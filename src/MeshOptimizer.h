@@ -0,0 +1,40 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+#include "mesh.h"
+
+/// <summary>
+/// Result of simulating a FIFO post-transform vertex cache over an index buffer.
+/// ACMR = shaded vertices per triangle (1.0 is very good, 3.0 is no reuse at all).
+/// ATVR = shaded vertices per unique vertex (1.0 is optimal).
+/// </summary>
+struct VertexCacheStats
+{
+	size_t misses = 0;
+	size_t triangles = 0;
+	size_t vertices = 0;
+
+	float acmr() const { return triangles ? float(misses) / triangles : 0.0f; }
+	float atvr() const { return vertices ? float(misses) / vertices : 0.0f; }
+	void add(const VertexCacheStats& other) { misses += other.misses; triangles += other.triangles; vertices += other.vertices; }
+};
+
+struct MeshOptimizationReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount);
+
+void WeldVertices(MeshData& mesh);
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices);
+void OptimizeVertexFetch(MeshData& mesh);
+
+// Runs all of the passes above in order: weld, vertex cache, overdraw, vertex fetch
+MeshOptimizationReport OptimizeMesh(MeshData& mesh);
+
+#endif
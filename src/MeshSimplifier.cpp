@@ -0,0 +1,281 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "Arena.h"
+#include "MeshOptimizer.h"
+
+namespace
+{
+	// Each LOD targets this fraction of the previous level's triangles
+	const float LOD_REDUCTION_RATIO = 0.5f;
+
+	// A LOD that can't get below this fraction of the previous level isn't worth its index memory
+	const float LOD_MIN_REDUCTION = 0.85f;
+
+	// Meshes smaller than this are not simplified at all
+	const size_t LOD_MIN_TRIANGLES = 64;
+
+	// Collapses that rotate an adjacent triangle's normal by more than ~75 degrees are rejected (this catches flips)
+	const float MAX_NORMAL_COS_CHANGE = 0.25f;
+
+	/// <summary>
+	/// Symmetric 4x4 error quadric (Garland/ Heckbert), accumulated from area weighted triangle planes.
+	/// </summary>
+	struct Quadric
+	{
+		double a00, a01, a02, a11, a12, a22; // plane normal outer products
+		double b0, b1, b2;                   // normal * distance
+		double c;                            // distance squared
+		double weight;
+
+		void addPlane(const glm::dvec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+			b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// Sum of weighted squared distances from p to the accumulated planes
+		double evaluate(const glm::dvec3& p) const
+		{
+			double rx = a00 * p.x + a01 * p.y + a02 * p.z;
+			double ry = a01 * p.x + a11 * p.y + a12 * p.z;
+			double rz = a02 * p.x + a12 * p.y + a22 * p.z;
+			double error = rx * p.x + ry * p.y + rz * p.z + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+			return error > 0.0 ? error : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		float error; // mean squared distance
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			uint32_t words[3];
+			std::memcpy(words, &p, sizeof(words));
+			return size_t((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u));
+		}
+	};
+
+	struct PositionEqual
+	{
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const { return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0; }
+	};
+
+	uint64_t EdgeKey(unsigned int a, unsigned int b)
+	{
+		if (a > b) std::swap(a, b);
+		return (uint64_t(a) << 32) | b;
+	}
+
+	/// <summary>
+	/// Would moving vertex "from" onto vertex "to" flip or badly distort any of the triangles around "from"?
+	/// </summary>
+	bool CollapseFlipsTriangle(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+		const ArenaVector<unsigned int>& adjacencyOffset, const ArenaVector<unsigned int>& adjacency, unsigned int from, unsigned int to)
+	{
+		const glm::vec3& target = vertices[to].Position;
+		for (unsigned int a = adjacencyOffset[from]; a < adjacencyOffset[from + 1]; a++)
+		{
+			const unsigned int* triangle = &indices[size_t(adjacency[a]) * 3];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue; // collapses to a degenerate triangle
+
+			glm::vec3 p[3], q[3];
+			for (int k = 0; k < 3; k++)
+			{
+				p[k] = vertices[triangle[k]].Position;
+				q[k] = triangle[k] == from ? target : p[k];
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+			if (glm::dot(before, after) <= MAX_NORMAL_COS_CHANGE * glm::length(before) * glm::length(after)) return true;
+		}
+		return false;
+	}
+}
+
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	size_t targetIndexCount, float& resultError)
+{
+	resultError = 0.0f;
+	std::vector<unsigned int> result(indices);
+	size_t vertexCount = vertices.size();
+	if (result.size() <= targetIndexCount || vertexCount == 0) return result;
+
+	// 1. Group vertices by position: split vertices (UV or normal seams) share a position but not attributes
+	ArenaHashMap<glm::vec3, unsigned int, PositionHash, PositionEqual> positionIds;
+	positionIds.reserve(vertexCount);
+	ArenaVector<unsigned int> positionId(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		positionId[v] = positionIds.emplace(vertices[v].Position, static_cast<unsigned int>(positionIds.size())).first->second;
+	size_t positionCount = positionIds.size();
+
+	// 2. Accumulate the quadric of every position from the planes of its triangles
+	ArenaVector<Quadric> quadrics(positionCount, Quadric());
+	for (size_t t = 0; t < result.size() / 3; t++)
+	{
+		glm::dvec3 p0(vertices[result[t * 3]].Position), p1(vertices[result[t * 3 + 1]].Position), p2(vertices[result[t * 3 + 2]].Position);
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(normal);
+		if (area <= 0.0) continue;
+		normal /= area;
+		double d = -glm::dot(normal, p0);
+		for (int k = 0; k < 3; k++) quadrics[positionId[result[t * 3 + k]]].addPlane(normal, d, area * 0.5);
+	}
+
+	// 3. Lock positions on open borders (edges with a single triangle) and on attribute seams
+	ArenaHashMap<uint64_t, unsigned int> edgeUse;
+	edgeUse.reserve(result.size());
+	for (size_t t = 0; t < result.size() / 3; t++)
+		for (int k = 0; k < 3; k++)
+			edgeUse[EdgeKey(positionId[result[t * 3 + k]], positionId[result[t * 3 + (k + 1) % 3]])]++;
+
+	ArenaVector<bool> locked(positionCount, false);
+	ArenaVector<unsigned int> firstWedge(positionCount, ~0u);
+	for (unsigned int index : result)
+	{
+		unsigned int id = positionId[index];
+		if (firstWedge[id] == ~0u) firstWedge[id] = index;
+		else if (firstWedge[id] != index) locked[id] = true; // more than one distinct vertex at this position
+	}
+	for (const auto& edge : edgeUse)
+	{
+		if (edge.second == 1)
+		{
+			locked[unsigned(edge.first >> 32)] = true;
+			locked[unsigned(edge.first & 0xffffffffu)] = true;
+		}
+	}
+
+	// 4. Collapse the cheapest edges in passes until the target is reached. Within a pass every collapse only touches
+	// vertices that no other collapse of the same pass touched, so the flip checks stay valid.
+	ArenaVector<unsigned int> remap(vertexCount);
+	ArenaVector<unsigned int> adjacencyOffset(vertexCount + 1);
+	ArenaVector<unsigned int> adjacency, fill;
+	ArenaVector<bool> touched(positionCount);
+	ArenaVector<Collapse> collapses;
+	double maxError = 0.0;
+
+	while (result.size() > targetIndexCount)
+	{
+		size_t triangleCount = result.size() / 3;
+
+		// Vertex to triangle adjacency of the current index buffer
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0u);
+		for (unsigned int index : result) adjacencyOffset[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] += adjacencyOffset[v];
+		adjacency.resize(result.size());
+		fill.assign(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++) adjacency[fill[result[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+		// Cost of collapsing each half edge whose source position may move
+		collapses.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int from = result[t * 3 + k];
+				unsigned int to = result[t * 3 + (k + 1) % 3];
+				unsigned int fromId = positionId[from], toId = positionId[to];
+				if (locked[fromId] || fromId == toId) continue;
+
+				Quadric q = quadrics[fromId];
+				q.add(quadrics[toId]);
+				double error = q.weight > 0.0 ? q.evaluate(glm::dvec3(vertices[to].Position)) / q.weight : 0.0;
+				Collapse collapse = { from, to, float(error) };
+				collapses.push_back(collapse);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// Each collapse removes about two triangles, don't overshoot the target by much
+		size_t collapseLimit = (result.size() - targetIndexCount) / 6 + 1;
+		size_t collapsed = 0;
+		for (size_t v = 0; v < vertexCount; v++) remap[v] = static_cast<unsigned int>(v);
+		std::fill(touched.begin(), touched.end(), false);
+
+		for (const Collapse& collapse : collapses)
+		{
+			unsigned int fromId = positionId[collapse.from], toId = positionId[collapse.to];
+			if (touched[fromId] || touched[toId]) continue;
+			if (CollapseFlipsTriangle(vertices, result, adjacencyOffset, adjacency, collapse.from, collapse.to)) continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[toId].add(quadrics[fromId]);
+			maxError = std::max(maxError, double(collapse.error));
+
+			// Freeze the whole neighbourhood of the moved vertex for the rest of this pass
+			for (unsigned int a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; a++)
+				for (int k = 0; k < 3; k++) touched[positionId[result[size_t(adjacency[a]) * 3 + k]]] = true;
+
+			if (++collapsed >= collapseLimit) break;
+		}
+		if (collapsed == 0) break;
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			unsigned int a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+			if (a == b || b == c || a == c) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	resultError = float(std::sqrt(maxError));
+	return result;
+}
+
+/// <summary>
+/// Build the LOD chain of a mesh. Every level is simplified from the full resolution mesh, so errors don't accumulate,
+/// and is reordered for the vertex cache on its own. The mesh is welded first, because the simplifier can only move
+/// vertices that aren't split.
+/// </summary>
+/// <param name="mesh"> processed mesh, its index buffer is replaced by the concatenated LODs. </param>
+void GenerateLods(MeshData& mesh)
+{
+	WeldVertices(mesh);
+
+	MeshLod full = { 0, static_cast<unsigned int>(mesh.indices.size()), 0.0f };
+	mesh.lods.assign(1, full);
+	if (mesh.indices.size() / 3 < LOD_MIN_TRIANGLES) return;
+
+	std::vector<unsigned int> fullIndices(mesh.indices);
+	size_t previousCount = fullIndices.size();
+	while (mesh.lods.size() < MAX_MESH_LODS)
+	{
+		size_t target = size_t(previousCount / 3 * LOD_REDUCTION_RATIO) * 3;
+		float error = 0.0f;
+		std::vector<unsigned int> lodIndices = SimplifyMesh(mesh.vertices, fullIndices, target, error);
+		if (lodIndices.empty() || lodIndices.size() > previousCount * LOD_MIN_REDUCTION) break;
+
+		OptimizeVertexCache(lodIndices, mesh.vertices.size());
+		MeshLod lod = { static_cast<unsigned int>(mesh.indices.size()), static_cast<unsigned int>(lodIndices.size()), error };
+		mesh.lods.push_back(lod);
+		mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+		previousCount = lodIndices.size();
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+#include "mesh.h"
+
+// Number of detail levels generated per mesh, including the full resolution LOD 0
+const unsigned int MAX_MESH_LODS = 4;
+
+/// <summary>
+/// Quadric error metric simplification: collapses edges onto one of their existing vertices (so no new vertices are
+/// created and all LODs share one vertex buffer) until the index count reaches the target. Vertices on open borders
+/// and on attribute seams (UV/ normal splits) never move.
+/// </summary>
+/// <param name="resultError"> receives the largest object space deviation introduced by the collapses. </param>
+/// <returns> the simplified index buffer, which may be larger than the target if no more edges could collapse. </returns>
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+	size_t targetIndexCount, float& resultError);
+
+// Weld the mesh and append up to MAX_MESH_LODS - 1 simplified index buffers after the original one, filling mesh.lods
+void GenerateLods(MeshData& mesh);
+
+#endif
@@ -0,0 +1,146 @@
+#include "MeshletBuilder.h"
+
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	/// <summary>
+	/// Bounding sphere and normal cone of the triangles in indices [begin, end).
+	/// </summary>
+	Meshlet MakeMeshlet(const Vertex* vertices, const unsigned int* indices, unsigned int begin, unsigned int end)
+	{
+		Meshlet meshlet;
+		meshlet.indexOffset = begin;
+		meshlet.indexCount = end - begin;
+
+		glm::vec3 minBounds(FLT_MAX), maxBounds(-FLT_MAX);
+		for (unsigned int i = begin; i < end; i++)
+		{
+			minBounds = glm::min(minBounds, vertices[indices[i]].Position);
+			maxBounds = glm::max(maxBounds, vertices[indices[i]].Position);
+		}
+		meshlet.center = (minBounds + maxBounds) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (unsigned int i = begin; i < end; i++)
+			meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+		// Cone axis: area weighted average of the face normals. The cone is as wide as the normal furthest from it.
+		glm::vec3 normalSum(0.0f);
+		for (unsigned int i = begin; i + 2 < end; i += 3)
+		{
+			const glm::vec3& a = vertices[indices[i]].Position;
+			normalSum += glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+		}
+		float sumLength = glm::length(normalSum);
+		meshlet.coneAxis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCosine = sumLength > 0.0f ? 1.0f : -1.0f;
+		for (unsigned int i = begin; i + 2 < end; i += 3)
+		{
+			const glm::vec3& a = vertices[indices[i]].Position;
+			glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+			float length = glm::length(normal);
+			if (length > 0.0f) meshlet.coneCosine = glm::min(meshlet.coneCosine, glm::dot(normal / length, meshlet.coneAxis));
+		}
+		return meshlet;
+	}
+}
+
+std::vector<Meshlet> BuildMeshlets(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, unsigned int indexOffset,
+	unsigned int indexCount)
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned int> lastMeshlet(vertexCount, ~0u); // meshlet that last referenced each vertex
+
+	unsigned int end = indexOffset + indexCount - indexCount % 3;
+	unsigned int begin = indexOffset;
+	unsigned int current = 0, meshletVertices = 0, triangleCount = 0;
+	for (unsigned int i = indexOffset; i < end; i += 3)
+	{
+		// Vertices of this triangle the current meshlet does not reference yet
+		unsigned int added = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int vertex = indices[i + k];
+			bool seen = lastMeshlet[vertex] == current;
+			for (unsigned int j = 0; j < k; j++)
+				seen = seen || indices[i + j] == vertex;
+			if (!seen) added++;
+		}
+
+		if (meshletVertices + added > MESHLET_MAX_VERTICES || triangleCount == MESHLET_MAX_TRIANGLES)
+		{
+			meshlets.push_back(MakeMeshlet(vertices, indices, begin, i));
+			current++;
+			begin = i;
+			meshletVertices = triangleCount = 0;
+			added = 0;
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				bool seen = false;
+				for (unsigned int j = 0; j < k; j++)
+					seen = seen || indices[i + j] == indices[i + k];
+				if (!seen) added++;
+			}
+		}
+
+		for (unsigned int k = 0; k < 3; k++)
+			lastMeshlet[indices[i + k]] = current;
+		meshletVertices += added;
+		triangleCount++;
+	}
+	if (begin < end) meshlets.push_back(MakeMeshlet(vertices, indices, begin, end));
+	return meshlets;
+}
+
+/// <summary>
+/// Bring the view into the mesh's object space: frustum planes from the combined matrix (Gribb/ Hartmann), the
+/// camera position, and the vertex displacement applied after culling converted into a margin.
+/// </summary>
+/// <param name="displacement"> world space distance shaders may move vertices by (e.g. the implosion). </param>
+/// <param name="cullBackfaces"> true if back faces are culled by GL, so clusters facing away can be skipped. Ignored
+/// while vertices are displaced, since moving triangles can turn them towards the camera. </param>
+MeshletCullView MakeMeshletCullView(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float displacement,
+	bool cullBackfaces)
+{
+	MeshletCullView cull;
+	glm::mat4 clip = projection * view * model;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+	for (int i = 0; i < 3; i++)
+	{
+		cull.planes[i * 2] = rows[3] + rows[i];
+		cull.planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (glm::vec4& plane : cull.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	cull.cameraPosition = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	float minScale = glm::min(glm::length(glm::vec3(model[0])), glm::min(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	cull.margin = minScale > 0.0f ? displacement / minScale : 0.0f;
+	cull.cullBackfaces = cullBackfaces && displacement <= 0.0f;
+	return cull;
+}
+
+/// <summary>
+/// Frustum test of the meshlet's bounding sphere, then the normal cone test: the cluster faces away if even the
+/// normal closest to the camera direction makes every point of the sphere a back face.
+/// </summary>
+bool IsMeshletVisible(const Meshlet& meshlet, const MeshletCullView& view)
+{
+	float radius = meshlet.radius + view.margin;
+	for (const glm::vec4& plane : view.planes)
+		if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -radius) return false;
+
+	if (!view.cullBackfaces || meshlet.coneCosine <= 0.0f) return true;
+	glm::vec3 toCenter = meshlet.center - view.cameraPosition;
+	float distance = glm::length(toCenter);
+	if (distance <= radius) return true;
+
+	// cos(angle to the axis + cone half angle) * distance is the smallest dot(toCenter, normal) over the cone
+	float cosAngle = glm::dot(toCenter, meshlet.coneAxis) / distance;
+	float sinAngle = std::sqrt(glm::max(0.0f, 1.0f - cosAngle * cosAngle));
+	float sinCone = std::sqrt(glm::max(0.0f, 1.0f - meshlet.coneCosine * meshlet.coneCosine));
+	return (cosAngle * meshlet.coneCosine - sinAngle * sinCone) * distance <= radius;
+}
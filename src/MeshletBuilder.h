@@ -0,0 +1,36 @@
+#ifndef MESHLETBUILDER_H
+#define MESHLETBUILDER_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh.h"
+
+// Cluster size limits: small enough that a cluster is a patch of surface that is culled as a whole
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+/// <summary>
+/// Split an index range into meshlets: consecutive runs of triangles that reference at most MESHLET_MAX_VERTICES
+/// vertices and MESHLET_MAX_TRIANGLES triangles. The index buffer is not reordered, so each meshlet is a contiguous
+/// sub-range that can be drawn on its own; meshes optimized for the vertex cache give the most compact clusters.
+/// </summary>
+std::vector<Meshlet> BuildMeshlets(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, unsigned int indexOffset,
+	unsigned int indexCount);
+
+/// <summary>
+/// Everything a meshlet culling pass needs to know about the view, in the mesh's object space.
+/// </summary>
+struct MeshletCullView
+{
+	glm::vec4 planes[6];      // frustum planes (xyz = normal pointing inwards, w = distance), normalized
+	glm::vec3 cameraPosition;
+	float margin;             // distance the shaders may still move vertices by, spheres are grown by it
+	bool cullBackfaces;       // clusters facing away from the camera are skipped (needs GL_CULL_FACE)
+};
+
+MeshletCullView MakeMeshletCullView(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float displacement,
+	bool cullBackfaces);
+bool IsMeshletVisible(const Meshlet& meshlet, const MeshletCullView& view);
+
+#endif
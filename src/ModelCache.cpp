@@ -0,0 +1,106 @@
+#include "ModelCache.h"
+#include <iostream>
+#include "TextureCache.h"
+
+ModelCache& ModelCache::instance()
+{
+	static ModelCache cache;
+	return cache;
+}
+
+/// <summary>
+/// Get a reference counted handle to the model at the given path, importing it only if no other instance holds it yet.
+/// </summary>
+/// <param name="path"> path of the model file. </param>
+/// <param name="options"> load options, used as given by the first acquire for a path. </param>
+/// <returns></returns>
+ModelHandle ModelCache::acquire(const std::string& path, const ModelLoadOptions& options)
+{
+	if (ModelHandle existing = find(path, options)) return existing;
+	return adopt(path, options, new Model(path.c_str(), options));
+}
+
+/// <summary>
+/// Handle to the model if it is already resident, without loading it otherwise.
+/// </summary>
+ModelHandle ModelCache::find(const std::string& path, const ModelLoadOptions& options) const
+{
+	auto found = byKey.find(cacheKey(path, options));
+	if (found == byKey.end()) return ModelHandle();
+	return found->second.lock();
+}
+
+/// <summary>
+/// Take ownership of a model created by the caller, which may still be loading (see SceneLoader), and share it under
+/// the given path and options from now on.
+/// </summary>
+ModelHandle ModelCache::adopt(const std::string& path, const ModelLoadOptions& options, Model* model)
+{
+	std::string key = cacheKey(path, options);
+	ModelHandle handle(model, [key](Model* released) { ModelCache::instance().release(released, key); });
+	byKey[key] = handle;
+	return handle;
+}
+
+size_t ModelCache::residentCount() const
+{
+	size_t count = 0;
+	for (const auto& entry : byKey)
+		if (!entry.second.expired()) count++;
+	return count;
+}
+
+/// <summary>
+/// Log the geometry memory of every resident model, with a per-mesh breakdown, followed by the totals.
+/// </summary>
+void ModelCache::logMemoryReport() const
+{
+	GeometryMemory total;
+	for (const auto& entry : byKey)
+	{
+		ModelHandle model = entry.second.lock();
+		if (!model) continue;
+		model->logMemoryReport(entry.first.substr(0, entry.first.find('|')));
+		GeometryMemory memory = model->memoryUsage();
+		total.cpuBytes += memory.cpuBytes;
+		total.gpuBytes += memory.gpuBytes;
+	}
+	std::cout << "DEBUG LOG: GEOMETRY MEMORY TOTAL (" << residentCount() << " models): CPU " << total.cpuBytes / 1024 << " KB, GPU "
+		<< total.gpuBytes / 1024 << " KB" << std::endl;
+}
+
+/// <summary>
+/// Called when the last handle to a model goes away: forget it and free its meshes.
+/// </summary>
+void ModelCache::release(Model* model, const std::string& key)
+{
+	auto found = byKey.find(key);
+	if (found != byKey.end() && found->second.expired()) byKey.erase(found);
+	delete model;
+}
+
+/// <summary>
+/// Options that only affect how a model is loaded (cache use, async textures, incremental upload) share an entry,
+/// options that produce different vertex or index data, or keep different data in system memory, do not.
+/// </summary>
+std::string ModelCache::cacheKey(const std::string& path, const ModelLoadOptions& options)
+{
+	std::string key = TextureCache::normalizePath(path);
+	key += '|';
+	key += options.useObjLoader ? 'o' : '-';
+	key += options.optimizeMeshes ? 'm' : '-';
+	key += options.generateLods ? 'l' : '-';
+	key += options.quantizeVertices ? 'q' : '-';
+	key += options.packTextureArrays ? 'a' : '-';
+	key += "fpg"[int(options.residency)]; // a model that dropped its vertices cannot serve one that needs them
+	return key;
+}
+
+/// <summary>
+/// Queue the shared model with this instance's transform (view.model is replaced by it).
+/// </summary>
+void ModelInstance::Draw(DrawBatch& batch, Shader& shader, ViewInfo view)
+{
+	view.model = transform;
+	model->Draw(batch, shader, view);
+}
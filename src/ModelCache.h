@@ -0,0 +1,47 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "model.h"
+
+typedef std::shared_ptr<Model> ModelHandle;
+
+/// <summary>
+/// Process-wide model cache. Models are keyed by their normalized path and the load options that change the geometry,
+/// so repeated props share one import and one set of GL buffers. A model is destroyed when the last handle to it is
+/// released. GL thread only.
+/// </summary>
+class ModelCache
+{
+public:
+	static ModelCache& instance();
+
+	ModelHandle acquire(const std::string& path, const ModelLoadOptions& options = ModelLoadOptions());
+	ModelHandle find(const std::string& path, const ModelLoadOptions& options = ModelLoadOptions()) const;
+	ModelHandle adopt(const std::string& path, const ModelLoadOptions& options, Model* model);
+	size_t residentCount() const;
+	void logMemoryReport() const;
+
+private:
+	std::unordered_map<std::string, std::weak_ptr<Model>> byKey; // key is the normalized path, '|', then the option flags
+
+	ModelCache() {}
+	void release(Model* model, const std::string& key);
+	static std::string cacheKey(const std::string& path, const ModelLoadOptions& options);
+};
+
+/// <summary>
+/// One placement of a shared model in the scene, with the state that differs between copies.
+/// </summary>
+struct ModelInstance
+{
+	ModelHandle model;
+	glm::mat4 transform = glm::mat4(1.0f);
+	int hitCount = 0;
+
+	void Draw(DrawBatch& batch, Shader& shader, ViewInfo view);
+};
+
+#endif
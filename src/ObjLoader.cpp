@@ -0,0 +1,653 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include "Arena.h"
+#include "AssetPack.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace
+{
+	const int32_t MISSING_INDEX = INT32_MIN;
+	const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+	// Bits of ObjCorner::relative, set when the index was negative (relative to the end of the attribute list)
+	const uint8_t RELATIVE_V = 1, RELATIVE_VT = 2, RELATIVE_VN = 4;
+
+	struct ObjCorner
+	{
+		int32_t v, vt, vn;
+		uint8_t relative;
+	};
+
+	// usemtl/ o/ g statement, applying to all faces from faceIndex onwards
+	struct ObjSwitch
+	{
+		size_t faceIndex;
+		bool newObject;
+		bool hasMaterial;
+		std::string material;
+	};
+
+	/// <summary>
+	/// Everything parsed out of one line-aligned chunk of the file. Indices are chunk-local until they are fixed up.
+	/// The bulk arrays live in the load's arena (if any), bound when the chunk is created.
+	/// </summary>
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+		ArenaVector<float> positions;
+		ArenaVector<float> texCoords;
+		ArenaVector<float> normals;
+		ArenaVector<ObjCorner> corners;
+		ArenaVector<uint32_t> faceSizes;
+		std::vector<ObjSwitch> switches;
+		std::vector<std::string> materialLibraries;
+		size_t positionBase, texCoordBase, normalBase;
+	};
+
+	// Consecutive faces of the file that end up in the same mesh
+	struct ObjFaceRange
+	{
+		size_t chunk;
+		size_t faceBegin, faceEnd;
+		size_t cornerBegin;
+	};
+
+	struct ObjSegment
+	{
+		std::string material;
+		std::vector<ObjFaceRange> ranges;
+	};
+
+	struct ObjMaterial
+	{
+		Material material;
+		std::string diffuseMap;
+		std::string specularMap;
+	};
+
+	struct CornerKey
+	{
+		int32_t v, vt, vn;
+		bool operator==(const CornerKey& other) const { return v == other.v && vt == other.vt && vn == other.vn; }
+	};
+
+	struct CornerKeyHash
+	{
+		size_t operator()(const CornerKey& key) const
+		{
+			uint64_t h = uint32_t(key.v) * 0x9E3779B97F4A7C15ull;
+			h ^= (uint32_t(key.vt) + 0x7F4A7C15ull + (h << 6) + (h >> 2)) * 0xC2B2AE3D27D4EB4Full;
+			h ^= (uint32_t(key.vn) + 0x165667B1ull + (h << 6) + (h >> 2)) * 0x9E3779B97F4A7C15ull;
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+	inline bool IsLineEnd(char c) { return c == '\n' || c == '\r'; }
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p)) p++;
+		return p;
+	}
+
+	inline const char* NextLine(const char* p, const char* end)
+	{
+		const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		return newline ? newline + 1 : end;
+	}
+
+	/// <summary>
+	/// Parse a decimal float without going through the C locale machinery. Plain mantissas with up to 19 digits
+	/// and small exponents (everything Blender writes) take the fast path, anything else falls back to strtod.
+	/// </summary>
+	const char* ParseFloat(const char* p, const char* end, float& out)
+	{
+		static const double powersOfTen[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			mantissa = mantissa * 10 + (*p++ - '0');
+			digits++;
+		}
+		if (p < end && *p == '.')
+		{
+			p++;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				mantissa = mantissa * 10 + (*p++ - '0');
+				digits++;
+				exponent--;
+			}
+		}
+		if (digits == 0) { out = 0.0f; return start; }
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* e = p + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '-' || *e == '+')) negativeExponent = (*e++ == '-');
+			int value = 0;
+			bool hasDigits = false;
+			while (e < end && *e >= '0' && *e <= '9' && value < 10000) { value = value * 10 + (*e++ - '0'); hasDigits = true; }
+			if (hasDigits)
+			{
+				exponent += negativeExponent ? -value : value;
+				p = e;
+			}
+		}
+
+		if (digits > 19 || exponent < -22 || exponent > 22)
+		{
+			char buffer[64];
+			size_t length = std::min(size_t(p - start), sizeof(buffer) - 1);
+			std::memcpy(buffer, start, length);
+			buffer[length] = '\0';
+			out = static_cast<float>(std::strtod(buffer, nullptr));
+			return p;
+		}
+
+		double value = static_cast<double>(mantissa);
+		value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+		out = static_cast<float>(negative ? -value : value);
+		return p;
+	}
+
+	inline const char* ParseInt(const char* p, const char* end, int64_t& out, bool& valid)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+		int64_t value = 0;
+		valid = false;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (value < INT32_MAX) value = value * 10 + (*p - '0');
+			p++;
+			valid = true;
+		}
+		out = negative ? -value : value;
+		return p;
+	}
+
+	const char* ParseFloats(const char* p, const char* end, int count, ArenaVector<float>& out)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float value = 0.0f;
+			p = ParseFloat(SkipSpaces(p, end), end, value);
+			out.push_back(value);
+		}
+		return p;
+	}
+
+	// Rest of the line with surrounding whitespace removed (names may contain spaces, e.g. "mtllib Brick Wall.mtl")
+	std::string RestOfLine(const char* p, const char* end)
+	{
+		p = SkipSpaces(p, end);
+		const char* lineEnd = p;
+		while (lineEnd < end && !IsLineEnd(*lineEnd)) lineEnd++;
+		while (lineEnd > p && IsSpace(lineEnd[-1])) lineEnd--;
+		return std::string(p, lineEnd);
+	}
+
+	inline bool StartsWithKeyword(const char* p, const char* end, const char* keyword, size_t length)
+	{
+		return size_t(end - p) > length && std::memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+	}
+
+	/// <summary>
+	/// Resolve a raw OBJ index into a 0-based one. Negative indices are relative to the attributes parsed so far, which
+	/// within a chunk is only known up to the chunk's base offset, so they get flagged and fixed up afterwards.
+	/// </summary>
+	inline int32_t ResolveIndex(int64_t raw, size_t localCount, uint8_t relativeBit, uint8_t& relative)
+	{
+		if (raw > 0) return static_cast<int32_t>(raw - 1);
+		if (raw < 0)
+		{
+			relative |= relativeBit;
+			return static_cast<int32_t>(static_cast<int64_t>(localCount) + raw);
+		}
+		return MISSING_INDEX;
+	}
+
+	void ParseFace(const char* p, const char* end, ObjChunk& chunk)
+	{
+		uint32_t cornerCount = 0;
+		const size_t localPositions = chunk.positions.size() / 3;
+		const size_t localTexCoords = chunk.texCoords.size() / 2;
+		const size_t localNormals = chunk.normals.size() / 3;
+
+		while (true)
+		{
+			p = SkipSpaces(p, end);
+			if (p >= end || IsLineEnd(*p)) break;
+
+			ObjCorner corner;
+			corner.relative = 0;
+			corner.vt = MISSING_INDEX;
+			corner.vn = MISSING_INDEX;
+
+			int64_t raw;
+			bool valid;
+			p = ParseInt(p, end, raw, valid);
+			if (!valid) break;
+			corner.v = ResolveIndex(raw, localPositions, RELATIVE_V, corner.relative);
+
+			if (p < end && *p == '/')
+			{
+				p++;
+				p = ParseInt(p, end, raw, valid);
+				if (valid) corner.vt = ResolveIndex(raw, localTexCoords, RELATIVE_VT, corner.relative);
+				if (p < end && *p == '/')
+				{
+					p++;
+					p = ParseInt(p, end, raw, valid);
+					if (valid) corner.vn = ResolveIndex(raw, localNormals, RELATIVE_VN, corner.relative);
+				}
+			}
+
+			chunk.corners.push_back(corner);
+			cornerCount++;
+			while (p < end && !IsSpace(*p) && !IsLineEnd(*p)) p++; // skip anything malformed
+		}
+
+		if (cornerCount >= 3) chunk.faceSizes.push_back(cornerCount);
+		else chunk.corners.resize(chunk.corners.size() - cornerCount); // points and lines are not rendered
+	}
+
+	void ParseChunk(ObjChunk& chunk)
+	{
+		const char* end = chunk.end;
+		for (const char* p = chunk.begin; p < end; p = NextLine(p, end))
+		{
+			const char* line = SkipSpaces(p, end);
+			if (line >= end) break;
+
+			switch (*line)
+			{
+			case 'v':
+				if (line + 1 < end && IsSpace(line[1])) ParseFloats(line + 1, end, 3, chunk.positions);
+				else if (line + 2 < end && line[1] == 't' && IsSpace(line[2])) ParseFloats(line + 2, end, 2, chunk.texCoords);
+				else if (line + 2 < end && line[1] == 'n' && IsSpace(line[2])) ParseFloats(line + 2, end, 3, chunk.normals);
+				break;
+			case 'f':
+				if (line + 1 < end && IsSpace(line[1])) ParseFace(line + 1, end, chunk);
+				break;
+			case 'u':
+				if (StartsWithKeyword(line, end, "usemtl", 6))
+				{
+					ObjSwitch change = { chunk.faceSizes.size(), false, true, RestOfLine(line + 6, end) };
+					chunk.switches.push_back(change);
+				}
+				break;
+			case 'o':
+			case 'g':
+				if (line + 1 < end && (IsSpace(line[1]) || IsLineEnd(line[1])))
+				{
+					ObjSwitch change = { chunk.faceSizes.size(), true, false, std::string() };
+					chunk.switches.push_back(change);
+				}
+				break;
+			case 'm':
+				if (StartsWithKeyword(line, end, "mtllib", 6)) chunk.materialLibraries.push_back(RestOfLine(line + 6, end));
+				break;
+			default:
+				break; // comments, smoothing groups, etc.
+			}
+		}
+	}
+
+	bool FixupIndex(int32_t& index, bool relative, size_t base, size_t count)
+	{
+		if (index == MISSING_INDEX) return true;
+		int64_t resolved = relative ? static_cast<int64_t>(base) + index : index;
+		if (resolved < 0 || resolved >= static_cast<int64_t>(count)) return false;
+		index = static_cast<int32_t>(resolved);
+		return true;
+	}
+
+	std::string DirectoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	// Texture options (e.g. "-bm 1.0 brick.png") come before the file name, which is the last token
+	std::string TexturePathFromMap(const std::string& value)
+	{
+		if (value.empty() || value[0] != '-') return value;
+		size_t lastSpace = value.find_last_of(" \t");
+		return lastSpace == std::string::npos ? value : value.substr(lastSpace + 1);
+	}
+
+	void LoadMaterialLibrary(const std::string& path, std::unordered_map<std::string, ObjMaterial>& materials)
+	{
+		std::string text;
+		if (!ReadAssetText(path, text)) return;
+
+		const char* end = text.data() + text.size();
+		ObjMaterial* current = nullptr;
+		for (const char* p = text.data(); p < end; p = NextLine(p, end))
+		{
+			const char* line = SkipSpaces(p, end);
+			ArenaVector<float> values;
+
+			if (StartsWithKeyword(line, end, "newmtl", 6))
+			{
+				ObjMaterial material;
+				material.material.ambient = glm::vec3(0.0f);
+				material.material.diffuse = glm::vec3(0.6f);
+				material.material.specular = glm::vec3(0.0f);
+				material.material.shininess = 0.0f;
+				current = &(materials[RestOfLine(line + 6, end)] = material);
+			}
+			else if (!current) continue;
+			else if (StartsWithKeyword(line, end, "Ka", 2)) { ParseFloats(line + 2, end, 3, values); current->material.ambient = glm::vec3(values[0], values[1], values[2]); }
+			else if (StartsWithKeyword(line, end, "Kd", 2)) { ParseFloats(line + 2, end, 3, values); current->material.diffuse = glm::vec3(values[0], values[1], values[2]); }
+			else if (StartsWithKeyword(line, end, "Ks", 2)) { ParseFloats(line + 2, end, 3, values); current->material.specular = glm::vec3(values[0], values[1], values[2]); }
+			else if (StartsWithKeyword(line, end, "Ns", 2)) { ParseFloats(line + 2, end, 1, values); current->material.shininess = values[0]; }
+			else if (StartsWithKeyword(line, end, "map_Kd", 6)) current->diffuseMap = TexturePathFromMap(RestOfLine(line + 6, end));
+			else if (StartsWithKeyword(line, end, "map_Ks", 6)) current->specularMap = TexturePathFromMap(RestOfLine(line + 6, end));
+		}
+	}
+
+	/// <summary>
+	/// Triangulate one segment and merge identical v/vt/vn tuples into shared vertices.
+	/// </summary>
+	void BuildSegmentMesh(const ObjSegment& segment, const std::vector<ObjChunk>& chunks, const ArenaVector<float>& positions,
+		const ArenaVector<float>& texCoords, const ArenaVector<float>& normals, MeshData& mesh)
+	{
+		size_t cornerCount = 0, triangleCount = 0;
+		for (const ObjFaceRange& range : segment.ranges)
+		{
+			const ObjChunk& chunk = chunks[range.chunk];
+			for (size_t face = range.faceBegin; face < range.faceEnd; face++)
+			{
+				cornerCount += chunk.faceSizes[face];
+				triangleCount += chunk.faceSizes[face] - 2;
+			}
+		}
+
+		ArenaHashMap<CornerKey, unsigned int, CornerKeyHash> vertexLookup;
+		vertexLookup.reserve(cornerCount);
+		mesh.vertices.reserve(cornerCount);
+		mesh.indices.reserve(triangleCount * 3);
+		ArenaVector<bool> needsNormal;
+		needsNormal.reserve(cornerCount);
+		bool anyMissingNormal = false;
+
+		auto vertexFor = [&](const ObjCorner& corner) -> unsigned int
+		{
+			// Look up before inserting: emplace allocates a node even when the key already exists
+			CornerKey key = { corner.v, corner.vt, corner.vn };
+			auto found = vertexLookup.find(key);
+			if (found != vertexLookup.end()) return found->second;
+			unsigned int index = static_cast<unsigned int>(mesh.vertices.size());
+			vertexLookup.emplace(key, index);
+
+			Vertex vertex;
+			vertex.Position = glm::vec3(positions[corner.v * 3], positions[corner.v * 3 + 1], positions[corner.v * 3 + 2]);
+			vertex.Normal = corner.vn != MISSING_INDEX
+				? glm::vec3(normals[corner.vn * 3], normals[corner.vn * 3 + 1], normals[corner.vn * 3 + 2])
+				: glm::vec3(0.0f);
+			vertex.TexCoords = corner.vt != MISSING_INDEX
+				? glm::vec2(texCoords[corner.vt * 2], 1.0f - texCoords[corner.vt * 2 + 1]) // same as aiProcess_FlipUVs
+				: glm::vec2(0.0f);
+			mesh.vertices.push_back(vertex);
+			needsNormal.push_back(corner.vn == MISSING_INDEX);
+			anyMissingNormal = anyMissingNormal || corner.vn == MISSING_INDEX;
+			return index;
+		};
+
+		for (const ObjFaceRange& range : segment.ranges)
+		{
+			const ObjChunk& chunk = chunks[range.chunk];
+			const ObjCorner* corners = chunk.corners.data() + range.cornerBegin;
+			for (size_t face = range.faceBegin; face < range.faceEnd; face++)
+			{
+				uint32_t size = chunk.faceSizes[face];
+				if (corners[0].v != MISSING_INDEX)
+				{
+					// Fan triangulation around the first corner
+					unsigned int first = vertexFor(corners[0]);
+					unsigned int previous = vertexFor(corners[1]);
+					for (uint32_t i = 2; i < size; i++)
+					{
+						unsigned int current = vertexFor(corners[i]);
+						mesh.indices.push_back(first);
+						mesh.indices.push_back(previous);
+						mesh.indices.push_back(current);
+						previous = current;
+					}
+				}
+				corners += size;
+			}
+		}
+
+		// Faces without vn get smooth normals from the area-weighted normals of the triangles around them
+		if (anyMissingNormal)
+		{
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				Vertex& a = mesh.vertices[mesh.indices[i]];
+				Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+				Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+				glm::vec3 faceNormal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+				if (needsNormal[mesh.indices[i]]) a.Normal += faceNormal;
+				if (needsNormal[mesh.indices[i + 1]]) b.Normal += faceNormal;
+				if (needsNormal[mesh.indices[i + 2]]) c.Normal += faceNormal;
+			}
+			for (size_t i = 0; i < mesh.vertices.size(); i++)
+			{
+				float length = glm::length(mesh.vertices[i].Normal);
+				if (needsNormal[i] && length > 0.0f) mesh.vertices[i].Normal /= length;
+			}
+		}
+	}
+}
+
+bool LoadObjFile(const std::string& path, ObjModelData& out)
+{
+	out.meshes.clear();
+	out.minBounds = glm::vec3(FLT_MAX);
+	out.maxBounds = glm::vec3(-FLT_MAX);
+	out.totalVertices = 0;
+	out.triangleCount = 0;
+
+	// Files inside the mounted asset pack are decompressed into memory, loose files are parsed straight from the mapping
+	MappedFile file;
+	std::vector<unsigned char> packed;
+	const AssetPack* pack = MountedAssetPack();
+	bool fromPack = pack && pack->contains(path);
+	if (fromPack ? !pack->read(path, packed) : !file.open(path))
+	{
+		std::cerr << "ERROR::OBJ::Could not open " << path << std::endl;
+		return false;
+	}
+
+	ThreadPool& pool = ThreadPool::shared();
+	size_t fileSize = fromPack ? packed.size() : file.size();
+	const char* begin = reinterpret_cast<const char*>(fromPack ? packed.data() : file.data());
+	const char* end = begin + fileSize;
+
+	// 1. Split the file into line-aligned chunks and parse them in parallel
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(size_t(pool.size()) * 4, fileSize / MIN_CHUNK_BYTES));
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* chunkBegin = begin;
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		const char* chunkEnd = (i + 1 == chunkCount) ? end : std::max(chunkBegin, begin + fileSize * (i + 1) / chunkCount);
+		if (chunkEnd != end) chunkEnd = NextLine(chunkEnd, end);
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+	pool.parallelFor(chunks.size(), [&chunks](size_t i)
+	{
+		TRACE_SCOPE("parse chunk");
+		ParseChunk(chunks[i]);
+	});
+
+	// 2. Offset each chunk's attributes by everything parsed before it, then gather them into one array per attribute
+	size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.positionBase = positionCount;
+		chunk.texCoordBase = texCoordCount;
+		chunk.normalBase = normalCount;
+		positionCount += chunk.positions.size() / 3;
+		texCoordCount += chunk.texCoords.size() / 2;
+		normalCount += chunk.normals.size() / 3;
+	}
+
+	ArenaVector<float> positions(positionCount * 3), texCoords(texCoordCount * 2), normals(normalCount * 3);
+	pool.parallelFor(chunks.size(), [&](size_t i)
+	{
+		ObjChunk& chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase * 3);
+		std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + chunk.texCoordBase * 2);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase * 3);
+
+		for (ObjCorner& corner : chunk.corners)
+		{
+			bool valid = FixupIndex(corner.v, (corner.relative & RELATIVE_V) != 0, chunk.positionBase, positionCount) && corner.v != MISSING_INDEX;
+			valid = FixupIndex(corner.vt, (corner.relative & RELATIVE_VT) != 0, chunk.texCoordBase, texCoordCount) && valid;
+			valid = FixupIndex(corner.vn, (corner.relative & RELATIVE_VN) != 0, chunk.normalBase, normalCount) && valid;
+			if (!valid) corner.v = MISSING_INDEX; // faces with broken indices are dropped
+		}
+	});
+
+	// A face is only kept if all of its corners are valid; flag the first corner of broken faces
+	pool.parallelFor(chunks.size(), [&chunks](size_t i)
+	{
+		ObjChunk& chunk = chunks[i];
+		ObjCorner* corners = chunk.corners.data();
+		for (uint32_t size : chunk.faceSizes)
+		{
+			for (uint32_t c = 1; c < size; c++)
+				if (corners[c].v == MISSING_INDEX) corners[0].v = MISSING_INDEX;
+			corners += size;
+		}
+	});
+
+	// 3. Split the faces into meshes at every object/ material change, like ASSIMP does
+	std::vector<ObjSegment> segments(1);
+	std::vector<std::string> materialLibraries;
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		const ObjChunk& chunk = chunks[c];
+		materialLibraries.insert(materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end());
+
+		size_t face = 0, corner = 0;
+		size_t nextSwitch = 0;
+		while (face < chunk.faceSizes.size() || nextSwitch < chunk.switches.size())
+		{
+			size_t rangeEnd = nextSwitch < chunk.switches.size() ? chunk.switches[nextSwitch].faceIndex : chunk.faceSizes.size();
+			if (rangeEnd > face)
+			{
+				ObjFaceRange range = { c, face, rangeEnd, corner };
+				segments.back().ranges.push_back(range);
+				for (; face < rangeEnd; face++) corner += chunk.faceSizes[face];
+			}
+
+			if (nextSwitch < chunk.switches.size())
+			{
+				const ObjSwitch& change = chunk.switches[nextSwitch++];
+				ObjSegment next;
+				next.material = change.hasMaterial ? change.material : segments.back().material;
+				if (segments.back().ranges.empty()) segments.back() = next;
+				else segments.push_back(next);
+			}
+		}
+	}
+	if (segments.back().ranges.empty()) segments.pop_back();
+
+	// Material libraries are resolved relative to the OBJ file. Blender writes the .blend name into mtllib,
+	// so fall back to "<model>.mtl" when the referenced file does not exist (ASSIMP does the same).
+	std::unordered_map<std::string, ObjMaterial> materials;
+	std::string directory = DirectoryOf(path);
+	for (const std::string& library : materialLibraries)
+		LoadMaterialLibrary(directory + library, materials);
+	if (materials.empty() && path.size() > 3)
+		LoadMaterialLibrary(path.substr(0, path.size() - 3) + "mtl", materials);
+
+	// 4. Build the meshes in parallel, one task per segment
+	out.meshes.resize(segments.size());
+	Arena* arena = Arena::current();
+	pool.parallelFor(segments.size(), [&](size_t i)
+	{
+		// Per-segment temporaries go to a child of the load arena, whose blocks the next segment reuses
+		Arena segmentScratch(arena);
+		ArenaScope scratch(arena ? &segmentScratch : nullptr);
+		TRACE_SCOPE("build mesh");
+		MeshData& mesh = out.meshes[i];
+		BuildSegmentMesh(segments[i], chunks, positions, texCoords, normals, mesh);
+
+		auto found = materials.find(segments[i].material);
+		if (found != materials.end())
+		{
+			mesh.material = found->second.material;
+			if (!found->second.diffuseMap.empty())
+			{
+				Texture texture = {};
+				texture.type = "texture_diffuse";
+				texture.path = found->second.diffuseMap;
+				mesh.textures.push_back(texture);
+			}
+			if (!found->second.specularMap.empty())
+			{
+				Texture texture = {};
+				texture.type = "texture_specular";
+				texture.path = found->second.specularMap;
+				mesh.textures.push_back(texture);
+			}
+		}
+		else
+		{
+			mesh.material.ambient = glm::vec3(0.0f);
+			mesh.material.diffuse = glm::vec3(0.6f);
+			mesh.material.specular = glm::vec3(0.0f);
+			mesh.material.shininess = 0.0f;
+		}
+	});
+
+	// Drop meshes that lost all of their faces to broken indices
+	out.meshes.erase(std::remove_if(out.meshes.begin(), out.meshes.end(),
+		[](const MeshData& mesh) { return mesh.indices.empty(); }), out.meshes.end());
+
+	for (const MeshData& mesh : out.meshes)
+	{
+		out.totalVertices += static_cast<unsigned int>(mesh.vertices.size());
+		out.triangleCount += mesh.indices.size() / 3;
+		for (const Vertex& vertex : mesh.vertices)
+		{
+			out.minBounds = glm::min(out.minBounds, vertex.Position);
+			out.maxBounds = glm::max(out.maxBounds, vertex.Position);
+		}
+	}
+
+	return !out.meshes.empty();
+}
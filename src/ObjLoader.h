@@ -0,0 +1,28 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh.h"
+
+/// <summary>
+/// Result of the built-in OBJ importer. Meshes are split per object and per material the same way ASSIMP splits them.
+/// </summary>
+struct ObjModelData
+{
+	std::vector<MeshData> meshes;
+	glm::vec3 minBounds;
+	glm::vec3 maxBounds;
+	unsigned int totalVertices;
+	size_t triangleCount;
+};
+
+/// <summary>
+/// Built-in loader for the Blender OBJ/ MTL exports used by the demo. The OBJ file is memory mapped and split into
+/// line-aligned chunks that are parsed in parallel on the shared ThreadPool. Faces are fan-triangulated, UVs are
+/// flipped like aiProcess_FlipUVs, and identical v/vt/vn tuples are merged into a single vertex.
+/// </summary>
+bool LoadObjFile(const std::string& path, ObjModelData& out);
+
+#endif
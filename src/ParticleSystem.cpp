@@ -1,4 +1,14 @@
 #include "ParticleSystem.h"
+#include "GLStateCache.h"
+#include "Trace.h"
+
+namespace
+{
+    constexpr UniformId DELTA_TIME_UNIFORM("deltaTime");
+    constexpr UniformId MODEL_CENTER_UNIFORM("modelCenter");
+    constexpr UniformId PROJECTION_UNIFORM("proj");
+    constexpr UniformId VIEW_UNIFORM("view");
+}
 
 ParticleSystem::ParticleSystem(Shader& vfShader, Shader& cShader, Model& model, unsigned int maxParticles)
     : vfShader(vfShader), cShader(cShader), model(model), maxParticles(maxParticles)
@@ -16,6 +26,7 @@ ParticleSystem::ParticleSystem(Shader& vfShader, Shader& cShader, Model& model,
 
 void ParticleSystem::init()
 {
+	TRACE_SCOPE("particle system init");
 	//********* create and fulfill the particle data into shader storage buffer objects (for gen-purpose computing) **********
 	GLint bufMask = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
 
@@ -29,19 +40,13 @@ void ParticleSystem::init()
 
 	if (pos_array != NULL)
 	{
+		// Write the mesh positions straight into the mapped buffer, one particle per vertex. Meshes that did not keep
+		// their vertices in system memory hand out their position stream or read it back from their vertex buffer.
+		unsigned int i = 0;
 		for (const auto& mesh : model.meshes)
-		{
-			for (const auto& vertex : mesh.vertices)
-				verticesTotal.push_back(vertex.Position);
-		}
-
-		for (unsigned int i = 0; i < maxParticles; i++)
-		{
-			pos_array[i].x = verticesTotal[i].x;
-			pos_array[i].y = verticesTotal[i].y;
-			pos_array[i].z = verticesTotal[i].z;
-			pos_array[i].w = 1.0f;
-		}
+			i += static_cast<unsigned int>(mesh.readPositions(pos_array + i, maxParticles - i));
+		for (; i < maxParticles; i++)
+			pos_array[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 	}
 	glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
 
@@ -112,11 +117,11 @@ void ParticleSystem::init()
 
 	// bind the SSBOs to the labeled "binding" in the compute shader using assigned layout labels
 	// this is similar to mapping data to attribute variables in the vertex shader
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, pos_ssbo);    // 4 - lay out id for positions in compute shader 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, dir_ssbo);	// 5 - lay out id for directions in compute shader 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, color_ssbo);	// 6 - lay out id for colors in compute shader 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, speed_ssbo);	// 7 - lay out id for speeds in compute shader 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, active_ssbo);
+	GLStateCache::instance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, pos_ssbo);    // 4 - lay out id for positions in compute shader 
+	GLStateCache::instance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, dir_ssbo);	// 5 - lay out id for directions in compute shader 
+	GLStateCache::instance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, color_ssbo);	// 6 - lay out id for colors in compute shader 
+	GLStateCache::instance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, speed_ssbo);	// 7 - lay out id for speeds in compute shader 
+	GLStateCache::instance().bindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, active_ssbo);
 
 	// ************** Define VAO (for rendering) **************
 	// for particle rendering, the vertex and fragment shaders just need the verts and colors (computed by the compute shader).  
@@ -127,7 +132,7 @@ void ParticleSystem::init()
 	// the actual vert and color data have already been kept on the GPU memory by the SSBOs. 
 	// So VAO's attrobites point to these data on the GPU, rather than referring back to any CPU data. 
 	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+	GLStateCache::instance().bindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, pos_ssbo);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL); // 0 - the layout id in vertex shader
 	glBindBuffer(GL_ARRAY_BUFFER, color_ssbo);
@@ -143,18 +148,19 @@ void ParticleSystem::update(float deltaTime)
 {
 	// invoke the compute shader to update the status of particles 
     cShader.use();
-    cShader.setFloat("deltaTime", deltaTime);
-	cShader.setVec3("modelCenter", model.modelCenter);
+    cShader.setFloat(DELTA_TIME_UNIFORM, deltaTime);
+	cShader.setVec3(MODEL_CENTER_UNIFORM, model.modelCenter);
 	glDispatchCompute((maxParticles + 128 - 1) / 128, 1, 1); // one-dimentional GPU threading config, 128 threads per group 
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void ParticleSystem::draw(float particle_size, glm::mat4 projection, glm::mat4 view)
 {
+    // Both go through GLStateCache: from the second frame of particles on neither reaches GL
     vfShader.use();
-    glBindVertexArray(VAO);
-    vfShader.setMat4("proj", projection);
-	vfShader.setMat4("view", view);
+    GLStateCache::instance().bindVertexArray(VAO);
+    vfShader.setMat4(PROJECTION_UNIFORM, projection);
+	vfShader.setMat4(VIEW_UNIFORM, view);
 	glPointSize(particle_size);
     glDrawArrays(GL_POINTS, 0, maxParticles);
 }
@@ -37,7 +37,6 @@ private:
     Shader& vfShader;
     Shader& cShader;
     Model& model;
-    std::vector<glm::vec3> verticesTotal;
     float randomf(float min = -1.0f, float max = 1.0f);
 };
 #endif
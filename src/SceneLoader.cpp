@@ -0,0 +1,165 @@
+#include "SceneLoader.h"
+#include <algorithm>
+#include <iostream>
+#include "Trace.h"
+
+namespace
+{
+	double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count();
+	}
+}
+
+SceneLoader::SceneLoader(const ModelLoadOptions& options)
+	: options(options), reported(false)
+{
+}
+
+/// <summary>
+/// The jobs point into the pending models, so whatever is still running is finished before they are destroyed. If the
+/// window (and with it the GL context) is already gone, the jobs that have not started are dropped instead.
+/// </summary>
+SceneLoader::~SceneLoader()
+{
+	if (!glfwGetCurrentContext()) graph.cancel();
+	graph.wait();
+}
+
+/// <summary>
+/// Queue a model for loading. Must be called before start().
+/// </summary>
+/// <param name="path"> path of the model file. </param>
+/// <returns> shared handle to the model, which is already resident if another load brought it in. </returns>
+ModelHandle SceneLoader::add(const std::string& path)
+{
+	if (ModelHandle resident = ModelCache::instance().find(path, options)) return resident;
+
+	std::unique_ptr<PendingModel> model(new PendingModel());
+	model->path = path;
+	model->model = ModelCache::instance().adopt(path, options, new Model(path, options, false));
+	model->imported = std::make_shared<ImportedModel>();
+	addJobs(*model);
+	pending.push_back(std::move(model));
+	return pending.back()->model;
+}
+
+void SceneLoader::start()
+{
+	startTime = std::chrono::high_resolution_clock::now();
+	graph.start();
+}
+
+/// <summary>
+/// Advance the load: run the GL jobs that are ready, then stream the buffers of incrementally loaded models with
+/// whatever is left of the budget.
+/// </summary>
+/// <param name="budgetMs"> time this call may spend on the GL thread. </param>
+/// <returns> true once every model has finished loading (or failed). </returns>
+bool SceneLoader::update(double budgetMs)
+{
+	auto stepStart = std::chrono::high_resolution_clock::now();
+	bool jobsDone = graph.runMainThreadJobs(budgetMs);
+
+	for (const std::unique_ptr<PendingModel>& model : pending)
+	{
+		double remainingMs = budgetMs - ElapsedMs(stepStart);
+		if (remainingMs <= 0.0) break;
+		if (model->model->loadState() == ModelLoadState::Loading) model->model->updateLoad(remainingMs);
+	}
+
+	if (!jobsDone || !modelsLoaded()) return false;
+	if (!reported)
+	{
+		std::cout << "DEBUG LOG: SCENE LOAD OF " << pending.size() << " MODELS SUCCESSFUL (" << ElapsedMs(startTime) << " ms)" << std::endl;
+		reported = true;
+	}
+	return true;
+}
+
+/// <summary>
+/// Block until every model has finished loading.
+/// </summary>
+void SceneLoader::finish()
+{
+	graph.wait();
+	for (const std::unique_ptr<PendingModel>& model : pending)
+		while (!model->model->updateLoad(1000.0)) {}
+	update(0.0);
+}
+
+/// <summary>
+/// Build the four jobs of a model:
+///   parse (worker)    - read the mesh cache, or parse the file without post-processing
+///   process (worker)  - optimize meshes/ generate LODs and write the mesh cache, after parse
+///   textures (GL)     - request every texture, so decoding starts while the meshes are still being processed, after parse
+///   upload (GL)       - create the meshes (or start their incremental upload), after process and textures
+/// </summary>
+void SceneLoader::addJobs(PendingModel& model)
+{
+	PendingModel* target = &model;
+	const ModelLoadOptions& loadOptions = options;
+
+	JobGraph::JobId parse = graph.add([target, loadOptions]()
+	{
+		TRACE_SCOPE("scene parse", target->path);
+		ArenaScope scratch(&target->scratch);
+		ImportedModel& imported = *target->imported;
+		bool cached = loadOptions.useMeshCache && Model::readCache(target->path, loadOptions, imported);
+		if (!cached && !Model::parseModel(target->path, loadOptions, imported))
+		{
+			target->failed = true;
+			return;
+		}
+
+		for (const MeshData& mesh : imported.meshes)
+		{
+			for (const Texture& texture : mesh.textures)
+			{
+				std::pair<std::string, std::string> entry(texture.path, texture.type);
+				if (std::find(target->texturePaths.begin(), target->texturePaths.end(), entry) == target->texturePaths.end())
+					target->texturePaths.push_back(entry);
+			}
+		}
+	});
+
+	JobGraph::JobId process = graph.add([target, loadOptions]()
+	{
+		TRACE_SCOPE("scene process", target->path);
+		ImportedModel& imported = *target->imported;
+		if (!target->failed && !imported.fromCache)
+		{
+			ArenaScope scratch(&target->scratch);
+			if (loadOptions.optimizeMeshes || loadOptions.generateLods) Model::postProcessMeshData(imported.meshes, loadOptions);
+			if (loadOptions.useMeshCache) Model::writeCache(target->path, loadOptions, imported);
+		}
+		target->scratch.release(); // parse and processing temporaries are no longer needed
+	}, JobThread::Worker, { parse });
+
+	JobGraph::JobId textures = graph.add([target]()
+	{
+		TRACE_SCOPE("scene textures", target->path);
+		if (target->failed || target->model->options.packTextureArrays) return; // packed when the meshes are created
+		for (const auto& entry : target->texturePaths)
+			target->textures.push_back(target->model->loadTexture(entry.first, entry.second));
+	}, JobThread::Main, { parse });
+
+	auto start = &startTime;
+	graph.add([target, start]()
+	{
+		TRACE_SCOPE("scene upload", target->path);
+		if (target->failed) std::cerr << "ERROR::SCENELOADER::Could not load " << target->path << std::endl;
+		target->model->finishImport(target->failed ? nullptr : target->imported);
+		if (target->model->loadState() == ModelLoadState::Ready)
+			std::cout << "DEBUG LOG: " << target->imported->importer << " MODEL LOAD SUCCESSFUL (" << ElapsedMs(*start) << " ms into scene load)" << std::endl;
+		target->textures.clear(); // the meshes hold their own references now
+	}, JobThread::Main, { process, textures });
+}
+
+bool SceneLoader::modelsLoaded() const
+{
+	for (const std::unique_ptr<PendingModel>& model : pending)
+		if (model->model->loadState() == ModelLoadState::Loading) return false;
+	return true;
+}
@@ -0,0 +1,58 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Arena.h"
+#include "JobGraph.h"
+#include "ModelCache.h"
+
+/// <summary>
+/// Loads a list of models concurrently. Each model gets a parse, a process, a texture and an upload job in one
+/// JobGraph, so parsing and mesh processing of all models overlap across the ThreadPool while the GL work (texture
+/// requests, buffer creation) is funneled to the context thread. Models are shared through the ModelCache: paths that
+/// are already resident are not loaded again. GL thread only.
+/// </summary>
+class SceneLoader
+{
+public:
+	explicit SceneLoader(const ModelLoadOptions& options = ModelLoadOptions());
+	~SceneLoader();
+	SceneLoader(const SceneLoader&) = delete;
+	SceneLoader& operator=(const SceneLoader&) = delete;
+
+	// Queue a model before start(). The handle is usable right away and stays in the Loading state until it is uploaded.
+	ModelHandle add(const std::string& path);
+	void start();
+
+	// Call once per frame: runs GL jobs and incremental uploads within the budget. Returns true once every model is done.
+	bool update(double budgetMs);
+	void finish();
+
+private:
+	// Everything the jobs of one model share
+	struct PendingModel
+	{
+		std::string path;
+		ModelHandle model;
+		std::shared_ptr<ImportedModel> imported;
+		std::vector<std::pair<std::string, std::string>> texturePaths; // (path, type) of every texture the meshes use
+		std::vector<Texture> textures;                                 // acquired early, held until the meshes exist
+		Arena scratch;
+		bool failed = false;
+	};
+
+	ModelLoadOptions options;
+	JobGraph graph;
+	std::vector<std::unique_ptr<PendingModel>> pending;
+	std::chrono::high_resolution_clock::time_point startTime;
+	bool reported;
+
+	void addJobs(PendingModel& model);
+	bool modelsLoaded() const;
+};
+
+#endif
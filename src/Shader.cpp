@@ -1,33 +1,21 @@
 #include "Shader.h"
 
+#include <cstdlib>
+#include <cstring>
+#include "AssetPack.h"
+#include "GLStateCache.h"
+#include "Trace.h"
+
 // Constructors
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
 {
+	TRACE_SCOPE("shader", vertexPath);
 	// 1. Retrive vertex/ fragment shader source code from file path
 	std::string vertexCode;
 	std::string fragmentCode;
-	std::ifstream vertexShaderFile;
-	std::ifstream fragmentShaderFile;
 
-	// error exception handling when reading files
-	vertexShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fragmentShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try
-	{
-		vertexShaderFile.open(vertexPath);
-		fragmentShaderFile.open(fragmentPath);
-
-		std::stringstream vertexShaderStream, fragmentShaderStream, geometryShaderStream;
-		vertexShaderStream << vertexShaderFile.rdbuf();
-		fragmentShaderStream << fragmentShaderFile.rdbuf();
-
-		vertexShaderFile.close();
-		fragmentShaderFile.close();
-
-		vertexCode = vertexShaderStream.str();
-		fragmentCode = fragmentShaderStream.str();
-	}
-	catch (std::ifstream::failure e)
+	// Looked up in the mounted asset pack first, then on disk
+	if (!ReadAssetText(vertexPath, vertexCode) || !ReadAssetText(fragmentPath, fragmentCode))
 	{
 		std::cerr << "ERROR: Shader Files Not Successfully Read!" << std::endl;
 	}
@@ -76,42 +64,18 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	// Delete shaders after successfully linking them, they're no longer needed
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	reflectUniforms();
 }
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
 {
+	TRACE_SCOPE("shader", vertexPath);
 	// 1. Retrive vertex/ fragment shader source code from file path
 	std::string vertexCode;
 	std::string fragmentCode;
 	std::string geometryCode;
-	std::ifstream vertexShaderFile;
-	std::ifstream fragmentShaderFile;
-	std::ifstream geometryShaderFile;
-
-	// error exception handling when reading files
-	vertexShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fragmentShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	geometryShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try
-	{
-		vertexShaderFile.open(vertexPath);
-		fragmentShaderFile.open(fragmentPath);
-		geometryShaderFile.open(geometryPath);
-
-		std::stringstream vertexShaderStream, fragmentShaderStream, geometryShaderStream;
-		vertexShaderStream << vertexShaderFile.rdbuf();
-		fragmentShaderStream << fragmentShaderFile.rdbuf();
-		geometryShaderStream << geometryShaderFile.rdbuf();
-
-		vertexShaderFile.close();
-		fragmentShaderFile.close();
-		geometryShaderFile.close();
-
-		vertexCode = vertexShaderStream.str();
-		fragmentCode = fragmentShaderStream.str();
-		geometryCode = geometryShaderStream.str();
-	} 
-	catch (std::ifstream::failure e)
+
+	if (!ReadAssetText(vertexPath, vertexCode) || !ReadAssetText(fragmentPath, fragmentCode) || !ReadAssetText(geometryPath, geometryCode))
 	{
 		std::cerr << "ERROR: Shader Files Not Successfully Read!" << std::endl;
 	}
@@ -178,23 +142,14 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geo
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 	glDeleteShader(geometry);
+	reflectUniforms();
 }
 
 Shader::Shader(const char* computePath)
 {
+	TRACE_SCOPE("shader", computePath);
 	std::string computeCode;
-	std::ifstream computeShaderFile;
-
-	computeShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try
-	{
-		computeShaderFile.open(computePath);
-		std::stringstream computeShaderStream;
-		computeShaderStream << computeShaderFile.rdbuf();
-		computeShaderFile.close();
-		computeCode = computeShaderStream.str();
-	}
-	catch (std::ifstream::failure e)
+	if (!ReadAssetText(computePath, computeCode))
 	{
 		std::cerr << "ERROR: Compute Shader File Not Successfully Read!" << std::endl;
 	}
@@ -226,37 +181,169 @@ Shader::Shader(const char* computePath)
 	}
 
 	glDeleteShader(compute);
+	reflectUniforms();
 }
 
+/// <summary>
+/// Make the program current. Goes through GLStateCache, so using the program that is already current costs nothing.
+/// </summary>
 void Shader::use()
 {
-	glUseProgram(ID);
+	GLStateCache::instance().useProgram(ID);
+}
+
+void Shader::release()
+{
+	GLStateCache::instance().programDeleted(ID);
+	glDeleteProgram(ID);
+	ID = 0;
+}
+
+/// <summary>
+/// Fill the uniform table with every active uniform of the linked program. Arrays are also entered under their name
+/// without "[0]". Uniforms inside uniform blocks have no location and are skipped.
+/// </summary>
+void Shader::reflectUniforms()
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	size_t capacity = 16;
+	while (capacity < size_t(count) * 4) capacity *= 2; // at most two names per uniform, keeps the table half empty
+	UniformSlot empty = {};
+	empty.location = -1;
+	uniformTable.assign(capacity, empty);
+
+	std::vector<char> name(maxLength > 0 ? maxLength : 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(ID, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+		int location = glGetUniformLocation(ID, name.data());
+		if (location < 0) continue;
+
+		addUniform(name.data(), location);
+		if (length > 3 && std::strcmp(name.data() + length - 3, "[0]") == 0)
+		{
+			name[length - 3] = '\0';
+			addUniform(name.data(), location);
+		}
+	}
+}
+
+/// <summary>
+/// Enter a uniform into the table. Two uniforms of one program with the same hash can't both be looked up by
+/// UniformId, so that is fatal: one of them has to be renamed.
+/// </summary>
+void Shader::addUniform(const char* name, int location)
+{
+	uint32_t hash = UniformId::Hash(name);
+	size_t mask = uniformTable.size() - 1;
+	for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+	{
+		UniformSlot& entry = uniformTable[slot];
+		if (entry.location < 0)
+		{
+			entry.hash = hash;
+			entry.location = location;
+#ifndef NDEBUG
+			entry.name = name;
+#endif
+			return;
+		}
+		if (entry.hash == hash)
+		{
+			std::cerr << "ERROR: Uniform " << name << " has the same hash as another uniform of program " << ID << ", rename one of them" << std::endl;
+			std::abort();
+		}
+	}
+}
+
+/// <summary>
+/// Location of an active uniform, or -1 (which glUniform* ignores) if the program has no such uniform. Debug builds
+/// also compare the name, so a name the program doesn't have can't hit a uniform with the same hash.
+/// </summary>
+int Shader::uniformLocation(UniformId id) const
+{
+	size_t mask = uniformTable.size() - 1;
+	for (size_t slot = id.hash & mask; uniformTable[slot].location >= 0; slot = (slot + 1) & mask)
+	{
+		const UniformSlot& entry = uniformTable[slot];
+		if (entry.hash != id.hash) continue;
+#ifndef NDEBUG
+		if (entry.name != id.name)
+		{
+			std::cerr << "ERROR: Uniform " << id.name << " has the same hash as uniform " << entry.name << " of program " << ID << std::endl;
+			return -1;
+		}
+#endif
+		return entry.location;
+	}
+	return -1;
 }
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	glUniform1i(uniformLocation(UniformId(name.c_str())), (int)value);
 }
 void Shader::setInt(const std::string& name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1i(uniformLocation(UniformId(name.c_str())), value);
 }
 void Shader::setFloat(const std::string& name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1f(uniformLocation(UniformId(name.c_str())), value);
 }
 
 void Shader::setMat4(const std::string& name, glm::mat4& value) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+	glUniformMatrix4fv(uniformLocation(UniformId(name.c_str())), 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::setVec3(const std::string& name, glm::vec3& value) const 
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+	glUniform3fv(uniformLocation(UniformId(name.c_str())), 1, glm::value_ptr(value));
 }
 
 void Shader::setVec3(const std::string& name, float x, float y, float z) const
 {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
-}
\ No newline at end of file
+	glUniform3f(uniformLocation(UniformId(name.c_str())), x, y, z);
+}
+
+void Shader::setVec4Array(const std::string& name, const glm::vec4* values, int count) const
+{
+	glUniform4fv(uniformLocation(UniformId(name.c_str())), count, glm::value_ptr(values[0]));
+}
+
+void Shader::setBool(UniformId id, bool value) const
+{
+	glUniform1i(uniformLocation(id), (int)value);
+}
+
+void Shader::setInt(UniformId id, int value) const
+{
+	glUniform1i(uniformLocation(id), value);
+}
+
+void Shader::setFloat(UniformId id, float value) const
+{
+	glUniform1f(uniformLocation(id), value);
+}
+
+void Shader::setMat4(UniformId id, const glm::mat4& value) const
+{
+	glUniformMatrix4fv(uniformLocation(id), 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void Shader::setVec3(UniformId id, const glm::vec3& value) const
+{
+	glUniform3fv(uniformLocation(id), 1, glm::value_ptr(value));
+}
+
+void Shader::setVec4Array(UniformId id, const glm::vec4* values, int count) const
+{
+	glUniform4fv(uniformLocation(id), count, glm::value_ptr(values[0]));
+}
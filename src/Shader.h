@@ -3,7 +3,9 @@
 
 #include <glad/glad.h>
 
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -11,6 +13,35 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+/// <summary>
+/// A uniform name hashed with 32 bit FNV-1a. Declared constexpr, the hash is computed by the compiler, so setting a
+/// uniform through it does no string building or hashing at runtime:
+///     constexpr UniformId MODEL_CENTER_UNIFORM("modelCenter");
+/// The name is kept as well, so debug builds can tell a uniform from another name with the same hash.
+/// </summary>
+struct UniformId
+{
+	uint32_t hash;
+	const char* name; // only valid as long as the string the id was made from
+
+	constexpr explicit UniformId(const char* name) : hash(Hash(name)), name(name) {}
+
+	static constexpr uint32_t Hash(const char* name)
+	{
+		uint32_t hash = 2166136261u;
+		while (*name)
+		{
+			hash ^= static_cast<unsigned char>(*name++);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+};
+
+/// <summary>
+/// A linked shader program. All active uniforms are looked up once at link time and kept in a flat hash table keyed
+/// by UniformId, so setters never call glGetUniformLocation. The name based setters hash the name at runtime.
+/// </summary>
 class Shader 
 {
 public:
@@ -21,6 +52,7 @@ public:
 	Shader(const char* computePath);
 
 	void use();
+	void release();
 
 	void setBool(const std::string& name, bool value) const;
 	void setInt(const std::string& name, int value) const;
@@ -28,6 +60,30 @@ public:
 	void setMat4(const std::string& name, glm::mat4& value) const;
 	void setVec3(const std::string& name, glm::vec3& value) const;
 	void setVec3(const std::string& name, float x, float y, float z) const;
+	void setVec4Array(const std::string& name, const glm::vec4* values, int count) const;
+
+	void setBool(UniformId id, bool value) const;
+	void setInt(UniformId id, int value) const;
+	void setFloat(UniformId id, float value) const;
+	void setMat4(UniformId id, const glm::mat4& value) const;
+	void setVec3(UniformId id, const glm::vec3& value) const;
+	void setVec4Array(UniformId id, const glm::vec4* values, int count) const;
+	int uniformLocation(UniformId id) const;
+
+private:
+	struct UniformSlot
+	{
+		uint32_t hash;
+		int location; // -1 marks an empty slot
+#ifndef NDEBUG
+		std::string name; // checked against the looked up name
+#endif
+	};
+
+	std::vector<UniformSlot> uniformTable; // open addressing with linear probing, size is a power of two
+
+	void reflectUniforms();
+	void addUniform(const char* name, int location);
 };
 
 #endif
@@ -0,0 +1,127 @@
+#include "TextureArrays.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include "AssetPack.h"
+#include "GLStateCache.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "stb_image.h"
+
+namespace
+{
+	struct DecodedImage
+	{
+		unsigned char* pixels = nullptr;
+		int width = 0, height = 0, channels = 0;
+	};
+
+	GLenum FormatForChannels(int channels)
+	{
+		if (channels == 1) return GL_RED;
+		if (channels == 2) return GL_RG;
+		if (channels == 3) return GL_RGB;
+		return GL_RGBA;
+	}
+
+	GLenum InternalFormatForChannels(int channels)
+	{
+		if (channels == 1) return GL_R8;
+		if (channels == 2) return GL_RG8;
+		if (channels == 3) return GL_RGB8;
+		return GL_RGBA8;
+	}
+}
+
+/// <summary>
+/// Decode the images on the shared ThreadPool, group them by size and channel count and upload every group as one
+/// mipmapped texture array. Images that fail to load get no layer. GL thread only.
+/// </summary>
+/// <param name="paths"> full paths of the images, without duplicates. </param>
+/// <returns> false if any image could not be loaded. </returns>
+bool TextureArraySet::pack(const std::vector<std::string>& paths)
+{
+	TRACE_SCOPE("texture array pack");
+	std::vector<DecodedImage> images(paths.size());
+	ThreadPool::shared().parallelFor(paths.size(), [&paths, &images](size_t i)
+	{
+		TRACE_SCOPE("texture decode", paths[i]);
+		DecodedImage& image = images[i];
+		image.pixels = LoadImageAsset(paths[i], &image.width, &image.height, &image.channels);
+	});
+
+	bool loaded = true;
+	std::map<std::tuple<int, int, int>, std::vector<size_t>> groups; // (width, height, channels) -> images
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (!images[i].pixels)
+		{
+			std::cerr << "Texture failed to load at path: " << paths[i] << std::endl;
+			loaded = false;
+			continue;
+		}
+		groups[std::make_tuple(images[i].width, images[i].height, images[i].channels)].push_back(i);
+	}
+
+	for (const auto& group : groups)
+	{
+		int width = std::get<0>(group.first);
+		int height = std::get<1>(group.first);
+		int channels = std::get<2>(group.first);
+		const std::vector<size_t>& members = group.second;
+		GLsizei levels = 1;
+		while ((std::max(width, height) >> levels) > 0) levels++;
+
+		unsigned int arrayID;
+		glGenTextures(1, &arrayID);
+		GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D_ARRAY, arrayID);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, InternalFormatForChannels(channels), width, height, static_cast<GLsizei>(members.size()));
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (size_t layer = 0; layer < members.size(); layer++)
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), width, height, 1, FormatForChannels(channels), GL_UNSIGNED_BYTE,
+				images[members[layer]].pixels);
+			TextureLayer& entry = layers[paths[members[layer]]];
+			entry.array = arrayID;
+			entry.layer = static_cast<int>(layer);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		arrays.push_back(arrayID);
+		bytes += size_t(width) * height * channels * members.size() * 4 / 3; // the mip chain adds about a third
+	}
+
+	for (DecodedImage& image : images)
+		stbi_image_free(image.pixels);
+
+	std::cout << "DEBUG LOG: PACKED " << layers.size() << " TEXTURES INTO " << arrays.size() << " TEXTURE ARRAYS (" << bytes / 1024 << " KB)" << std::endl;
+	return loaded;
+}
+
+TextureLayer TextureArraySet::find(const std::string& path) const
+{
+	auto found = layers.find(path);
+	return found != layers.end() ? found->second : TextureLayer();
+}
+
+/// <summary>
+/// Delete the texture arrays. GL thread only.
+/// </summary>
+void TextureArraySet::release()
+{
+	for (unsigned int array : arrays)
+		GLStateCache::instance().textureDeleted(array);
+	if (!arrays.empty()) glDeleteTextures(static_cast<GLsizei>(arrays.size()), arrays.data());
+	arrays.clear();
+	layers.clear();
+	bytes = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TEXTUREARRAYS_H
+#define TEXTUREARRAYS_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// <summary>
+/// Where a packed material texture lives: a GL_TEXTURE_2D_ARRAY and the layer inside it (-1 if not packed).
+/// </summary>
+struct TextureLayer
+{
+	unsigned int array = 0;
+	int layer = -1;
+};
+
+/// <summary>
+/// The material textures of a model packed into texture arrays at load time, one GL_TEXTURE_2D_ARRAY per image size
+/// and channel count. Meshes whose maps share an array draw without rebinding textures, they only change the layer
+/// they sample. The arrays are freed explicitly with release(), by the Model that owns them.
+/// </summary>
+class TextureArraySet
+{
+public:
+	bool pack(const std::vector<std::string>& paths);
+	TextureLayer find(const std::string& path) const;
+	bool empty() const { return arrays.empty(); }
+	size_t arrayCount() const { return arrays.size(); }
+	size_t byteSize() const { return bytes; }
+	void release();
+
+private:
+	std::vector<unsigned int> arrays;
+	std::unordered_map<std::string, TextureLayer> layers; // by the path given to pack()
+	size_t bytes = 0;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "TextureCache.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <vector>
+#include "AssetPack.h"
+#include "GLStateCache.h"
+#include "MappedFile.h"
+#include "TextureCooker.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "Trace.h"
+#include "stb_image.h"
+
+namespace
+{
+	// 64 bit FNV-1a over the whole file
+	uint64_t HashFileContents(const std::string& path)
+	{
+		MappedFile file;
+		std::vector<unsigned char> packed;
+		const AssetPack* pack = MountedAssetPack();
+		bool fromPack = pack && pack->contains(path);
+		if (fromPack ? !pack->read(path, packed) : !file.open(path)) return 0;
+
+		uint64_t hash = 14695981039346656037ull;
+		const unsigned char* bytes = fromPack ? packed.data() : file.data();
+		size_t size = fromPack ? packed.size() : file.size();
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+TextureCache& TextureCache::instance()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::TextureCache()
+	: hashContents(false), streamTextures(false)
+{
+}
+
+/// <summary>
+/// Turn a texture path into its cache key: forward slashes only, no "." or ".." segments, and lower case on Windows
+/// where the file system is case insensitive. "assets\models\..\models\brick.png" and "assets/models/brick.png" match.
+/// </summary>
+std::string TextureCache::normalizePath(const std::string& path)
+{
+	std::string unified = path;
+	std::replace(unified.begin(), unified.end(), '\\', '/');
+#ifdef _WIN32
+	std::transform(unified.begin(), unified.end(), unified.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+#endif
+
+	std::vector<std::string> segments;
+	size_t start = 0;
+	while (start <= unified.size())
+	{
+		size_t slash = unified.find('/', start);
+		if (slash == std::string::npos) slash = unified.size();
+		std::string segment = unified.substr(start, slash - start);
+		start = slash + 1;
+
+		if (segment.empty() || segment == ".") continue;
+		if (segment == ".." && !segments.empty() && segments.back() != "..") segments.pop_back();
+		else segments.push_back(segment);
+	}
+
+	std::string normalized = (!unified.empty() && unified[0] == '/') ? "/" : "";
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		if (i > 0) normalized += '/';
+		normalized += segments[i];
+	}
+	return normalized;
+}
+
+/// <summary>
+/// Get a reference counted handle to the texture at the given path, loading it only if no other model holds it yet.
+/// </summary>
+/// <param name="path"> path of the image file. </param>
+/// <param name="async"> decode in the background through the TextureLoader, showing a placeholder until then. Streamed
+/// textures (see setStreaming) always load in the background. </param>
+/// <returns></returns>
+TextureHandle TextureCache::acquire(const std::string& path, bool async)
+{
+	std::string key = normalizePath(path);
+	auto found = byPath.find(key);
+	if (found != byPath.end())
+	{
+		if (TextureHandle existing = found->second.lock()) return existing;
+	}
+
+	// Same image stored under a different name (e.g. a copied brick map next to each prop)
+	uint64_t contentHash = hashContents ? HashFileContents(path) : 0;
+	if (contentHash != 0)
+	{
+		auto sameContent = byContent.find(contentHash);
+		if (sameContent != byContent.end())
+		{
+			if (TextureHandle existing = sameContent->second.lock())
+			{
+				byPath[key] = existing;
+				return existing;
+			}
+		}
+	}
+
+	TextureResource* resource = new TextureResource();
+	if (streamTextures) resource->id = TextureStreamer::instance().load(path);
+	else resource->id = async ? TextureLoader::instance().load(path) : TextureFromFile(path);
+	resource->key = key;
+	resource->contentHash = contentHash;
+
+	TextureHandle handle(resource, [](TextureResource* released) { TextureCache::instance().release(released); });
+	byPath[key] = handle;
+	if (contentHash != 0) byContent[contentHash] = handle;
+	return handle;
+}
+
+size_t TextureCache::residentCount() const
+{
+	size_t count = 0;
+	for (const auto& entry : byPath)
+		if (!entry.second.expired()) count++;
+	return count;
+}
+
+/// <summary>
+/// Called when the last handle to a texture goes away: forget it and free the GL texture.
+/// </summary>
+void TextureCache::release(TextureResource* resource)
+{
+	auto samePath = byPath.find(resource->key);
+	if (samePath != byPath.end() && samePath->second.expired()) byPath.erase(samePath);
+
+	// Other paths may alias the same texture through its content hash, drop those as well
+	if (resource->contentHash != 0)
+	{
+		for (auto it = byPath.begin(); it != byPath.end();)
+		{
+			if (it->second.expired()) it = byPath.erase(it);
+			else ++it;
+		}
+		auto sameContent = byContent.find(resource->contentHash);
+		if (sameContent != byContent.end() && sameContent->second.expired()) byContent.erase(sameContent);
+	}
+
+	TextureLoader::instance().release(resource->id);
+	TextureStreamer::instance().release(resource->id);
+
+	// Handles can outlive the window at shutdown, by then there is no context to delete the texture from
+	if (glfwGetCurrentContext())
+	{
+		GLStateCache::instance().textureDeleted(resource->id);
+		glDeleteTextures(1, &resource->id);
+	}
+	delete resource;
+}
+
+/// <summary>
+/// Generate and bind textures synchronously. A cooked texture is used as is when one exists for the path.
+/// </summary>
+/// <param name="path"></param>
+/// <returns></returns>
+unsigned int TextureCache::TextureFromFile(const std::string& path)
+{
+	TRACE_SCOPE("texture load", path);
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+
+	CookedTexture cooked;
+	if (cooked.open(path))
+	{
+		UploadCookedTexture(textureID, cooked);
+		return textureID;
+	}
+
+	int width, height, nrComponents;
+	unsigned char* data = LoadImageAsset(path, &width, &height, &nrComponents);
+	if (data)
+	{
+		GLenum format;
+		if (nrComponents == 1)
+			format = GL_RED;
+		else if (nrComponents == 2)
+			format = GL_RG;
+		else if (nrComponents == 3)
+			format = GL_RGB;
+		else
+			format = GL_RGBA;
+
+		GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		stbi_image_free(data);
+	}
+	else
+	{
+		std::cerr << "Texture failed to load at path: " << path << std::endl;
+		stbi_image_free(data);
+	}
+
+	return textureID;
+}
@@ -0,0 +1,49 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/// <summary>
+/// A GL texture owned by the TextureCache. The texture is deleted when the last handle to it is released.
+/// </summary>
+struct TextureResource
+{
+	unsigned int id;
+	std::string key;
+	uint64_t contentHash;
+};
+
+typedef std::shared_ptr<TextureResource> TextureHandle;
+
+/// <summary>
+/// Process-wide texture cache shared by all models. Textures are keyed by their normalized path and, when content
+/// hashing is enabled, by a hash of the file contents, so identical maps referenced by several props are only
+/// decoded and resident once. GL thread only.
+/// </summary>
+class TextureCache
+{
+public:
+	static TextureCache& instance();
+
+	TextureHandle acquire(const std::string& path, bool async);
+	void setContentHashing(bool enabled) { hashContents = enabled; }
+	void setStreaming(bool enabled) { streamTextures = enabled; } // new textures go through the TextureStreamer
+	size_t residentCount() const;
+
+	static std::string normalizePath(const std::string& path);
+
+private:
+	std::unordered_map<std::string, std::weak_ptr<TextureResource>> byPath;
+	std::unordered_map<uint64_t, std::weak_ptr<TextureResource>> byContent;
+	bool hashContents;
+	bool streamTextures;
+
+	TextureCache();
+	void release(TextureResource* resource);
+	static unsigned int TextureFromFile(const std::string& path);
+};
+
+#endif
@@ -0,0 +1,399 @@
+#include "TextureCooker.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "GLStateCache.h"
+#include "stb_image.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COOKER_USE_SSE2 1
+#endif
+
+namespace
+{
+	const char COOKED_TEXTURE_MAGIC[4] = { 'M', 'D', 'T', 'X' };
+	const uint32_t COOKED_TEXTURE_VERSION = 1;
+	const size_t COOKED_TEXTURE_ALIGNMENT = 16;
+	const int ROWS_PER_JOB = 16;
+	const int LINEAR_TO_SRGB_STEPS = 4096;
+
+	struct CookedTextureHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceSize;
+		int64_t sourceModifiedTime;
+		uint32_t width;
+		uint32_t height;
+		uint32_t channels;
+		uint32_t levelCount;
+	};
+
+	struct CookedLevelRecord
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	/// <summary>
+	/// Lookup tables for the sRGB transfer function, so mips are averaged in linear space (gamma-correct) without
+	/// calling pow() per texel.
+	/// </summary>
+	struct GammaTables
+	{
+		float toLinear[256];
+		unsigned char toSrgb[LINEAR_TO_SRGB_STEPS + 1];
+
+		GammaTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i <= LINEAR_TO_SRGB_STEPS; i++)
+			{
+				float l = float(i) / LINEAR_TO_SRGB_STEPS;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f)));
+			}
+		}
+	};
+
+	const GammaTables& Gamma()
+	{
+		static GammaTables tables;
+		return tables;
+	}
+
+	// Only the colour channels of RGB(A) images are sRGB encoded. Alpha and 1/ 2 channel maps are stored linearly.
+	inline bool IsGammaChannel(int channels, int channel)
+	{
+		return channels >= 3 && channel < 3;
+	}
+
+	/// <summary>
+	/// One mip level in linear space, always padded to four floats per texel so it can be filtered with SSE.
+	/// </summary>
+	struct LinearImage
+	{
+		int width;
+		int height;
+		std::vector<float> texels;
+	};
+
+	void DecodeToLinear(const unsigned char* pixels, int width, int height, int channels, LinearImage& out)
+	{
+		const GammaTables& gamma = Gamma();
+		out.width = width;
+		out.height = height;
+		out.texels.assign(size_t(width) * height * 4, 1.0f);
+
+		int rowJobs = (height + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+		ThreadPool::shared().parallelFor(rowJobs, [&](size_t job)
+		{
+			int yEnd = std::min(height, int(job + 1) * ROWS_PER_JOB);
+			for (int y = int(job) * ROWS_PER_JOB; y < yEnd; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					size_t texel = size_t(y) * width + x;
+					for (int c = 0; c < channels; c++)
+					{
+						unsigned char value = pixels[texel * channels + c];
+						out.texels[texel * 4 + c] = IsGammaChannel(channels, c) ? gamma.toLinear[value] : value / 255.0f;
+					}
+				}
+			}
+		});
+	}
+
+	/// <summary>
+	/// 2x2 box filter into the next mip level. Odd edges are clamped, so a 5 texel wide level filters into 2 texels.
+	/// </summary>
+	void Downsample(const LinearImage& src, LinearImage& dst)
+	{
+		dst.width = std::max(1, src.width / 2);
+		dst.height = std::max(1, src.height / 2);
+		dst.texels.resize(size_t(dst.width) * dst.height * 4);
+
+		int rowJobs = (dst.height + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+		ThreadPool::shared().parallelFor(rowJobs, [&](size_t job)
+		{
+			int yEnd = std::min(dst.height, int(job + 1) * ROWS_PER_JOB);
+			for (int y = int(job) * ROWS_PER_JOB; y < yEnd; y++)
+			{
+				const float* row0 = &src.texels[size_t(std::min(2 * y, src.height - 1)) * src.width * 4];
+				const float* row1 = &src.texels[size_t(std::min(2 * y + 1, src.height - 1)) * src.width * 4];
+				float* out = &dst.texels[size_t(y) * dst.width * 4];
+
+				for (int x = 0; x < dst.width; x++)
+				{
+					int x0 = std::min(2 * x, src.width - 1) * 4;
+					int x1 = std::min(2 * x + 1, src.width - 1) * 4;
+#ifdef COOKER_USE_SSE2
+					__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+						_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+					_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+					for (int c = 0; c < 4; c++)
+						out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+				}
+			}
+		});
+	}
+
+	void EncodeFromLinear(const LinearImage& image, int channels, std::vector<unsigned char>& out)
+	{
+		const GammaTables& gamma = Gamma();
+		out.resize(size_t(image.width) * image.height * channels);
+
+		int rowJobs = (image.height + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+		ThreadPool::shared().parallelFor(rowJobs, [&](size_t job)
+		{
+			int yEnd = std::min(image.height, int(job + 1) * ROWS_PER_JOB);
+			for (int y = int(job) * ROWS_PER_JOB; y < yEnd; y++)
+			{
+				for (int x = 0; x < image.width; x++)
+				{
+					size_t texel = size_t(y) * image.width + x;
+					for (int c = 0; c < channels; c++)
+					{
+						float value = std::min(1.0f, std::max(0.0f, image.texels[texel * 4 + c]));
+						out[texel * channels + c] = IsGammaChannel(channels, c)
+							? gamma.toSrgb[int(value * LINEAR_TO_SRGB_STEPS + 0.5f)]
+							: static_cast<unsigned char>(value * 255.0f + 0.5f);
+					}
+				}
+			}
+		});
+	}
+
+	size_t AlignUp(size_t offset)
+	{
+		return (offset + COOKED_TEXTURE_ALIGNMENT - 1) & ~(COOKED_TEXTURE_ALIGNMENT - 1);
+	}
+
+	GLenum FormatForChannels(int channels)
+	{
+		if (channels == 1) return GL_RED;
+		if (channels == 2) return GL_RG;
+		if (channels == 3) return GL_RGB;
+		return GL_RGBA;
+	}
+
+	GLenum InternalFormatForChannels(int channels)
+	{
+		if (channels == 1) return GL_R8;
+		if (channels == 2) return GL_RG8;
+		if (channels == 3) return GL_RGB8;
+		return GL_RGBA8;
+	}
+}
+
+std::string CookedTexturePath(const std::string& sourcePath)
+{
+	return sourcePath + ".ctex";
+}
+
+/// <summary>
+/// Map the cooked version of a texture, if there is one that is newer than the source image.
+/// </summary>
+/// <param name="sourcePath"> path of the original image file. </param>
+/// <returns> false if there is no valid, up to date cooked texture. </returns>
+bool CookedTexture::open(const std::string& sourcePath)
+{
+	levels.clear();
+
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime;
+	if (!GetFileStamp(sourcePath, sourceSize, sourceModifiedTime)) return false;
+	if (!file.open(CookedTexturePath(sourcePath))) return false;
+
+	if (file.size() < sizeof(CookedTextureHeader)) { file.close(); return false; }
+	const CookedTextureHeader* header = reinterpret_cast<const CookedTextureHeader*>(file.data());
+	if (std::memcmp(header->magic, COOKED_TEXTURE_MAGIC, sizeof(COOKED_TEXTURE_MAGIC)) != 0 ||
+		header->version != COOKED_TEXTURE_VERSION ||
+		header->sourceSize != sourceSize || header->sourceModifiedTime != sourceModifiedTime ||
+		header->levelCount == 0 || header->channels == 0 || header->channels > 4)
+	{
+		file.close(); return false;
+	}
+
+	size_t tableEnd = sizeof(CookedTextureHeader) + sizeof(CookedLevelRecord) * size_t(header->levelCount);
+	if (tableEnd > file.size()) { file.close(); return false; }
+
+	width = header->width;
+	height = header->height;
+	channels = header->channels;
+
+	const CookedLevelRecord* records = reinterpret_cast<const CookedLevelRecord*>(file.data() + sizeof(CookedTextureHeader));
+	levels.resize(header->levelCount);
+	for (uint32_t i = 0; i < header->levelCount; i++)
+	{
+		const CookedLevelRecord& record = records[i];
+		if (record.offset > file.size() || record.size > file.size() - record.offset ||
+			record.size != uint64_t(record.width) * record.height * channels)
+		{
+			levels.clear(); file.close(); return false;
+		}
+		levels[i].width = record.width;
+		levels[i].height = record.height;
+		levels[i].pixels = file.data() + record.offset;
+		levels[i].size = static_cast<size_t>(record.size);
+	}
+	return true;
+}
+
+size_t CookedTexture::byteSize() const
+{
+	size_t total = 0;
+	for (const CookedMipLevel& level : levels)
+		total += level.size;
+	return total;
+}
+
+/// <summary>
+/// Offline cook step: decode an image and write it out together with its full mip chain. The mips are box filtered in
+/// linear space (sRGB decoded first), with the filtering and conversions spread over the shared ThreadPool.
+/// The image is decoded flipped, the same way the demo loads its textures.
+/// </summary>
+/// <param name="sourcePath"> path of the png/ jpg to cook. </param>
+/// <returns> true if the cooked texture was written. </returns>
+bool CookTexture(const std::string& sourcePath)
+{
+	CookedTextureHeader header = {};
+	std::memcpy(header.magic, COOKED_TEXTURE_MAGIC, sizeof(COOKED_TEXTURE_MAGIC));
+	header.version = COOKED_TEXTURE_VERSION;
+	if (!GetFileStamp(sourcePath, header.sourceSize, header.sourceModifiedTime))
+	{
+		std::cerr << "ERROR: Texture to cook not found: " << sourcePath << std::endl;
+		return false;
+	}
+
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load_thread(1);
+	unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, 0);
+	if (!pixels)
+	{
+		std::cerr << "ERROR: Texture failed to decode for cooking: " << sourcePath << std::endl;
+		return false;
+	}
+
+	std::vector<std::vector<unsigned char>> levelData(1, std::vector<unsigned char>(pixels, pixels + size_t(width) * height * channels));
+	LinearImage current, next;
+	DecodeToLinear(pixels, width, height, channels, current);
+	stbi_image_free(pixels);
+
+	while (current.width > 1 || current.height > 1)
+	{
+		Downsample(current, next);
+		levelData.emplace_back();
+		EncodeFromLinear(next, channels, levelData.back());
+		std::swap(current, next);
+	}
+
+	header.width = width;
+	header.height = height;
+	header.channels = channels;
+	header.levelCount = static_cast<uint32_t>(levelData.size());
+
+	std::vector<CookedLevelRecord> records(levelData.size());
+	size_t offset = AlignUp(sizeof(CookedTextureHeader) + sizeof(CookedLevelRecord) * records.size());
+	int levelWidth = width, levelHeight = height;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		records[i].width = levelWidth;
+		records[i].height = levelHeight;
+		records[i].offset = offset;
+		records[i].size = levelData[i].size();
+		offset = AlignUp(offset + levelData[i].size());
+		levelWidth = std::max(1, levelWidth / 2);
+		levelHeight = std::max(1, levelHeight / 2);
+	}
+
+	std::vector<char> buffer(offset, 0);
+	std::memcpy(buffer.data(), &header, sizeof(header));
+	std::memcpy(buffer.data() + sizeof(header), records.data(), sizeof(CookedLevelRecord) * records.size());
+	for (size_t i = 0; i < records.size(); i++)
+		std::memcpy(buffer.data() + records[i].offset, levelData[i].data(), levelData[i].size());
+
+	std::string cookedPath = CookedTexturePath(sourcePath);
+	std::string tempPath = cookedPath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out) return false;
+		out.write(buffer.data(), buffer.size());
+		if (!out) { out.close(); std::remove(tempPath.c_str()); return false; }
+	}
+	std::remove(cookedPath.c_str()); // rename() does not overwrite on Windows
+	if (std::rename(tempPath.c_str(), cookedPath.c_str()) != 0) return false;
+
+	std::cout << "DEBUG LOG: COOKED " << sourcePath << " (" << width << "x" << height << ", " << records.size() << " mip levels)" << std::endl;
+	return true;
+}
+
+/// <summary>
+/// Allocate immutable storage for all mip levels and upload them as they are, no glGenerateMipmap needed. GL thread only.
+/// </summary>
+void UploadCookedTexture(unsigned int textureID, const CookedTexture& texture)
+{
+	GLenum format = FormatForChannels(texture.channels);
+
+	GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+	glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(texture.levels.size()), InternalFormatForChannels(texture.channels), texture.width, texture.height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t i = 0; i < texture.levels.size(); i++)
+	{
+		const CookedMipLevel& level = texture.levels[i];
+		glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0, 0, level.width, level.height, format, GL_UNSIGNED_BYTE, level.pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+/// <summary>
+/// Respecify a mutable texture with the cooked levels from firstLevel down to 1x1, so level firstLevel of the source
+/// becomes the texture's level 0. Used by texture streaming to grow or shrink a texture in place: the texture ID stays
+/// the same and the memory of the dropped levels is released. GL thread only.
+/// </summary>
+/// <returns> bytes uploaded. </returns>
+size_t UploadCookedLevels(unsigned int textureID, const CookedTexture& texture, size_t firstLevel)
+{
+	GLenum format = FormatForChannels(texture.channels);
+	GLenum internalFormat = InternalFormatForChannels(texture.channels);
+
+	GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t uploaded = 0;
+	for (size_t i = firstLevel; i < texture.levels.size(); i++)
+	{
+		const CookedMipLevel& level = texture.levels[i];
+		glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i - firstLevel), internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, level.pixels);
+		uploaded += level.size;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels.size() - firstLevel - 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return uploaded;
+}
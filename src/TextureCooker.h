@@ -0,0 +1,42 @@
+#ifndef TEXTURECOOKER_H
+#define TEXTURECOOKER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+struct CookedMipLevel
+{
+	int width;
+	int height;
+	const unsigned char* pixels;
+	size_t size;
+};
+
+/// <summary>
+/// A cooked texture ("brick.png.ctex" next to "brick.png"): the decoded image together with its whole mip chain,
+/// filtered offline so loading it is just a memory mapping and one upload per level. Pixel pointers point into the
+/// mapping and stay valid as long as the CookedTexture is alive.
+/// </summary>
+class CookedTexture
+{
+public:
+	int width;
+	int height;
+	int channels;
+	std::vector<CookedMipLevel> levels;
+
+	bool open(const std::string& sourcePath);
+	size_t byteSize() const;
+
+private:
+	MappedFile file;
+};
+
+std::string CookedTexturePath(const std::string& sourcePath);
+bool CookTexture(const std::string& sourcePath);
+void UploadCookedTexture(unsigned int textureID, const CookedTexture& texture);
+size_t UploadCookedLevels(unsigned int textureID, const CookedTexture& texture, size_t firstLevel);
+
+#endif
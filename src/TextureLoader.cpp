@@ -0,0 +1,213 @@
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "AssetPack.h"
+#include "GLStateCache.h"
+#include "stb_image.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace
+{
+	// Neutral grey, so untextured frames don't flash white or black while the real image is decoding
+	const unsigned char PLACEHOLDER_PIXEL[4] = { 128, 128, 128, 255 };
+
+	GLenum FormatForChannels(int channels)
+	{
+		if (channels == 1) return GL_RED;
+		if (channels == 2) return GL_RG;
+		if (channels == 3) return GL_RGB;
+		return GL_RGBA;
+	}
+
+	void SetSamplerParameters()
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+}
+
+TextureLoader& TextureLoader::instance()
+{
+	static TextureLoader loader;
+	return loader;
+}
+
+TextureLoader::TextureLoader()
+	: queue(std::make_shared<DecodeQueue>()), nextTicket(1), nextUploadBuffer(0)
+{
+	uploadBuffers[0] = uploadBuffers[1] = 0;
+	uploadBufferSizes[0] = uploadBufferSizes[1] = 0;
+}
+
+TextureLoader::~TextureLoader()
+{
+	// The GL context is usually gone by now, so only free the decoded images that never got uploaded
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	for (DecodedImage& image : queue->ready)
+		if (image.pixels) stbi_image_free(image.pixels);
+	queue->ready.clear();
+}
+
+/// <summary>
+/// Create a texture showing a 1x1 placeholder and queue the image at the given path for decoding. GL thread only.
+/// </summary>
+/// <param name="path"> full path of the image file. </param>
+/// <returns> the texture ID, which keeps pointing at the same texture once the real image is uploaded. </returns>
+unsigned int TextureLoader::load(const std::string& path)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_PIXEL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->inFlight++;
+	}
+
+	unsigned long long ticket = nextTicket++;
+	idsByTicket[ticket] = textureID;
+	ticketsById[textureID] = ticket;
+
+	std::shared_ptr<DecodeQueue> decodeQueue = queue;
+	ThreadPool::shared().submit([decodeQueue, ticket, path]()
+	{
+		TRACE_SCOPE("texture decode", path);
+		DecodedImage image;
+		image.ticket = ticket;
+		image.path = path;
+		image.pixels = nullptr;
+
+		std::shared_ptr<CookedTexture> cooked = std::make_shared<CookedTexture>();
+		if (cooked->open(path)) image.cooked = cooked;
+		else image.pixels = LoadImageAsset(path, &image.width, &image.height, &image.channels);
+
+		std::lock_guard<std::mutex> lock(decodeQueue->mutex);
+		decodeQueue->inFlight--;
+		if (image.pixels || image.cooked) decodeQueue->ready.push_back(image);
+		else std::cerr << "Texture failed to load at path: " << path << std::endl;
+		decodeQueue->condition.notify_all();
+	});
+
+	return textureID;
+}
+
+/// <summary>
+/// Upload decoded images until the byte budget for this frame is used up. At least one image is uploaded per call,
+/// so a single texture larger than the budget can't stall the queue. GL thread only, call once per frame.
+/// </summary>
+/// <param name="byteBudget"> maximum number of pixel bytes to upload this frame. </param>
+void TextureLoader::processUploads(size_t byteBudget)
+{
+	size_t uploadedBytes = 0;
+	while (true)
+	{
+		DecodedImage image;
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			if (queue->ready.empty()) return;
+
+			const DecodedImage& next = queue->ready.front();
+			size_t bytes = next.cooked ? next.cooked->byteSize() : size_t(next.width) * next.height * next.channels;
+			if (uploadedBytes > 0 && uploadedBytes + bytes > byteBudget) return;
+
+			image = next;
+			queue->ready.pop_front();
+			uploadedBytes += bytes;
+		}
+		auto pending = idsByTicket.find(image.ticket);
+		if (pending != idsByTicket.end()) // not released while it was decoding
+		{
+			unsigned int textureID = pending->second;
+			idsByTicket.erase(pending);
+			ticketsById.erase(textureID);
+			TRACE_SCOPE("texture upload", image.path);
+			if (image.cooked) UploadCookedTexture(textureID, *image.cooked);
+			else upload(textureID, image);
+		}
+		if (image.pixels) stbi_image_free(image.pixels);
+	}
+}
+
+/// <summary>
+/// Block until every queued texture has been decoded and uploaded. GL thread only.
+/// </summary>
+void TextureLoader::finishAll()
+{
+	while (true)
+	{
+		processUploads(SIZE_MAX);
+
+		std::unique_lock<std::mutex> lock(queue->mutex);
+		if (queue->inFlight == 0 && queue->ready.empty()) return;
+		queue->condition.wait(lock, [this]() { return !queue->ready.empty() || queue->inFlight == 0; });
+	}
+}
+
+/// <summary>
+/// Forget the pending decode of a texture that is about to be deleted. Its image is dropped once decoded, so it can't
+/// end up in a texture that gets the same ID later. GL thread only.
+/// </summary>
+void TextureLoader::release(unsigned int textureID)
+{
+	auto found = ticketsById.find(textureID);
+	if (found == ticketsById.end()) return;
+	idsByTicket.erase(found->second);
+	ticketsById.erase(found);
+}
+
+size_t TextureLoader::pendingCount() const
+{
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	return queue->inFlight + queue->ready.size();
+}
+
+/// <summary>
+/// Copy a decoded image into one of two alternating pixel buffer objects and update the texture from it, so the
+/// driver can copy out of the buffer asynchronously instead of blocking on client memory.
+/// </summary>
+void TextureLoader::upload(unsigned int textureID, const DecodedImage& image)
+{
+	size_t size = size_t(image.width) * image.height * image.channels;
+	unsigned int& buffer = uploadBuffers[nextUploadBuffer];
+	size_t& bufferSize = uploadBufferSizes[nextUploadBuffer];
+	nextUploadBuffer = (nextUploadBuffer + 1) % 2;
+
+	if (buffer == 0) glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	if (size > bufferSize)
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		bufferSize = size;
+	}
+
+	// If the buffer can't be mapped, upload straight from client memory instead
+	const void* source = image.pixels;
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped)
+	{
+		std::memcpy(mapped, image.pixels, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		source = (void*)0; // offset into the bound pixel buffer
+	}
+	else glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	GLenum format = FormatForChannels(image.channels);
+	GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 1 and 3 channel images are not 4 byte aligned
+	glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glGenerateMipmap(GL_TEXTURE_2D);
+	SetSamplerParameters();
+}
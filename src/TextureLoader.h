@@ -0,0 +1,63 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "TextureCooker.h"
+
+/// <summary>
+/// Asynchronous texture loading. Images are decoded by stb_image on the shared ThreadPool, and the finished images are
+/// uploaded on the GL thread through pixel buffer objects, under a byte budget per frame. Each texture is created
+/// immediately with a 1x1 placeholder image, so the returned texture ID can be bound right away.
+/// Textures that have been cooked (see TextureCooker) skip decoding and upload their precomputed mip chain instead.
+/// </summary>
+class TextureLoader
+{
+public:
+	static TextureLoader& instance();
+	~TextureLoader();
+
+	unsigned int load(const std::string& path);
+	void processUploads(size_t byteBudget);
+	void finishAll();
+	void release(unsigned int textureID);
+	size_t pendingCount() const;
+
+private:
+	struct DecodedImage
+	{
+		unsigned long long ticket; // tells the image apart from one for a recycled texture ID
+		std::string path;
+		unsigned char* pixels;
+		int width, height, channels;
+		std::shared_ptr<CookedTexture> cooked; // set instead of pixels when a cooked texture with mips exists
+	};
+
+	// Shared with the decode jobs, which can still be running when the loader itself goes away
+	struct DecodeQueue
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<DecodedImage> ready;
+		size_t inFlight = 0;
+	};
+
+	std::shared_ptr<DecodeQueue> queue;
+	std::unordered_map<unsigned long long, unsigned int> idsByTicket; // decodes still to be uploaded
+	std::unordered_map<unsigned int, unsigned long long> ticketsById;
+	unsigned long long nextTicket;
+	unsigned int uploadBuffers[2];
+	size_t uploadBufferSizes[2];
+	unsigned int nextUploadBuffer;
+
+	TextureLoader();
+	void upload(unsigned int textureID, const DecodedImage& image);
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "TextureStreamer.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "GLStateCache.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace
+{
+	// Same neutral grey as the TextureLoader placeholder
+	const unsigned char PLACEHOLDER_PIXEL[4] = { 128, 128, 128, 255 };
+}
+
+TextureStreamer& TextureStreamer::instance()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+TextureStreamer::TextureStreamer()
+	: queue(std::make_shared<OpenQueue>()), budgetBytes(TEXTURE_STREAMING_DEFAULT_BUDGET), totalResidentBytes(0), frame(0), nextTicket(0)
+{
+}
+
+/// <summary>
+/// Create a texture showing a 1x1 placeholder and open its cooked mip chain on a worker, cooking the image first if
+/// there is no up to date .ctex yet. The low mips are uploaded by the next update() after that.
+/// </summary>
+/// <param name="path"> full path of the image file. </param>
+/// <returns> the texture ID, which stays valid as mips are streamed in and out. </returns>
+unsigned int TextureStreamer::load(const std::string& path)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	GLStateCache::instance().bindTexture(0, GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_PIXEL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	StreamedTexture texture = {};
+	texture.id = textureID;
+	texture.ticket = nextTicket++;
+	texture.path = path;
+	texture.lastUsedFrame = frame;
+	textures[textureID] = texture;
+	idsByTicket[texture.ticket] = textureID;
+
+	std::shared_ptr<OpenQueue> openQueue = queue;
+	unsigned long long ticket = texture.ticket;
+	ThreadPool::shared().submit([openQueue, ticket, path]()
+	{
+		TRACE_SCOPE("texture stream open", path);
+		std::shared_ptr<CookedTexture> cooked = std::make_shared<CookedTexture>();
+		if (!cooked->open(path) && !(CookTexture(path) && cooked->open(path))) cooked.reset();
+
+		std::lock_guard<std::mutex> lock(openQueue->mutex);
+		openQueue->ready.emplace_back(ticket, cooked);
+	});
+
+	return textureID;
+}
+
+/// <summary>
+/// Forget a texture that is about to be deleted, returning its share of the budget.
+/// </summary>
+void TextureStreamer::release(unsigned int textureID)
+{
+	auto found = textures.find(textureID);
+	if (found == textures.end()) return;
+	totalResidentBytes -= found->second.residentBytes;
+	idsByTicket.erase(found->second.ticket);
+	textures.erase(found);
+}
+
+/// <summary>
+/// Called for every draw that uses a streamed texture. The highest request of a frame decides which mip the texture
+/// should have on the GPU; non streamed texture IDs are ignored.
+/// </summary>
+/// <param name="textureID"></param>
+/// <param name="pixelsPerUv"> screen pixels spanned by one unit of texture coordinates (1 = the whole texture). </param>
+void TextureStreamer::requestDetail(unsigned int textureID, float pixelsPerUv)
+{
+	auto found = textures.find(textureID);
+	if (found == textures.end()) return;
+
+	StreamedTexture& texture = found->second;
+	if (texture.lastUsedFrame != frame)
+	{
+		texture.lastUsedFrame = frame;
+		texture.wantedDetail = pixelsPerUv;
+	}
+	else texture.wantedDetail = std::max(texture.wantedDetail, pixelsPerUv);
+}
+
+/// <summary>
+/// Once per frame, before drawing: give newly opened textures their low mips, then stream in the mips the last frame
+/// asked for, largest shortfall first, evicting least recently used mips to stay within the GPU memory budget.
+/// </summary>
+/// <param name="uploadBudget"> bytes that may be uploaded this frame (at least one texture is always updated). </param>
+void TextureStreamer::update(size_t uploadBudget)
+{
+	size_t uploaded = 0;
+
+	// 1. Low mips for textures the workers have finished opening
+	std::deque<std::pair<unsigned long long, std::shared_ptr<CookedTexture>>> opened;
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		opened.swap(queue->ready);
+	}
+	for (auto& result : opened)
+	{
+		auto ticket = idsByTicket.find(result.first);
+		if (ticket == idsByTicket.end()) continue; // released while it was opening
+		StreamedTexture& texture = textures[ticket->second];
+		if (!result.second)
+		{
+			std::cerr << "Texture failed to load at path: " << texture.path << std::endl;
+			release(texture.id); // keeps its placeholder
+			continue;
+		}
+
+		texture.cooked = result.second;
+		const std::vector<CookedMipLevel>& levels = texture.cooked->levels;
+		texture.minimumLevel = levels.size() - 1;
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			if (std::max(levels[i].width, levels[i].height) > TEXTURE_STREAMING_INITIAL_SIZE) continue;
+			texture.minimumLevel = i;
+			break;
+		}
+		makeRoom(chainBytes(*texture.cooked, texture.minimumLevel), texture.id); // the low mips are loaded regardless
+		uploaded += setResidentLevel(texture, texture.minimumLevel);
+	}
+
+	// 2. Higher mips for the textures drawn last frame that are showing less detail than they need
+	std::vector<StreamedTexture*> wanting;
+	for (auto& entry : textures)
+	{
+		StreamedTexture& texture = entry.second;
+		if (texture.cooked && texture.lastUsedFrame == frame && wantedLevel(texture) < texture.residentLevel)
+			wanting.push_back(&texture);
+	}
+	std::sort(wanting.begin(), wanting.end(), [this](const StreamedTexture* a, const StreamedTexture* b)
+	{
+		return a->residentLevel - wantedLevel(*a) > b->residentLevel - wantedLevel(*b);
+	});
+
+	for (StreamedTexture* texture : wanting)
+	{
+		if (uploaded > 0 && uploaded >= uploadBudget) break;
+
+		// Settle for a coarser level if the wanted one does not fit even after evicting
+		size_t level = wantedLevel(*texture);
+		while (level < texture->residentLevel && !makeRoom(chainBytes(*texture->cooked, level) - texture->residentBytes, texture->id))
+			level++;
+		if (level < texture->residentLevel) uploaded += setResidentLevel(*texture, level);
+	}
+
+	frame++;
+}
+
+/// <summary>
+/// Finest mip level worth having for the detail requested: the level whose texels are about the size of a pixel.
+/// </summary>
+size_t TextureStreamer::wantedLevel(const StreamedTexture& texture) const
+{
+	if (texture.wantedDetail <= 0.0f) return texture.minimumLevel;
+	const CookedMipLevel& top = texture.cooked->levels[0];
+	float texelsPerPixel = float(std::max(top.width, top.height)) / texture.wantedDetail;
+	if (texelsPerPixel <= 1.0f) return 0;
+	size_t level = static_cast<size_t>(std::floor(std::log2(texelsPerPixel)));
+	return std::min(level, texture.minimumLevel);
+}
+
+/// <summary>
+/// Respecify the texture so its finest mip is the given cooked level, and keep the budget accounting in step.
+/// </summary>
+/// <returns> bytes uploaded. </returns>
+size_t TextureStreamer::setResidentLevel(StreamedTexture& texture, size_t level)
+{
+	TRACE_SCOPE("texture stream level", texture.path);
+	size_t bytes = UploadCookedLevels(texture.id, *texture.cooked, level);
+	totalResidentBytes = totalResidentBytes - texture.residentBytes + bytes;
+	texture.residentBytes = bytes;
+	texture.residentLevel = level;
+	return bytes;
+}
+
+/// <summary>
+/// Evict mips until the given number of extra bytes fits into the budget. The victim is always the least recently used
+/// texture that still has more than its low mips (textures drawn last frame only give up mips finer than they need);
+/// it drops its top mip, which frees about three quarters of its memory.
+/// </summary>
+/// <param name="bytes"> extra bytes about to be uploaded. </param>
+/// <param name="keepID"> texture the room is made for, never evicted. </param>
+/// <returns> false if the budget cannot be met. </returns>
+bool TextureStreamer::makeRoom(size_t bytes, unsigned int keepID)
+{
+	if (totalResidentBytes + bytes <= budgetBytes) return true;
+
+	// Do not evict anything for a request that cannot be met anyway
+	size_t evictable = 0;
+	for (auto& entry : textures)
+	{
+		const StreamedTexture& texture = entry.second;
+		if (texture.id != keepID && texture.cooked)
+			evictable += texture.residentBytes - chainBytes(*texture.cooked, evictionLimit(texture));
+	}
+	if (totalResidentBytes - evictable + bytes > budgetBytes) return false;
+
+	while (totalResidentBytes + bytes > budgetBytes)
+	{
+		StreamedTexture* victim = nullptr;
+		for (auto& entry : textures)
+		{
+			StreamedTexture& texture = entry.second;
+			if (texture.id == keepID || !texture.cooked || texture.residentLevel >= evictionLimit(texture)) continue;
+			if (!victim || texture.lastUsedFrame < victim->lastUsedFrame) victim = &texture;
+		}
+		if (!victim) return false;
+		setResidentLevel(*victim, victim->residentLevel + 1);
+	}
+	return true;
+}
+
+/// <summary>
+/// Coarsest level eviction may take a texture to: its low mips, or the level it needs if it was drawn last frame.
+/// </summary>
+size_t TextureStreamer::evictionLimit(const StreamedTexture& texture) const
+{
+	if (texture.lastUsedFrame == frame) return std::max(texture.residentLevel, wantedLevel(texture));
+	return texture.minimumLevel;
+}
+
+size_t TextureStreamer::chainBytes(const CookedTexture& cooked, size_t firstLevel)
+{
+	size_t total = 0;
+	for (size_t i = firstLevel; i < cooked.levels.size(); i++)
+		total += cooked.levels[i].size;
+	return total;
+}
@@ -0,0 +1,80 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "TextureCooker.h"
+
+// GPU memory streamed textures may use together, unless changed with setBudget()
+const size_t TEXTURE_STREAMING_DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+// Largest side of the low mips a texture starts with. These are never evicted.
+const int TEXTURE_STREAMING_INITIAL_SIZE = 64;
+
+/// <summary>
+/// Mip-level texture streaming. A streamed texture starts with its low mips only; higher mips are uploaded once
+/// draws request more detail (see requestDetail), and when the resident mips of all streamed textures would exceed
+/// the GPU memory budget, the least recently used textures drop their top mips first. Mips come from cooked textures
+/// (see TextureCooker), which are cooked on a worker the first time an image is streamed. Growing or shrinking a
+/// texture respecifies it in place, so its ID never changes. GL thread only.
+/// </summary>
+class TextureStreamer
+{
+public:
+	static TextureStreamer& instance();
+
+	unsigned int load(const std::string& path);
+	void release(unsigned int textureID);
+
+	// Screen pixels covered by one unit of texture coordinates where the texture is drawn this frame
+	void requestDetail(unsigned int textureID, float pixelsPerUv);
+	void update(size_t uploadBudget);
+
+	void setBudget(size_t bytes) { budgetBytes = bytes; }
+	size_t budget() const { return budgetBytes; }
+	size_t residentBytes() const { return totalResidentBytes; }
+	size_t textureCount() const { return textures.size(); }
+	bool active() const { return !textures.empty(); }
+
+private:
+	struct StreamedTexture
+	{
+		unsigned int id;
+		unsigned long long ticket;             // tells the open result apart from one for a recycled texture ID
+		std::string path;
+		std::shared_ptr<CookedTexture> cooked; // nullptr until the worker has opened (or cooked) it
+		size_t residentLevel;                  // finest cooked level on the GPU
+		size_t minimumLevel;                   // coarsest level kept resident, the initial low mips
+		float wantedDetail;                    // highest pixelsPerUv requested in lastUsedFrame
+		unsigned long long lastUsedFrame;
+		size_t residentBytes;
+	};
+
+	// Shared with the open jobs, which can still be running when a texture is released
+	struct OpenQueue
+	{
+		std::mutex mutex;
+		std::deque<std::pair<unsigned long long, std::shared_ptr<CookedTexture>>> ready; // by ticket, nullptr if it failed
+	};
+
+	std::unordered_map<unsigned int, StreamedTexture> textures;
+	std::unordered_map<unsigned long long, unsigned int> idsByTicket;
+	std::shared_ptr<OpenQueue> queue;
+	size_t budgetBytes;
+	size_t totalResidentBytes;
+	unsigned long long frame;
+	unsigned long long nextTicket;
+
+	TextureStreamer();
+	size_t wantedLevel(const StreamedTexture& texture) const;
+	size_t setResidentLevel(StreamedTexture& texture, size_t level);
+	bool makeRoom(size_t bytes, unsigned int keepID);
+	size_t evictionLimit(const StreamedTexture& texture) const;
+	static size_t chainBytes(const CookedTexture& cooked, size_t firstLevel);
+};
+
+#endif
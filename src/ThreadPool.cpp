@@ -0,0 +1,105 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+	: stopping(false)
+{
+	if (threadCount == 0) threadCount = 1;
+	workers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back([this]() { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool(std::thread::hardware_concurrency());
+	return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		jobs.push(std::move(job));
+	}
+	queueCondition.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
+
+/// <summary>
+/// Run body(i) for every i in [0, count) across the pool and wait for all of them to finish.
+/// The calling thread works through the range as well, so this is safe to call from inside a job.
+/// </summary>
+/// <param name="count"></param>
+/// <param name="body"></param>
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+	if (count == 0) return;
+	if (count == 1) { body(0); return; }
+
+	// Shared with the helper jobs, which may only get to run after this call has already returned
+	struct ForState
+	{
+		std::function<void(size_t)> body;
+		size_t count;
+		std::atomic<size_t> next;
+		std::atomic<size_t> done;
+		std::mutex doneMutex;
+		std::condition_variable doneCondition;
+	};
+	auto state = std::make_shared<ForState>();
+	state->body = body;
+	state->count = count;
+	state->next = 0;
+	state->done = 0;
+
+	auto work = [state]()
+	{
+		size_t i;
+		while ((i = state->next.fetch_add(1)) < state->count)
+		{
+			state->body(i);
+			if (state->done.fetch_add(1) + 1 == state->count)
+			{
+				std::lock_guard<std::mutex> lock(state->doneMutex);
+				state->doneCondition.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(count - 1, workers.size());
+	for (size_t i = 0; i < helpers; i++)
+		enqueue(work);
+	work();
+
+	std::unique_lock<std::mutex> lock(state->doneMutex);
+	state->doneCondition.wait(lock, [&state]() { return state->done.load() == state->count; });
+}
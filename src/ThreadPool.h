@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Fixed-size pool of worker threads used for CPU-side loading work (parsing, mesh processing, image decoding).
+/// None of the workers own an OpenGL context, so jobs must never issue GL calls.
+/// </summary>
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int threadCount);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Process-wide pool sized to the number of hardware threads
+	static ThreadPool& shared();
+
+	unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+	template <class F>
+	std::future<typename std::result_of<F()>::type> submit(F&& job)
+	{
+		typedef typename std::result_of<F()>::type Result;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> result = task->get_future();
+		enqueue([task]() { (*task)(); });
+		return result;
+	}
+
+	void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping;
+
+	void enqueue(std::function<void()> job);
+	void workerLoop();
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct TraceEvent
+	{
+		const char* name;
+		std::string detail;
+		long long startUs;
+		long long durationUs; // -1 for an instant event
+		unsigned int thread;
+	};
+
+	struct TraceState
+	{
+		std::atomic<bool> enabled{ false };
+		std::chrono::steady_clock::time_point origin;
+		std::mutex mutex;
+		std::vector<TraceEvent> events;
+		std::vector<std::string> threadNames; // indexed by trace thread id
+	};
+
+	TraceState& State()
+	{
+		static TraceState state;
+		return state;
+	}
+
+	long long NowUs()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - State().origin).count();
+	}
+
+	/// <summary>
+	/// Small, stable id of the calling thread, assigned the first time it records an event. The thread that started
+	/// tracing is 0.
+	/// </summary>
+	unsigned int ThreadIndex()
+	{
+		static thread_local unsigned int index = ~0u;
+		if (index == ~0u)
+		{
+			TraceState& state = State();
+			std::lock_guard<std::mutex> lock(state.mutex);
+			index = static_cast<unsigned int>(state.threadNames.size());
+			state.threadNames.push_back(index == 0 ? "main" : "worker " + std::to_string(index));
+		}
+		return index;
+	}
+
+	void Record(const char* name, const std::string& detail, long long startUs, long long durationUs)
+	{
+		unsigned int thread = ThreadIndex();
+		TraceState& state = State();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (!state.enabled) return;
+		TraceEvent event = { name, detail, startUs, durationUs, thread };
+		state.events.push_back(std::move(event));
+	}
+
+	// JSON string escaping, asset paths contain backslashes
+	void WriteJsonString(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\') out << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out << escaped;
+			}
+			else out << c;
+		}
+		out << '"';
+	}
+}
+
+TraceScope::TraceScope(const char* name)
+	: name(name), startUs(-1)
+{
+	if (!State().enabled.load(std::memory_order_relaxed)) return;
+	startUs = NowUs();
+}
+
+TraceScope::TraceScope(const char* name, const char* detail)
+	: name(name), startUs(-1)
+{
+	if (!State().enabled.load(std::memory_order_relaxed)) return;
+	if (detail) this->detail = detail;
+	startUs = NowUs();
+}
+
+TraceScope::TraceScope(const char* name, const std::string& detail)
+	: name(name), startUs(-1)
+{
+	if (!State().enabled.load(std::memory_order_relaxed)) return;
+	this->detail = detail;
+	startUs = NowUs();
+}
+
+TraceScope::~TraceScope()
+{
+	if (startUs >= 0) Record(name, detail, startUs, NowUs() - startUs);
+}
+
+/// <summary>
+/// Start recording. Call this as early as possible on the main thread, the trace's time 0 is this call.
+/// </summary>
+void BeginTrace()
+{
+	TraceState& state = State();
+	state.origin = std::chrono::steady_clock::now();
+	ThreadIndex(); // the calling thread becomes "main"
+	state.enabled = true;
+}
+
+bool TraceEnabled()
+{
+	return State().enabled.load(std::memory_order_relaxed);
+}
+
+void TraceInstant(const char* name, const std::string& detail)
+{
+	if (TraceEnabled()) Record(name, detail, NowUs(), -1);
+}
+
+/// <summary>
+/// Stop recording and write everything recorded so far as a Chrome trace-event JSON file.
+/// </summary>
+/// <param name="path"> output file, e.g. "startup_trace.json". </param>
+/// <returns> false if the file could not be written. </returns>
+bool WriteTrace(const std::string& path)
+{
+	TraceState& state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.enabled = false;
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "ERROR::TRACE::Could not write " << path << std::endl;
+		return false;
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	const char* separator = "\n";
+	for (size_t i = 0; i < state.threadNames.size(); i++)
+	{
+		out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":";
+		WriteJsonString(out, state.threadNames[i]);
+		out << "}}";
+		separator = ",\n";
+	}
+	for (const TraceEvent& event : state.events)
+	{
+		out << separator << "{\"name\":";
+		WriteJsonString(out, event.name);
+		out << ",\"cat\":\"startup\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.startUs;
+		if (event.durationUs >= 0) out << ",\"ph\":\"X\",\"dur\":" << event.durationUs;
+		else out << ",\"ph\":\"i\",\"s\":\"g\"";
+		if (!event.detail.empty())
+		{
+			out << ",\"args\":{\"detail\":";
+			WriteJsonString(out, event.detail);
+			out << "}";
+		}
+		out << "}";
+		separator = ",\n";
+	}
+	out << "\n]}\n";
+
+	std::cout << "DEBUG LOG: TRACE WRITTEN TO " << path << " (" << state.events.size() << " events)" << std::endl;
+	state.events.clear();
+	return true;
+}
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+/// <summary>
+/// Startup tracer. Once BeginTrace() has been called, every TRACE_SCOPE records a complete event (name, optional detail
+/// such as an asset path, start, duration and the recording thread), and WriteTrace() saves them in the Chrome
+/// trace-event JSON format (open in chrome://tracing or ui.perfetto.dev). Worker threads show up as separate tracks.
+/// Before BeginTrace() a scope costs one flag check: details passed as a C string or an existing std::string are only
+/// copied once tracing is on.
+/// </summary>
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name);
+	TraceScope(const char* name, const char* detail);
+	TraceScope(const char* name, const std::string& detail);
+	~TraceScope();
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name;
+	std::string detail;
+	long long startUs; // -1 while tracing is off
+};
+
+void BeginTrace();
+bool TraceEnabled();
+void TraceInstant(const char* name, const std::string& detail = std::string()); // zero length marker, e.g. "first frame"
+bool WriteTrace(const std::string& path); // stops recording
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,61 @@
+#include "UniformBuffers.h"
+
+#include <glad/glad.h>
+#include "GLStateCache.h"
+
+/// <summary>
+/// Allocate the buffer with its initial contents and bind it to its binding point.
+/// </summary>
+/// <param name="data"> initial contents, or nullptr to leave them undefined until update(). </param>
+void UniformBuffer::create(unsigned int binding, size_t size, const void* data)
+{
+	this->binding = binding;
+	this->size = size;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, data, data ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	bind();
+}
+
+/// <summary>
+/// Replace the whole block.
+/// </summary>
+void UniformBuffer::update(const void* data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind() const
+{
+	GLStateCache::instance().bindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+}
+
+void UniformBuffer::release()
+{
+	if (!buffer) return;
+	GLStateCache::instance().bufferDeleted(buffer);
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+SceneUniforms& SceneUniforms::instance()
+{
+	static SceneUniforms uniforms;
+	return uniforms;
+}
+
+void SceneUniforms::setCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos)
+{
+	CameraUniforms block = { view, projection, glm::vec4(cameraPos, 1.0f) };
+	if (!camera.created()) camera.create(CAMERA_UNIFORM_BINDING, sizeof(CameraUniforms), nullptr);
+	camera.update(&block);
+}
+
+void SceneUniforms::setLight(const LightUniforms& block)
+{
+	if (!light.created()) light.create(LIGHT_UNIFORM_BINDING, sizeof(LightUniforms), nullptr);
+	light.update(&block);
+}
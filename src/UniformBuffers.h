@@ -0,0 +1,69 @@
+#ifndef UNIFORMBUFFERS_H
+#define UNIFORMBUFFERS_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Binding points of the std140 uniform blocks declared by the scene shaders. Per-draw values (transforms and
+// materials) live in the DrawBatch record table instead.
+const unsigned int CAMERA_UNIFORM_BINDING = 0;
+const unsigned int LIGHT_UNIFORM_BINDING = 1;
+
+// The structs below mirror the blocks in the shaders member for member: std140 pads vec3 to 16 bytes, so vec3s are
+// stored as vec4.
+
+struct CameraUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 cameraPos;
+};
+
+struct LightUniforms
+{
+	glm::vec4 direction;
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+/// <summary>
+/// A GL buffer holding one std140 uniform block, bound to a fixed binding point. Copies share the buffer, whoever
+/// created it calls release().
+/// </summary>
+class UniformBuffer
+{
+public:
+	UniformBuffer() : buffer(0), binding(0), size(0) {}
+	void create(unsigned int binding, size_t size, const void* data);
+	void update(const void* data);
+	void bind() const;
+	void release();
+	bool created() const { return buffer != 0; }
+
+private:
+	unsigned int buffer;
+	unsigned int binding;
+	size_t size;
+};
+
+/// <summary>
+/// The uniform blocks shared by every draw of a frame, uploaded once per frame. The buffers stay bound to their
+/// binding points, so shaders pick them up without any per-draw calls. GL thread only.
+/// </summary>
+class SceneUniforms
+{
+public:
+	static SceneUniforms& instance();
+
+	void setCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
+	void setLight(const LightUniforms& light);
+
+private:
+	UniformBuffer camera;
+	UniformBuffer light;
+
+	SceneUniforms() {}
+};
+
+#endif
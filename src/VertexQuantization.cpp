@@ -0,0 +1,119 @@
+#include "VertexQuantization.h"
+
+#include <cfloat>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include "mesh.h"
+
+namespace
+{
+	const float UNORM16_MAX = 65535.0f;
+	const float SNORM16_MAX = 32767.0f;
+
+	uint16_t QuantizeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::floor(glm::clamp(value, 0.0f, 1.0f) * UNORM16_MAX + 0.5f));
+	}
+
+	int16_t QuantizeSnorm16(float value)
+	{
+		float scaled = glm::clamp(value, -1.0f, 1.0f) * SNORM16_MAX;
+		return static_cast<int16_t>(scaled >= 0.0f ? std::floor(scaled + 0.5f) : std::ceil(scaled - 0.5f));
+	}
+
+	// Same conversion the GL uses for normalized signed attributes (GL 4.2+)
+	float DecodeSnorm16(int16_t value)
+	{
+		return glm::max(value / SNORM16_MAX, -1.0f);
+	}
+
+	float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+}
+
+/// <summary>
+/// Quantization range of a mesh: its AABB. Flat axes get a scale of 1 so decoding never divides by zero.
+/// </summary>
+QuantizationParams ComputeQuantization(const Vertex* vertices, size_t vertexCount)
+{
+	glm::vec3 minBounds(FLT_MAX), maxBounds(-FLT_MAX);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		minBounds = glm::min(minBounds, vertices[i].Position);
+		maxBounds = glm::max(maxBounds, vertices[i].Position);
+	}
+
+	QuantizationParams params;
+	params.offset = vertexCount ? minBounds : glm::vec3(0.0f);
+	params.scale = vertexCount ? maxBounds - minBounds : glm::vec3(1.0f);
+	for (int axis = 0; axis < 3; axis++)
+		if (params.scale[axis] <= 0.0f) params.scale[axis] = 1.0f;
+	return params;
+}
+
+void QuantizeVertices(const Vertex* vertices, size_t vertexCount, const QuantizationParams& params, std::vector<QuantizedVertex>& out)
+{
+	out.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		QuantizedVertex& packed = out[i];
+
+		glm::vec3 normalized = (vertex.Position - params.offset) / params.scale;
+		for (int axis = 0; axis < 3; axis++) packed.position[axis] = QuantizeUnorm16(normalized[axis]);
+		packed.padding = 0;
+
+		glm::vec2 octahedral = OctEncode(vertex.Normal);
+		packed.normal[0] = QuantizeSnorm16(octahedral.x);
+		packed.normal[1] = QuantizeSnorm16(octahedral.y);
+
+		packed.texCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+		packed.texCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+	}
+}
+
+/// <summary>
+/// CPU version of the dequantization in vertexShader.VERT, for tools and for measuring the quantization error.
+/// </summary>
+void DecodeVertices(const QuantizedVertex* vertices, size_t vertexCount, const QuantizationParams& params, std::vector<Vertex>& out)
+{
+	out.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const QuantizedVertex& packed = vertices[i];
+		Vertex& vertex = out[i];
+
+		glm::vec3 normalized(packed.position[0], packed.position[1], packed.position[2]);
+		vertex.Position = params.offset + normalized / UNORM16_MAX * params.scale;
+		vertex.Normal = OctDecode(glm::vec2(DecodeSnorm16(packed.normal[0]), DecodeSnorm16(packed.normal[1])));
+		vertex.TexCoords = glm::vec2(glm::unpackHalf1x16(packed.texCoords[0]), glm::unpackHalf1x16(packed.texCoords[1]));
+	}
+}
+
+/// <summary>
+/// Project a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfold it into the [-1, 1] square.
+/// </summary>
+glm::vec2 OctEncode(glm::vec3 normal)
+{
+	float l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	if (l1 <= 0.0f) return glm::vec2(0.0f, 0.0f);
+	normal /= l1;
+
+	glm::vec2 encoded(normal.x, normal.y);
+	if (normal.z < 0.0f)
+	{
+		encoded = glm::vec2((1.0f - std::fabs(normal.y)) * SignNotZero(normal.x), (1.0f - std::fabs(normal.x)) * SignNotZero(normal.y));
+	}
+	return encoded;
+}
+
+glm::vec3 OctDecode(glm::vec2 encoded)
+{
+	glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+	float fold = glm::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize(normal);
+}
@@ -0,0 +1,39 @@
+#ifndef VERTEXQUANTIZATION_H
+#define VERTEXQUANTIZATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Vertex;
+
+/// <summary>
+/// Compact 16 byte vertex layout, half the size of Vertex:
+/// position as unorm16 relative to the mesh AABB, normal octahedral encoded as 2 x snorm16, texture coordinates as halfs.
+/// </summary>
+struct QuantizedVertex
+{
+	uint16_t position[3];
+	uint16_t padding;
+	int16_t normal[2];
+	uint16_t texCoords[2];
+};
+
+/// <summary>
+/// Maps the normalized [0, 1] quantized position back into object space: position = offset + normalized * scale.
+/// </summary>
+struct QuantizationParams
+{
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+
+QuantizationParams ComputeQuantization(const Vertex* vertices, size_t vertexCount);
+void QuantizeVertices(const Vertex* vertices, size_t vertexCount, const QuantizationParams& params, std::vector<QuantizedVertex>& out);
+void DecodeVertices(const QuantizedVertex* vertices, size_t vertexCount, const QuantizationParams& params, std::vector<Vertex>& out);
+
+glm::vec2 OctEncode(glm::vec3 normal);
+glm::vec3 OctDecode(glm::vec2 encoded);
+
+#endif
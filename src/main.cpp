@@ -1,6 +1,8 @@
 #include <iostream>
 #include <iomanip>
 #include <numeric>
+#include <cstring>
+#include <memory>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -9,14 +11,26 @@
 #include "stb_image.h"
 #include "Shader.h"
 #include "model.h"
+#include "ModelCache.h"
+#include "SceneLoader.h"
 #include "ParticleSystem.h"
+#include "Benchmarks.h"
+#include "DrawBatch.h"
+#include "GLStateCache.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "TextureCooker.h"
+#include "AssetPack.h"
+#include "Trace.h"
+#include "UniformBuffers.h"
 
 // ------------------------------------ Prototype Functions ------------------------------------
 int Init();
 void TrackFPS();
 void PrintFPSDiagnostic();
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(GLFWwindow* window, ModelInstance& target);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 // ---------------------------------------------------------------------------------------------
 
@@ -26,6 +40,17 @@ const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
 GLFWwindow* window = nullptr;
 
+// --- Streaming Settings
+const size_t TEXTURE_UPLOAD_BUDGET = 8 * 1024 * 1024; // Max texture bytes uploaded per frame, to avoid hitches
+const size_t TEXTURE_VRAM_BUDGET = 128 * 1024 * 1024; // Max GPU memory for streamed texture mips, least recently used mips are evicted beyond it
+const double MODEL_LOAD_BUDGET_MS = 2.0;              // Max time per frame spent on scene loading GL work (texture requests, mesh creation/ uploads)
+const char* ASSET_PACK_PATH = "assets.pak";           // Shaders, models and textures are read from here first (if it exists)
+
+// --- Culling Settings
+const bool GPU_MESHLET_CULLING = true; // Cull the wall's meshlets in a compute shader instead of on the CPU
+const float IMPLOSION_STEP = 0.15f;    // Furthest the geometry shader pushes the wall in per hit (see Implode in geometryShader.GEO)
+constexpr UniformId IMPLOSION_COUNTER_UNIFORM("implosionCounter");
+
 // --- Camera Settings
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -52,32 +77,86 @@ int tickCount = 0;
 std::vector<float> totalFPSTracked; // This will be needed to get the mean FPS at the end of the program
 
 // --- Input Tracker
-int buttonPressCounter = 0;
 bool wasPressed = false;
 bool inputThresholdReached = false;
 
 // ---------------------------------------------------------------------------------------------
 
-int main()
+int main(int argc, char* argv[])
 {
+	// "--trace <file.json>" records the startup phases and writes them as a Chrome trace once the scene has loaded
+	const char* tracePath = nullptr;
+	if (argc > 2 && std::strcmp(argv[1], "--trace") == 0)
+	{
+		tracePath = argv[2];
+		BeginTrace();
+	}
+
 	// Initialize GLFW window and GLAD function pointers. Exit out of program early and terminate if -1 is returned
 	if (Init() == -1) return -1;
 
 	// tell stb_image.h to flip any loaded textures on the y-axis (before loading model).
 	stbi_set_flip_vertically_on_load(true);
 
+	// "--bench" runs the load-time benchmarks instead of the demo
+	if (argc > 1 && std::strcmp(argv[1], "--bench") == 0)
+	{
+		RunBenchmarks();
+		glfwTerminate();
+		return 0;
+	}
+
+	// "--cook <image>..." writes a .ctex with a precomputed mip chain next to each image, then exits
+	if (argc > 1 && std::strcmp(argv[1], "--cook") == 0)
+	{
+		int failures = 0;
+		for (int i = 2; i < argc; i++)
+			if (!CookTexture(argv[i])) failures++;
+		glfwTerminate();
+		return failures == 0 ? 0 : 1;
+	}
+
+	// "--pack <out.pak> <file>..." stores the files (under the paths given) in an asset pack, then exits
+	if (argc > 2 && std::strcmp(argv[1], "--pack") == 0)
+	{
+		std::vector<std::string> files(argv + 3, argv + argc);
+		bool packed = BuildAssetPack(argv[2], files);
+		glfwTerminate();
+		return packed ? 0 : 1;
+	}
+
+	MountAssetPack(ASSET_PACK_PATH);
+
 	// build and compile shaders
 	Shader vgfShader("shaders\\vertexShader.VERT", "shaders\\fragmentShader.FRAG", "shaders\\geometryShader.GEO");
 	Shader particleShader("shaders\\particleVert.VERT", "shaders\\particleFrag.FRAG");
 	Shader cShader("shaders\\computeShader.COMP");
+	Shader meshletCullShader("shaders\\meshletCull.COMP");
+
+	// Textures start with their low mips, higher mips are streamed in as the camera gets close enough to need them
+	TextureCache::instance().setStreaming(true);
+	TextureStreamer::instance().setBudget(TEXTURE_VRAM_BUDGET);
+
+	// load models: every model of the scene is parsed and processed concurrently, GL work happens in the render loop
+	ModelLoadOptions loadOptions;
+	loadOptions.incremental = true; // keep rendering while the wall streams in
+	loadOptions.residency = GeometryResidency::PositionsOnly; // the particle system only needs the wall's positions
+	SceneLoader sceneLoader(loadOptions);
+	ModelInstance brickWall;
+	//brickWall.model = sceneLoader.add("assets\\models\\goblin\\EvilCartoonVillain.obj");
+	//brickWall.model = sceneLoader.add("assets\\models\\brick_wall\\brick_wall.obj");
+	brickWall.model = sceneLoader.add("assets\\models\\brick_wall\\brick_wall_highres.obj");
+	sceneLoader.start();
+
+	// Bring the wall to origin and initialize scale to 1:1:1
+	brickWall.transform = glm::translate(brickWall.transform, glm::vec3(0.0f, 0.0f, 0.0f));
+	brickWall.transform = glm::scale(brickWall.transform, glm::vec3(1.0f, 1.0f, 1.0f));
 
-	// load models
-	//Model brickWallModel("assets\\models\\goblin\\EvilCartoonVillain.obj");
-	//Model brickWallModel("assets\\models\\brick_wall\\brick_wall.obj");
-	Model brickWallModel("assets\\models\\brick_wall\\brick_wall_highres.obj");
+	// The Particle System is created from the wall's vertices once the wall has finished loading
+	std::unique_ptr<ParticleSystem> particleSystem;
 
-	// initialize Particle System
-	ParticleSystem particleSystem(particleShader, cShader, brickWallModel, brickWallModel.totalVertices);
+	// Every model drawn in a frame is queued here and submitted with one multi-draw per texture set
+	DrawBatch sceneBatch;
 
 	// Enable depth testing and MSAA
 	glEnable(GL_DEPTH_TEST);
@@ -87,8 +166,11 @@ int main()
 	std::srand(std::time(nullptr));
 
 	// Run the render loop
+	bool firstFrameDrawn = false;
 	while (!glfwWindowShouldClose(window))
 	{
+		TRACE_SCOPE("frame");
+		GLStateCache::instance().beginFrame();
 		// Calculate delta time
 		float currentFrame = static_cast<float>(glfwGetTime());
 		deltaTime = currentFrame - lastFrame;
@@ -98,10 +180,26 @@ int main()
 		TrackFPS();
 
 		// Check for when wall has been hit enough times to switch shaders
-		if (buttonPressCounter > 4) inputThresholdReached = true;
+		if (brickWall.hitCount > 4) inputThresholdReached = true;
 
 		// Get user input
-		processInput(window);
+		processInput(window, brickWall);
+
+		// Upload any textures that finished decoding in the background
+		TextureLoader::instance().processUploads(TEXTURE_UPLOAD_BUDGET);
+		TextureStreamer::instance().update(TEXTURE_UPLOAD_BUDGET);
+
+		// Continue loading the scene, then initialize the Particle System from the wall
+		Model& brickWallModel = *brickWall.model;
+		if (sceneLoader.update(MODEL_LOAD_BUDGET_MS) && !particleSystem && brickWallModel.loadState() == ModelLoadState::Ready)
+		{
+			particleSystem.reset(new ParticleSystem(particleShader, cShader, brickWallModel, brickWallModel.totalVertices));
+			ModelCache::instance().logMemoryReport();
+			TextureStreamer& streamer = TextureStreamer::instance();
+			std::cout << "DEBUG LOG: STREAMED TEXTURES: " << streamer.textureCount() << ", " << streamer.residentBytes() / 1024 << " KB RESIDENT OF "
+				<< streamer.budget() / 1024 << " KB BUDGET" << std::endl;
+			if (tracePath) WriteTrace(tracePath);
+		}
 
 		// ------------------------------ Render stuff here... ------------------------------
 		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
@@ -110,50 +208,59 @@ int main()
 		// Model/ View/ Projection transforms
 		glm::mat4 projection = glm::perspective(glm::radians(FOV), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		vgfShader.setMat4("projection", projection);
-		vgfShader.setMat4("view", view);
+		SceneUniforms::instance().setCamera(view, projection, cameraPos);
 
 		// If wall has been hit less than 3 times, run the normal vertex/ geometry/ fragment shaders
 		if (!inputThresholdReached)
 		{
-			// Enable shader
+			// Enable shader (a no-op through GLStateCache once it is current, the batch draws with it as well)
 			vgfShader.use();
-			vgfShader.setInt("implosionCounter", buttonPressCounter);
-			vgfShader.setVec3("cameraPos", cameraPos);
+			vgfShader.setInt(IMPLOSION_COUNTER_UNIFORM, brickWall.hitCount);
 
 			// Set up direction light 
-			vgfShader.setVec3("dirLight.direction", -0.1f, -0.2f, -0.9f);
-			vgfShader.setVec3("dirLight.ambient", 0.33f, 0.33f, 0.33f);
-			vgfShader.setVec3("dirLight.diffuse", 1.0f, 1.0f, 1.0f);
-			vgfShader.setVec3("dirLight.specular", 1.0f, 0.6f, 0.3f);
-
-			// Render the loaded model. Bring it to origin and initialize scale to 1:1:1
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-			model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-			vgfShader.setMat4("model", model);
-			brickWallModel.Draw(vgfShader);
+			LightUniforms dirLight;
+			dirLight.direction = glm::vec4(-0.1f, -0.2f, -0.9f, 0.0f);
+			dirLight.ambient = glm::vec4(0.33f, 0.33f, 0.33f, 0.0f);
+			dirLight.diffuse = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+			dirLight.specular = glm::vec4(1.0f, 0.6f, 0.3f, 0.0f);
+			SceneUniforms::instance().setLight(dirLight);
+
+			// Render the loaded model
+			ViewInfo viewInfo = { glm::mat4(1.0f), view, projection, static_cast<float>(SCR_HEIGHT) };
+			viewInfo.displacement = IMPLOSION_STEP * brickWall.hitCount;
+			viewInfo.meshletCullShader = GPU_MESHLET_CULLING ? &meshletCullShader : nullptr;
+			brickWall.Draw(sceneBatch, vgfShader, viewInfo);
+			sceneBatch.flush();
 		}
 
 		// If the hit threshold is reached, switch to the particle system compute shader
 		else
 		{
-			particleSystem.update(deltaTime);
-			particleSystem.draw(2.0f, projection, view);
+			if (particleSystem)
+			{
+				particleSystem->update(deltaTime);
+				particleSystem->draw(2.0f, projection, view);
+			}
 		}
 
 		// Check and call events/ callback functions, then swap the buffer
 		glfwPollEvents();
 		glfwSwapBuffers(window);
+		if (!firstFrameDrawn) TraceInstant("first frame");
+		firstFrameDrawn = true;
 	}
 
+	if (TraceEnabled()) WriteTrace(tracePath); // closed before the scene finished loading
+
 	PrintFPSDiagnostic(); // Print out FPS information before terminating
+	sceneBatch.release();
 	glfwTerminate();
 	return 0;
 }
 
 int Init()
 {
+	TRACE_SCOPE("Init");
 	// Initialize GLFW, tell it we are using OpenGL 3.3 and to use the core profile
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -214,6 +321,11 @@ void PrintFPSDiagnostic()
 	std::cout << " > Mean FPS: " << std::fixed << std::setprecision(2) << meanFPS << std::endl;
 	std::cout << " > Minimum FPS: " << minFPS << std::endl;
 	std::cout << " > Maximum FPS: " << maxFPS << std::endl;
+
+	const GLStateCache& state = GLStateCache::instance();
+	if (state.frameCount() == 0) return;
+	std::cout << " > GL state changes per frame: " << double(state.total().issued) / state.frameCount() << " issued, "
+		<< double(state.total().skipped) / state.frameCount() << " skipped as redundant" << std::endl;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -221,7 +333,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window)
+void processInput(GLFWwindow* window, ModelInstance& target)
 {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) // ESC
 		glfwSetWindowShouldClose(window, true);
@@ -246,7 +358,7 @@ void processInput(GLFWwindow* window)
 	// Left Mouse Button
 	bool isPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS; // Check if mouse is currently being pressed
 	if (!isPressed && wasPressed && !inputThresholdReached) // Check if the mouse was let go but was previously being pressed (only caring for a singular click and not the mouse being held down)
-		buttonPressCounter++;
+		target.hitCount++;
 	wasPressed = isPressed;
 
 	// Keep the user on the ground plane
@@ -1,83 +1,375 @@
 #include "mesh.h"
+#include <cfloat>
+#include <cmath>
+#include "DrawBatch.h"
+#include "GLStateCache.h"
+#include "MeshletBuilder.h"
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, Material material)
-	: vertices(vertices), indices(indices), textures(textures), material(material)
+namespace
 {
-	setupMesh();
+	// Laid out like the std430 struct in meshletCull.COMP
+	struct GpuMeshlet
+	{
+		glm::vec4 sphere; // center, radius
+		glm::vec4 cone;   // axis, cosine
+		unsigned int indexOffset, indexCount, padding[2];
+	};
 }
 
-void Mesh::Draw(Shader &shader)
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, Material material, std::vector<MeshLod> lods,
+	bool quantize, bool deferUpload)
+	: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), material(material), lods(std::move(lods)),
+	quantized(quantize), vertexTotal(this->vertices.size()), indexTotal(this->indices.size()), residencyPolicy(GeometryResidency::Full)
 {
-	bool hasDiffuse = false;
-	bool hasSpecular = false;
+	setupLods(this->vertices.data(), this->indices.data());
+	setupMesh(this->vertices.data(), this->indices.data(), deferUpload);
+}
 
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	for (unsigned int i = 0; i < textures.size(); i++)
+/// <summary>
+/// Build a mesh from externally owned arrays (e.g. a memory mapped mesh cache). The bounds, meshlets and GPU buffers
+/// are made straight from the given arrays, which are only copied as far as the residency keeps them.
+/// </summary>
+Mesh::Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount, std::vector<Texture> textures, Material material,
+	std::vector<MeshLod> lods, bool quantize, GeometryResidency residency)
+	: textures(std::move(textures)), material(material), lods(std::move(lods)),
+	quantized(quantize), vertexTotal(vertexCount), indexTotal(indexCount), residencyPolicy(residency)
+{
+	setupLods(vertexData, indexData);
+	setupMesh(vertexData, indexData, false);
+	if (residency == GeometryResidency::Full)
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // activate texture unit
+		vertices.assign(vertexData, vertexData + vertexCount);
+		indices.assign(indexData, indexData + indexCount);
+	}
+	else if (residency == GeometryResidency::PositionsOnly)
+	{
+		positions.reserve(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			positions.push_back(vertexData[i].Position);
+	}
+}
 
-		// retrieve texture number
-		std::string number;
-		std::string name = textures[i].type;
+/// <summary>
+/// Queue the mesh at the given level of detail (clamped to the coarsest level available).
+/// </summary>
+/// <param name="instance"> the model instance drawn, its program and record. </param>
+void Mesh::Draw(DrawBatch& batch, const DrawInstance& instance, unsigned int lod)
+{
+	const MeshLod& level = lods[lod < lods.size() ? lod : lods.size() - 1];
+	unsigned int drawId = addDrawRecord(batch, instance.record);
+	batch.addDraw(drawState(instance), drawId, geometry.firstIndex + level.indexOffset, level.indexCount, static_cast<int>(geometry.firstVertex),
+		viewDepth(instance));
+}
 
-		if (name == "texture_diffuse")
-		{
-			number = std::to_string(diffuseNr++); 
-			hasDiffuse = true;
-		}
-		else if (name == "texture_specular")
+/// <summary>
+/// Queue LOD 0 without the meshlets that are outside the view or facing away from it. On the CPU the visible meshlets
+/// are merged into contiguous index ranges, one indirect command each; with a cull shader a compute pass writes one
+/// command per meshlet (empty if culled) when the batch is flushed, without reading anything back.
+/// </summary>
+/// <param name="view"> the view in the mesh's object space, see MakeMeshletCullView. </param>
+/// <param name="cullShader"> meshletCull.COMP to cull on the GPU, or nullptr to cull on the CPU. </param>
+/// <returns> meshlets drawn, or all of them when culling on the GPU. </returns>
+size_t Mesh::DrawCulled(DrawBatch& batch, const DrawInstance& instance, const MeshletCullView& view, Shader* cullShader)
+{
+	if (cullShader)
+	{
+		GpuMeshletCull cull = { gpuMeshlets(), static_cast<unsigned int>(meshlets.size()), view, cullShader };
+		batch.addCulledDraw(drawState(instance), addDrawRecord(batch, instance.record), geometry.firstIndex, static_cast<int>(geometry.firstVertex), cull,
+			viewDepth(instance));
+		return meshlets.size();
+	}
+
+	size_t visible = 0;
+	unsigned int drawId = 0;
+	DrawState state;
+	float depth = 0.0f;
+	for (const Meshlet& meshlet : meshlets)
+	{
+		if (!IsMeshletVisible(meshlet, view)) continue;
+		if (visible++ == 0)
 		{
-			number = std::to_string(specularNr++); 
-			hasSpecular = true;
+			drawId = addDrawRecord(batch, instance.record);
+			state = drawState(instance);
+			depth = viewDepth(instance);
 		}
+		// Neighbouring visible meshlets continue each other's index range and are merged by the batch
+		batch.addDraw(state, drawId, geometry.firstIndex + meshlet.indexOffset, meshlet.indexCount, static_cast<int>(geometry.firstVertex), depth);
+	}
+	return visible;
+}
+
+/// <summary>
+/// The meshlets in the layout meshletCull.COMP reads, uploaded on first use.
+/// </summary>
+unsigned int Mesh::gpuMeshlets()
+{
+	if (meshletBuffer) return meshletBuffer;
+	std::vector<GpuMeshlet> gpuMeshlets(meshlets.size());
+	for (size_t i = 0; i < meshlets.size(); i++)
+	{
+		gpuMeshlets[i].sphere = glm::vec4(meshlets[i].center, meshlets[i].radius);
+		gpuMeshlets[i].cone = glm::vec4(meshlets[i].coneAxis, meshlets[i].coneCosine);
+		gpuMeshlets[i].indexOffset = meshlets[i].indexOffset;
+		gpuMeshlets[i].indexCount = meshlets[i].indexCount;
+	}
+	glGenBuffers(1, &meshletBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, gpuMeshlets.size() * sizeof(GpuMeshlet), gpuMeshlets.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return meshletBuffer;
+}
 
-		shader.setFloat(("material." + name + number).c_str(), i); // This will set any texture maps in the material shader
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+/// <summary>
+/// Add the instance's record, completed with the mesh's material, texture layers and dequantization parameters.
+/// </summary>
+/// <returns> the draw ID. </returns>
+unsigned int Mesh::addDrawRecord(DrawBatch& batch, const DrawRecord& instance) const
+{
+	DrawRecord record = instance;
+	record.material.ambient = glm::vec4(material.ambient, 0.0f);
+	record.material.diffuse = glm::vec4(material.diffuse, 0.0f);
+	record.material.specular = glm::vec4(material.specular, 0.0f);
+	record.material.shininess = material.shininess;
+	record.material.hasDiffuseTex = diffuseTexture >= 0;
+	record.material.hasSpecularTex = specularTexture >= 0;
+	record.diffuseLayer = diffuseLayer.layer;
+	record.specularLayer = specularLayer.layer;
+	record.quantized = quantized;
+	if (quantized)
+	{
+		record.positionOffset = glm::vec4(quantization.offset, 0.0f);
+		record.positionScale = glm::vec4(quantization.scale, 0.0f);
 	}
-	glActiveTexture(GL_TEXTURE0);
+	return batch.addRecord(record);
+}
 
-	// Bind material uniform values
-	shader.setVec3("material.ambient", material.ambient);
-	shader.setVec3("material.diffuse", material.diffuse);
-	shader.setVec3("material.specular", material.specular);
-	shader.setFloat("material.shininess", material.shininess);
-	shader.setBool("hasDiffuseTex", hasDiffuse);
-	shader.setBool("hasSpecularTex", hasSpecular);
+/// <summary>
+/// What has to be bound to draw the mesh: the instance's program, the mesh's arena and its first diffuse and specular
+/// texture, or the texture arrays holding them when they are packed.
+/// </summary>
+DrawState Mesh::drawState(const DrawInstance& instance) const
+{
+	DrawState state;
+	state.program = instance.shader->ID;
+	state.arena = &arena();
+	if (diffuseTexture >= 0) state.diffuseTexture = textures[diffuseTexture].id;
+	if (specularTexture >= 0) state.specularTexture = textures[specularTexture].id;
+	if (diffuseLayer.layer >= 0) state.diffuseArray = diffuseLayer.array;
+	if (specularLayer.layer >= 0) state.specularArray = specularLayer.array;
+	return state;
+}
 
-	// draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+/// <summary>
+/// Distance of the bounding sphere's center in front of the camera, the batch draws nearer meshes first.
+/// </summary>
+float Mesh::viewDepth(const DrawInstance& instance) const
+{
+	return -(instance.modelView * glm::vec4(boundsCenter, 1.0f)).z;
 }
 
-void Mesh::setupMesh() 
+/// <summary>
+/// Index of the first texture of the given type ("texture_diffuse", ...), or -1.
+/// </summary>
+int Mesh::findTexture(const std::string& type) const
 {
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
+	for (size_t i = 0; i < textures.size(); i++)
+		if (textures[i].type == type) return static_cast<int>(i);
+	return -1;
+}
 
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+/// <summary>
+/// Allocate the mesh's vertices and indices in the arena of its vertex layout and fill them. With deferUpload the
+/// contents are streamed in later by uploadStep() from the mesh's own vertex/ index arrays. The textures the draws bind
+/// are looked up here too, so queueing a draw does no string compares.
+/// </summary>
+void Mesh::setupMesh(const Vertex* vertexData, const unsigned int* indexData, bool deferUpload) 
+{
+	diffuseTexture = findTexture("texture_diffuse");
+	specularTexture = findTexture("texture_specular");
+	geometry = arena().allocate(vertexTotal, indexTotal);
+	if (quantized)
+	{
+		quantization = ComputeQuantization(vertexData, vertexTotal);
+		QuantizeVertices(vertexData, vertexTotal, quantization, quantizedVertices);
+	}
+
+	if (!deferUpload)
+	{
+		const void* vertexSource = quantized ? static_cast<const void*>(quantizedVertices.data()) : static_cast<const void*>(vertexData);
+		arena().writeVertices(geometry, 0, vertexTotal * arena().vertexStride(), vertexSource);
+		arena().writeIndices(geometry, 0, indexTotal * sizeof(unsigned int), indexData);
+		std::vector<QuantizedVertex>().swap(quantizedVertices);
+	}
+	uploadedBytes = deferUpload ? 0 : uploadSize();
+}
 
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+/// <summary>
+/// Size of the mesh's share of the arena buffers in bytes.
+/// </summary>
+size_t Mesh::uploadSize() const
+{
+	return vertexTotal * (quantized ? sizeof(QuantizedVertex) : sizeof(Vertex)) + indexTotal * sizeof(unsigned int);
+}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+/// <summary>
+/// Upload the next chunk of a deferred mesh: the vertex buffer first, then the index buffer.
+/// </summary>
+/// <param name="maxBytes"> upper bound for the bytes copied in this step. </param>
+/// <returns> bytes uploaded in this step, 0 once the mesh is complete. </returns>
+size_t Mesh::uploadStep(size_t maxBytes)
+{
+	size_t vertexBytes = vertexTotal * (quantized ? sizeof(QuantizedVertex) : sizeof(Vertex));
+	const unsigned char* vertexSource = quantized ? reinterpret_cast<const unsigned char*>(quantizedVertices.data())
+		: reinterpret_cast<const unsigned char*>(vertices.data());
+	const unsigned char* indexSource = reinterpret_cast<const unsigned char*>(indices.data());
 
-	// Vertex positions
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	glEnableVertexAttribArray(0);
+	size_t uploaded = 0;
+	while (uploaded < maxBytes && !isUploaded())
+	{
+		bool vertexPart = uploadedBytes < vertexBytes;
+		size_t offset = vertexPart ? uploadedBytes : uploadedBytes - vertexBytes;
+		size_t remaining = vertexPart ? vertexBytes - offset : indexTotal * sizeof(unsigned int) - offset;
+		size_t chunk = remaining < maxBytes - uploaded ? remaining : maxBytes - uploaded;
 
-	// Vertex normals
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 
-		(void*)offsetof(Vertex, Normal));
-	glEnableVertexAttribArray(1);
+		if (vertexPart) arena().writeVertices(geometry, offset, chunk, vertexSource + offset);
+		else arena().writeIndices(geometry, offset, chunk, indexSource + offset);
+		uploaded += chunk;
+		uploadedBytes += chunk;
+	}
 
-	// Vertex texCoords
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), 
-		(void*)offsetof(Vertex, TexCoords));
-	glEnableVertexAttribArray(2);
+	if (isUploaded())
+	{
+		std::vector<QuantizedVertex>().swap(quantizedVertices); // staging copy no longer needed
+		applyResidency();
+	}
+	return uploaded;
+}
+
+/// <summary>
+/// Choose what stays in system memory after upload. Takes effect right away if the buffers are already complete,
+/// otherwise when the last uploadStep() finishes. Dropped data is not brought back by switching to a fuller policy.
+/// </summary>
+void Mesh::setResidency(GeometryResidency policy)
+{
+	residencyPolicy = policy;
+	if (isUploaded()) applyResidency();
+}
+
+void Mesh::applyResidency()
+{
+	if (residencyPolicy == GeometryResidency::Full) return;
+	if (residencyPolicy == GeometryResidency::PositionsOnly && positions.empty())
+	{
+		positions.reserve(vertices.size());
+		for (const Vertex& vertex : vertices)
+			positions.push_back(vertex.Position);
+	}
+	std::vector<Vertex>().swap(vertices);
+	std::vector<unsigned int>().swap(indices);
+}
+
+/// <summary>
+/// Copy up to maxCount object space vertex positions (w = 1) into out, from whichever copy the residency policy kept.
+/// Without a CPU copy the positions are read back from the vertex buffer, so this needs the GL context.
+/// </summary>
+/// <returns> number of positions written. </returns>
+size_t Mesh::readPositions(glm::vec4* out, size_t maxCount) const
+{
+	size_t count = vertexTotal < maxCount ? vertexTotal : maxCount;
+	if (!vertices.empty())
+	{
+		for (size_t i = 0; i < count; i++) out[i] = glm::vec4(vertices[i].Position, 1.0f);
+		return count;
+	}
+	if (!positions.empty())
+	{
+		for (size_t i = 0; i < count; i++) out[i] = glm::vec4(positions[i], 1.0f);
+		return count;
+	}
+	if (!isUploaded()) return 0;
+
+	// GPU only: read the first count vertices back (and decode them if quantized)
+	if (quantized)
+	{
+		std::vector<QuantizedVertex> packed(count);
+		arena().readVertices(geometry, count, packed.data());
+		std::vector<Vertex> decoded;
+		DecodeVertices(packed.data(), count, quantization, decoded);
+		for (size_t i = 0; i < count; i++) out[i] = glm::vec4(decoded[i].Position, 1.0f);
+	}
+	else
+	{
+		std::vector<Vertex> readback(count);
+		arena().readVertices(geometry, count, readback.data());
+		for (size_t i = 0; i < count; i++) out[i] = glm::vec4(readback[i].Position, 1.0f);
+	}
+	return count;
+}
+
+/// <summary>
+/// System memory held by the mesh's geometry (vertex, index, position and staging arrays plus the LOD table) and the
+/// GPU memory it uses: its share of the arena buffers and its meshlet buffer.
+/// </summary>
+GeometryMemory Mesh::memoryUsage() const
+{
+	GeometryMemory memory;
+	memory.cpuBytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int)
+		+ positions.capacity() * sizeof(glm::vec3) + quantizedVertices.capacity() * sizeof(QuantizedVertex)
+		+ lods.capacity() * sizeof(MeshLod) + meshlets.capacity() * sizeof(Meshlet);
+	memory.gpuBytes = uploadSize();
+	if (meshletBuffer) memory.gpuBytes += meshlets.size() * sizeof(GpuMeshlet);
+	return memory;
+}
+
+void Mesh::releaseBuffers()
+{
+	arena().free(geometry);
+	if (meshletBuffer)
+	{
+		GLStateCache::instance().bufferDeleted(meshletBuffer);
+		glDeleteBuffers(1, &meshletBuffer);
+	}
+	geometry = GeometryAllocation();
+	meshletBuffer = 0;
+}
+
+/// <summary>
+/// Make sure there is a LOD 0 covering the whole index buffer, and compute the bounding box and sphere used to cull the
+/// mesh and pick its LOD, and the average texture coordinate density used to pick texture mips (the square root of the
+/// ratio of UV area to surface area over all triangles). LOD 0 is also split into meshlets for culling.
+/// </summary>
+void Mesh::setupLods(const Vertex* vertexData, const unsigned int* indexData)
+{
+	if (lods.empty())
+	{
+		MeshLod full = { 0, static_cast<unsigned int>(indexTotal), 0.0f };
+		lods.push_back(full);
+	}
+
+	glm::vec3 minBounds(FLT_MAX), maxBounds(-FLT_MAX);
+	for (size_t i = 0; i < vertexTotal; i++)
+	{
+		minBounds = glm::min(minBounds, vertexData[i].Position);
+		maxBounds = glm::max(maxBounds, vertexData[i].Position);
+	}
+	boundsMin = vertexTotal == 0 ? glm::vec3(0.0f) : minBounds;
+	boundsMax = vertexTotal == 0 ? glm::vec3(0.0f) : maxBounds;
+	boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	boundsRadius = 0.0f;
+	for (size_t i = 0; i < vertexTotal; i++)
+		boundsRadius = glm::max(boundsRadius, glm::length(vertexData[i].Position - boundsCenter));
+
+	double surfaceArea = 0.0, uvArea = 0.0;
+	for (size_t i = 0; i + 2 < lods[0].indexCount; i += 3)
+	{
+		const Vertex& a = vertexData[indexData[lods[0].indexOffset + i]];
+		const Vertex& b = vertexData[indexData[lods[0].indexOffset + i + 1]];
+		const Vertex& c = vertexData[indexData[lods[0].indexOffset + i + 2]];
+		surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+		glm::vec2 uvB = b.TexCoords - a.TexCoords, uvC = c.TexCoords - a.TexCoords;
+		uvArea += std::fabs(uvB.x * uvC.y - uvB.y * uvC.x);
+	}
+	uvDensity = surfaceArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
 
-	glBindVertexArray(0);
+	meshlets = BuildMeshlets(vertexData, vertexTotal, indexData, lods[0].indexOffset, lods[0].indexCount);
 }
@@ -6,7 +6,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "GeometryArena.h"
 #include "Shader.h"
+#include "TextureArrays.h"
+#include "TextureCache.h"
+#include "VertexQuantization.h"
 
 struct Vertex
 {
@@ -20,8 +24,16 @@ struct Texture
 	unsigned int id;
 	std::string type;
 	std::string path;
+	TextureHandle handle; // keeps the shared GL texture alive while any mesh uses it
 };
 
+// Texture units of a mesh's diffuse and specular map, fixed by layout(binding) in fragmentShader.FRAG
+const unsigned int DIFFUSE_TEXTURE_UNIT = 0;
+const unsigned int SPECULAR_TEXTURE_UNIT = 1;
+
+// First texture unit used by packed texture arrays (diffuse, then specular)
+const unsigned int TEXTURE_ARRAY_UNIT = 8;
+
 struct Material
 {
 	glm::vec3 ambient;
@@ -31,24 +43,133 @@ struct Material
 };
 
 /// <summary>
-/// This class handles generating and buffering Mesh data to their respective buffer objects and drawing them.
+/// One level of detail: a range of the mesh's index buffer. All levels share the same vertices.
+/// The error is the largest object space distance the simplified surface deviates from the full resolution one.
+/// </summary>
+struct MeshLod
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	float error;
+};
+
+/// <summary>
+/// A cluster of LOD 0's triangles (see MeshletBuilder): a contiguous range of the index buffer with the bounds used to
+/// cull it. Every face normal of the cluster lies within coneCosine of coneAxis.
+/// </summary>
+struct Meshlet
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	glm::vec3 center;   // object space bounding sphere
+	float radius;
+	glm::vec3 coneAxis;
+	float coneCosine;   // cosine of the cone's half angle, <= 0 if the cluster cannot be backface culled
+};
+
+struct MeshletCullView;
+class DrawBatch;
+struct DrawInstance;
+struct DrawRecord;
+struct DrawState;
+
+/// <summary>
+/// What a mesh keeps in system memory once its GPU buffers are filled.
+/// </summary>
+enum class GeometryResidency
+{
+	Full,          // vertex and index arrays
+	PositionsOnly, // a compact position stream, for picking and particle seeding
+	GpuOnly        // nothing, positions are read back from the vertex buffer when needed
+};
+
+/// <summary>
+/// Bytes of geometry a mesh holds in system memory and in GPU buffers.
+/// </summary>
+struct GeometryMemory
+{
+	size_t cpuBytes = 0;
+	size_t gpuBytes = 0;
+};
+
+/// <summary>
+/// CPU-side mesh produced by an importer, before any OpenGL buffers exist for it. Textures only carry their type and path.
+/// </summary>
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices; // all LODs back to back, see lods
+	std::vector<Texture> textures;
+	Material material;
+	std::vector<MeshLod> lods;         // empty if the mesh has no LODs
+};
+
+/// <summary>
+/// This class handles buffering Mesh data into the shared GeometryArena of its vertex layout and queueing its draws.
 /// </summary>
 class Mesh
 {
 public:	
-	// mesh data
+	// mesh data, the vertex and index arrays are emptied after upload unless the residency is Full
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> positions; // only kept with GeometryResidency::PositionsOnly
 	std::vector<Texture> textures;
+	TextureLayer diffuseLayer;   // used instead of textures when the model packs its textures into arrays
+	TextureLayer specularLayer;
 	Material material;
+	std::vector<MeshLod> lods;   // always at least one level, LOD 0 is the full resolution mesh
+	std::vector<Meshlet> meshlets; // clusters of LOD 0, culled individually by DrawCulled
+	glm::vec3 boundsCenter;      // object space bounding sphere, used for LOD selection
+	float boundsRadius;
+	glm::vec3 boundsMin;         // object space bounding box, culled with the sphere by Model::Draw
+	glm::vec3 boundsMax;
+	float uvDensity;             // texture coordinate units per object space unit, for texture streaming
+	bool quantized;              // GPU vertex buffer uses QuantizedVertex instead of Vertex
+	QuantizationParams quantization;
+
+	// Constructors
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, Material material,
+		std::vector<MeshLod> lods = std::vector<MeshLod>(), bool quantize = false, bool deferUpload = false);
+	Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount, std::vector<Texture> textures, Material material,
+		std::vector<MeshLod> lods = std::vector<MeshLod>(), bool quantize = false, GeometryResidency residency = GeometryResidency::Full);
+	void Draw(DrawBatch& batch, const DrawInstance& instance, unsigned int lod = 0);
+	size_t DrawCulled(DrawBatch& batch, const DrawInstance& instance, const MeshletCullView& view, Shader* cullShader = nullptr);
+
+	// Incremental upload of meshes created with deferUpload
+	size_t uploadSize() const;
+	size_t uploadStep(size_t maxBytes);
+	bool isUploaded() const { return uploadedBytes == uploadSize(); }
+
+	// CPU-side geometry kept after upload (applied once the buffers are complete)
+	void setResidency(GeometryResidency policy);
+	GeometryResidency residency() const { return residencyPolicy; }
+	size_t vertexCount() const { return vertexTotal; }
+	size_t indexCount() const { return indexTotal; }
+	size_t readPositions(glm::vec4* out, size_t maxCount) const;
+	GeometryMemory memoryUsage() const;
 
-	// Constructor
-	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, Material material);
-	void Draw(Shader& shader);
+	// Copies of a Mesh share its arena allocation and GL objects, so only the owning Model frees them
+	void releaseBuffers();
 
 private:
 	// render data
-	unsigned int VAO, VBO, EBO;
-	void setupMesh();
+	GeometryAllocation geometry;     // vertices and indices in GeometryArena::forLayout(quantized)
+	unsigned int meshletBuffer = 0; // GPU culling input, created on first use
+	int diffuseTexture = -1;        // index of the first diffuse/ specular map in textures, -1 if none
+	int specularTexture = -1;
+	size_t uploadedBytes;
+	size_t vertexTotal, indexTotal;
+	GeometryResidency residencyPolicy;
+	std::vector<QuantizedVertex> quantizedVertices; // staging copy, only kept while a deferred upload is in progress
+	void setupMesh(const Vertex* vertexData, const unsigned int* indexData, bool deferUpload);
+	void setupLods(const Vertex* vertexData, const unsigned int* indexData);
+	void applyResidency();
+	GeometryArena& arena() const { return GeometryArena::forLayout(quantized); }
+	unsigned int addDrawRecord(DrawBatch& batch, const DrawRecord& instance) const;
+	DrawState drawState(const DrawInstance& instance) const;
+	float viewDepth(const DrawInstance& instance) const;
+	int findTexture(const std::string& type) const;
+	unsigned int gpuMeshlets();
 };
 #endif
\ No newline at end of file
@@ -1,77 +1,638 @@
 #include "model.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include "AllocationTracker.h"
+#include "Arena.h"
+#include "AssetIOSystem.h"
+#include "DrawBatch.h"
+#include "AssetPack.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "Trace.h"
+
+namespace
+{
+	// A coarser LOD is used as soon as its simplification error projects to less than this many pixels
+	const float LOD_PIXEL_ERROR_THRESHOLD = 1.0f;
+
+	// Largest buffer upload issued in one incremental loading step
+	const size_t INCREMENTAL_UPLOAD_CHUNK = 256 * 1024;
+
+	double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count();
+	}
+
+	// Texture paths referenced by a list of MeshData or CachedMesh, each once
+	template <typename MeshList>
+	std::vector<std::string> UniqueTexturePaths(const MeshList& meshes)
+	{
+		std::vector<std::string> paths;
+		for (const auto& mesh : meshes)
+			for (const Texture& texture : mesh.textures)
+				if (std::find(paths.begin(), paths.end(), texture.path) == paths.end()) paths.push_back(texture.path);
+		return paths;
+	}
+}
 
-Model::Model(const char* path)
+/// <summary>
+/// State of an incremental load: the import job running on the ThreadPool, then the meshes still waiting for upload.
+/// </summary>
+struct Model::IncrementalLoad
+{
+	std::string path;
+	std::chrono::high_resolution_clock::time_point start;
+	std::shared_ptr<ImportedModel> imported; // shared with the import job
+	std::future<bool> import;                // valid until the import result has been collected
+	size_t nextMesh = 0;                     // next imported mesh to create GL objects for
+	size_t bytesTotal = 0;
+	size_t bytesUploaded = 0;
+};
+
+Model::Model(const char* path, const ModelLoadOptions& options)
+	: Model(std::string(path), options, true)
+{
+}
+
+/// <summary>
+/// Without startLoad the model stays empty in the Loading state until its import is handed over by finishImport().
+/// </summary>
+Model::Model(std::string const& path, const ModelLoadOptions& options, bool startLoad)
+	: totalVertices(0), options(options), state(ModelLoadState::Loading)
 {
 	// Init bounds for the model
 	minBounds = glm::vec3(FLT_MAX);
 	maxBounds = glm::vec3(-FLT_MAX);
-	loadModel(path);
+	directory = path.substr(0, path.find_last_of('\\'));
+	if (!startLoad) return;
+	if (options.incremental) beginIncrementalLoad(path);
+	else loadModel(path);
+}
+
+/// <summary>
+/// Free the GL objects of every mesh. A pending incremental import keeps running on its own copy and is discarded.
+/// </summary>
+Model::~Model()
+{
+	// Models can outlive the window at shutdown, by then there is no context to delete the buffers from
+	if (!glfwGetCurrentContext()) return;
+	for (Mesh& mesh : meshes)
+		mesh.releaseBuffers();
+	textureArrays.release();
+}
+
+/// <summary>
+/// Queue every mesh at full detail, to be drawn with the given shader. Without a view the meshes are not depth sorted.
+/// </summary>
+void Model::Draw(DrawBatch& batch, Shader& shader, const glm::mat4& transform)
+{
+	DrawInstance instance = { &shader, MakeDrawRecord(transform, modelCenter), glm::mat4(0.0f) };
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		if (!meshes[i].isUploaded()) continue; // still streaming in
+		meshes[i].Draw(batch, instance);
+	}
 }
 
-void Model::Draw(Shader& shader) 
+/// <summary>
+/// Queue every mesh at the coarsest level of detail that still looks the same from the given view. Meshes outside the
+/// view are skipped before anything is queued, and meshes drawn at full detail only draw the meshlets that can be
+/// visible.
+/// </summary>
+void Model::Draw(DrawBatch& batch, Shader& shader, const ViewInfo& view)
 {
+	DrawInstance instance = { &shader, MakeDrawRecord(view.model, modelCenter), view.view * view.model };
+	MeshletCullView cull = MakeMeshletCullView(view.model, view.view, view.projection, view.displacement, view.cullBackfaces);
+	if (view.cullMeshes)
+	{
+		// The whole model first, then its meshes eight at a time
+		if (!meshes.empty() && !IsBoxVisible(cull.planes, cull.margin, minBounds, maxBounds)) return;
+		updateMeshBounds();
+		meshBounds.cull(cull.planes, cull.margin, visibleMeshes);
+	}
 	for (unsigned int i = 0; i < meshes.size(); i++)
 	{
-		meshes[i].Draw(shader);
+		if (view.cullMeshes && !IsBoundsVisible(visibleMeshes, i)) continue;
+		if (!meshes[i].isUploaded()) continue; // still streaming in
+		unsigned int lod = selectLod(meshes[i], view);
+		if (lod == 0 && view.cullMeshlets && meshes[i].meshlets.size() > 1)
+		{
+			if (meshes[i].DrawCulled(batch, instance, cull, view.meshletCullShader) == 0) continue; // nothing of it is visible
+		}
+		else meshes[i].Draw(batch, instance, lod);
+		requestTextureDetail(meshes[i], view);
 	}
-	shader.setVec3("modelCenter", modelCenter);
+}
+
+/// <summary>
+/// Add the bounds of meshes added since the last call. Meshes are only ever appended, or all removed.
+/// </summary>
+void Model::updateMeshBounds()
+{
+	if (meshBounds.size() > meshes.size()) meshBounds.clear();
+	for (size_t i = meshBounds.size(); i < meshes.size(); i++)
+		meshBounds.add(meshes[i].boundsMin, meshes[i].boundsMax, meshes[i].boundsRadius);
+}
+
+/// <summary>
+/// Pick a LOD from the projected screen space size of the mesh: the mesh's bounding sphere gives its distance to
+/// the camera, which scales each LOD's object space error into pixels on screen.
+/// </summary>
+/// <returns> index into mesh.lods. </returns>
+unsigned int Model::selectLod(const Mesh& mesh, const ViewInfo& view) const
+{
+	if (mesh.lods.size() < 2) return 0;
+
+	float pixelsPerUnit = projectedPixelsPerUnit(mesh, view);
+	unsigned int lod = 0;
+	while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].error * pixelsPerUnit < LOD_PIXEL_ERROR_THRESHOLD)
+		lod++;
+	return lod;
+}
+
+/// <summary>
+/// Screen pixels covered by one object space unit of the mesh at the closest point of its bounding sphere
+/// (FLT_MAX when the camera is inside the sphere).
+/// </summary>
+float Model::projectedPixelsPerUnit(const Mesh& mesh, const ViewInfo& view) const
+{
+	glm::vec3 viewCenter = glm::vec3(view.view * view.model * glm::vec4(mesh.boundsCenter, 1.0f));
+	float scale = glm::max(glm::length(glm::vec3(view.model[0])), glm::max(glm::length(glm::vec3(view.model[1])), glm::length(glm::vec3(view.model[2]))));
+	float distance = glm::length(viewCenter) - mesh.boundsRadius * scale; // distance to the closest point of the sphere
+	if (distance <= 0.0f) return FLT_MAX;
+
+	// World space size of one pixel at that distance: projection[1][1] is cot(fovy / 2)
+	return scale * view.projection[1][1] * 0.5f * view.viewportHeight / distance;
+}
+
+/// <summary>
+/// Tell the TextureStreamer how much detail the mesh's textures need at its current screen size.
+/// </summary>
+void Model::requestTextureDetail(const Mesh& mesh, const ViewInfo& view) const
+{
+	TextureStreamer& streamer = TextureStreamer::instance();
+	if (!streamer.active() || mesh.textures.empty()) return;
+
+	float pixelsPerUnit = projectedPixelsPerUnit(mesh, view);
+	float pixelsPerUv = mesh.uvDensity > 0.0f && pixelsPerUnit < FLT_MAX ? pixelsPerUnit / mesh.uvDensity : FLT_MAX;
+	for (const Texture& texture : mesh.textures)
+		streamer.requestDetail(texture.id, pixelsPerUv);
 }
 
 void Model::loadModel(std::string path)
 {
+	TRACE_SCOPE("model load", path);
+	auto loadStart = std::chrono::high_resolution_clock::now();
+
+	// Temporary import/ processing data is bump allocated and freed in one go when the load returns
+	Arena scratch;
+	ArenaScope scratchScope(&scratch);
+
+	bool cacheLoaded = false;
+	{
+		AllocationScope allocations("mesh cache load");
+		TRACE_SCOPE("mesh cache load");
+		cacheLoaded = options.useMeshCache && loadFromCache(path);
+	}
+	if (cacheLoaded)
+	{
+		std::cout << "DEBUG LOG: MESH CACHE LOAD SUCCESSFUL (" << ElapsedMs(loadStart) << " ms)" << std::endl;
+		state = ModelLoadState::Ready;
+		glfwSetTime(0.0);
+		return;
+	}
+
+	ImportedModel imported;
+	{
+		AllocationScope allocations("import");
+		TRACE_SCOPE("import");
+		if (!importModel(path, options, imported))
+		{
+			state = ModelLoadState::Failed;
+			return;
+		}
+	}
+
+	applyImport(imported);
+	{
+		AllocationScope allocations("mesh cache write");
+		TRACE_SCOPE("mesh cache write");
+		if (options.useMeshCache) writeCache(path, options, imported);
+	}
+
+	{
+		AllocationScope allocations("mesh creation");
+		TRACE_SCOPE("mesh creation");
+		meshes.reserve(imported.meshes.size());
+		for (MeshData& mesh : imported.meshes)
+			addMesh(mesh, false);
+	}
+	state = ModelLoadState::Ready;
+
+	std::cout << "DEBUG LOG: " << imported.importer << " MODEL LOAD SUCCESSFUL (" << ElapsedMs(loadStart) << " ms)" << std::endl;
+	glfwSetTime(0.0);
+}
+
+/// <summary>
+/// Start an incremental load: reading the cache or importing and processing the model runs as one job on the shared
+/// ThreadPool, the GL side is then done step by step by updateLoad(). The frame clock is left alone.
+/// </summary>
+/// <param name="path"></param>
+void Model::beginIncrementalLoad(std::string const& path)
+{
+	pendingLoad = std::make_shared<IncrementalLoad>();
+	pendingLoad->path = path;
+	pendingLoad->start = std::chrono::high_resolution_clock::now();
+	pendingLoad->imported = std::make_shared<ImportedModel>();
+
+	// The job only touches its own copies, so the model may be destroyed while it runs. It opens no AllocationScope:
+	// the main thread keeps allocating while it runs, and the process wide counters can't tell the two apart.
+	std::shared_ptr<ImportedModel> imported = pendingLoad->imported;
+	ModelLoadOptions importOptions = options;
+	pendingLoad->import = ThreadPool::shared().submit([path, importOptions, imported]()
+	{
+		TRACE_SCOPE("incremental import", path);
+		Arena scratch;
+		ArenaScope scratchScope(&scratch);
+		if (importOptions.useMeshCache && readCache(path, importOptions, *imported)) return true;
+		if (!importModel(path, importOptions, *imported)) return false;
+		if (importOptions.useMeshCache) writeCache(path, importOptions, *imported);
+		return true;
+	});
+}
+
+/// <summary>
+/// Advance an incremental load. Call this once per frame on the GL thread: it picks up the finished import, then
+/// creates the meshes and streams their buffers in chunks until the time budget is used up (at least one step is done).
+/// </summary>
+/// <param name="budgetMs"> time this call may spend on the GL thread. </param>
+/// <returns> true once the model has finished loading (or failed). </returns>
+bool Model::updateLoad(double budgetMs)
+{
+	TRACE_SCOPE("model upload step");
+	if (!pendingLoad) return true;
+	auto stepStart = std::chrono::high_resolution_clock::now();
+	IncrementalLoad& load = *pendingLoad;
+
+	// 1. Wait (without blocking) for the import job
+	if (load.import.valid())
+	{
+		if (load.import.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		if (!load.import.get())
+		{
+			std::cerr << "ERROR::MODEL::Incremental load of " << load.path << " failed" << std::endl;
+			state = ModelLoadState::Failed;
+			pendingLoad.reset();
+			return true;
+		}
+
+		beginUpload(load);
+	}
+
+	// 2. Create the meshes and upload their buffers in chunks
+	std::vector<MeshData>& pendingMeshes = load.imported->meshes;
+	do
+	{
+		if (!meshes.empty() && !meshes.back().isUploaded())
+			load.bytesUploaded += meshes.back().uploadStep(INCREMENTAL_UPLOAD_CHUNK);
+		else if (load.nextMesh < pendingMeshes.size())
+			addMesh(pendingMeshes[load.nextMesh++], true);
+		else break;
+	} while (ElapsedMs(stepStart) < budgetMs);
+
+	if (load.nextMesh < pendingMeshes.size() || (!meshes.empty() && !meshes.back().isUploaded())) return false;
+
+	std::cout << "DEBUG LOG: INCREMENTAL " << load.imported->importer << " MODEL LOAD SUCCESSFUL (" << ElapsedMs(load.start) << " ms)" << std::endl;
+	state = ModelLoadState::Ready;
+	pendingLoad.reset();
+	return true;
+}
+
+/// <summary>
+/// Take over the finished import of an incremental load and size the uploads still to come.
+/// </summary>
+void Model::beginUpload(IncrementalLoad& load)
+{
+	applyImport(*load.imported);
+	meshes.reserve(load.imported->meshes.size());
+	for (const MeshData& mesh : load.imported->meshes)
+	{
+		size_t vertexSize = options.quantizeVertices ? sizeof(QuantizedVertex) : sizeof(Vertex);
+		load.bytesTotal += mesh.vertices.size() * vertexSize + mesh.indices.size() * sizeof(unsigned int);
+	}
+}
+
+/// <summary>
+/// Hand a model created without startLoad the result of an import that ran elsewhere (see SceneLoader). The meshes are
+/// created right away, or streamed in by updateLoad() if the model loads incrementally. GL thread only.
+/// </summary>
+/// <param name="imported"> processed import, or nullptr if it failed. </param>
+void Model::finishImport(const std::shared_ptr<ImportedModel>& imported)
+{
+	if (!imported)
+	{
+		state = ModelLoadState::Failed;
+		return;
+	}
+
+	if (options.incremental)
+	{
+		pendingLoad = std::make_shared<IncrementalLoad>();
+		pendingLoad->start = std::chrono::high_resolution_clock::now();
+		pendingLoad->imported = imported;
+		beginUpload(*pendingLoad);
+		return;
+	}
+
+	applyImport(*imported);
+	meshes.reserve(imported->meshes.size());
+	for (MeshData& mesh : imported->meshes)
+		addMesh(mesh, false);
+	state = ModelLoadState::Ready;
+}
+
+/// <summary>
+/// Write a fresh import to the mesh cache so later loads can skip importing. Safe to call from worker threads.
+/// Nothing is written after the OBJ loader fell back to ASSIMP: the cache flags say which importer the options ask
+/// for, and a later load with them must not be handed the other importer's meshes.
+/// </summary>
+void Model::writeCache(std::string const& path, const ModelLoadOptions& options, const ImportedModel& imported)
+{
+	if (imported.objFallback) return;
+	unsigned int vertexCount = 0;
+	for (const MeshData& mesh : imported.meshes) vertexCount += static_cast<unsigned int>(mesh.vertices.size());
+	glm::vec3 center = (imported.minBounds + imported.maxBounds) * 0.5f;
+	if (!WriteMeshCache(path, cacheFlags(options), imported.meshes, vertexCount, center, imported.minBounds, imported.maxBounds))
+		std::cerr << "WARNING: Could not write mesh cache for " << path << std::endl;
+}
+
+/// <summary>
+/// Fraction of the model that is loaded: 0 while the import job runs, then the fraction of buffer bytes uploaded.
+/// </summary>
+float Model::loadProgress() const
+{
+	if (state != ModelLoadState::Loading) return state == ModelLoadState::Ready ? 1.0f : 0.0f;
+	if (!pendingLoad || pendingLoad->import.valid() || pendingLoad->bytesTotal == 0) return 0.0f;
+	return float(pendingLoad->bytesUploaded) / float(pendingLoad->bytesTotal);
+}
+
+GeometryMemory Model::memoryUsage() const
+{
+	GeometryMemory total;
+	for (const Mesh& mesh : meshes)
+	{
+		GeometryMemory memory = mesh.memoryUsage();
+		total.cpuBytes += memory.cpuBytes;
+		total.gpuBytes += memory.gpuBytes;
+	}
+	return total;
+}
+
+/// <summary>
+/// Log how much system and GPU memory the model's geometry takes, in total and per mesh.
+/// </summary>
+/// <param name="name"> label for the model in the log, e.g. its path. </param>
+void Model::logMemoryReport(const std::string& name) const
+{
+	static const char* residencyNames[] = { "full", "positions only", "gpu only" };
+	GeometryMemory total = memoryUsage();
+	std::cout << "DEBUG LOG: GEOMETRY MEMORY " << name << " (" << residencyNames[int(options.residency)] << "): CPU "
+		<< total.cpuBytes / 1024 << " KB, GPU " << total.gpuBytes / 1024 << " KB" << std::endl;
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		GeometryMemory memory = meshes[i].memoryUsage();
+		std::cout << "    mesh " << i << ": " << meshes[i].vertexCount() << " vertices, " << meshes[i].indexCount() << " indices, CPU "
+			<< memory.cpuBytes / 1024 << " KB, GPU " << memory.gpuBytes / 1024 << " KB" << std::endl;
+	}
+}
+
+/// <summary>
+/// Try to load the processed model from its binary mesh cache instead of going through ASSIMP.
+/// The meshes are built and uploaded straight from the memory mapping, and only copy what their residency keeps.
+/// </summary>
+/// <param name="path"> path of the source model file. </param>
+/// <returns> false if there is no valid cache for this model. </returns>
+bool Model::loadFromCache(std::string const& path)
+{
+	MeshCacheReader cache;
+	if (!cache.open(path, cacheFlags(options))) return false;
+
+	totalVertices = cache.totalVertices;
+	modelCenter = cache.modelCenter;
+	minBounds = cache.minBounds;
+	maxBounds = cache.maxBounds;
+
+	if (options.packTextureArrays) packTextures(UniqueTexturePaths(cache.meshes));
+	meshes.reserve(cache.meshes.size());
+	for (CachedMesh& cached : cache.meshes)
+	{
+		meshes.emplace_back(cached.vertices, cached.vertexCount, cached.indices, cached.indexCount, loadMeshTextures(cached.textures), cached.material,
+			std::move(cached.lods), options.quantizeVertices, options.residency);
+		assignTextureLayers(meshes.back(), cached.textures);
+	}
+	return true;
+}
+
+/// <summary>
+/// Read the mesh cache into CPU-side meshes (copied out of the mapping), for loads that upload later.
+/// </summary>
+/// <returns> false if there is no valid cache for this model. </returns>
+bool Model::readCache(std::string const& path, const ModelLoadOptions& options, ImportedModel& out)
+{
+	MeshCacheReader cache;
+	if (!cache.open(path, cacheFlags(options))) return false;
+
+	out.minBounds = cache.minBounds;
+	out.maxBounds = cache.maxBounds;
+	out.importer = "MESH CACHE";
+	out.fromCache = true;
+	out.meshes.resize(cache.meshes.size());
+	for (size_t i = 0; i < cache.meshes.size(); i++)
+	{
+		CachedMesh& cached = cache.meshes[i];
+		MeshData& mesh = out.meshes[i];
+		mesh.vertices.assign(cached.vertices, cached.vertices + cached.vertexCount);
+		mesh.indices.assign(cached.indices, cached.indices + cached.indexCount);
+		mesh.textures = std::move(cached.textures);
+		mesh.material = cached.material;
+		mesh.lods = std::move(cached.lods);
+	}
+	return true;
+}
+
+/// <summary>
+/// Import and process a model file with the built-in OBJ loader (if enabled) or ASSIMP. No GL calls are made, so this
+/// can run on a worker thread.
+/// </summary>
+/// <param name="path"></param>
+/// <param name="options"></param>
+/// <param name="out"> receives the processed meshes and bounds. </param>
+/// <returns> false if the file could not be imported. </returns>
+bool Model::importModel(std::string const& path, const ModelLoadOptions& options, ImportedModel& out)
+{
+	if (!parseModel(path, options, out)) return false;
+	if (options.optimizeMeshes || options.generateLods) postProcessMeshData(out.meshes, options);
+	return true;
+}
+
+/// <summary>
+/// The parsing half of importModel(): read the file into meshes and bounds, without optimizing or generating LODs.
+/// </summary>
+/// <returns> false if the file could not be imported. </returns>
+bool Model::parseModel(std::string const& path, const ModelLoadOptions& options, ImportedModel& out)
+{
+	TRACE_SCOPE("parse", path);
+	out.minBounds = glm::vec3(FLT_MAX);
+	out.maxBounds = glm::vec3(-FLT_MAX);
+
+	if (options.useObjLoader && path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0)
+	{
+		// The built-in OBJ loader produces the same meshes and materials as the ASSIMP path, except that identical
+		// vertices are shared instead of duplicated per face
+		ObjModelData data;
+		if (LoadObjFile(path, data))
+		{
+			out.meshes = std::move(data.meshes);
+			out.minBounds = data.minBounds;
+			out.maxBounds = data.maxBounds;
+			out.importer = "OBJ";
+			return true;
+		}
+		std::cerr << "WARNING: Built-in OBJ loader failed, falling back to ASSIMP for " << path << std::endl;
+		out.objFallback = true;
+	}
+
 	Assimp::Importer import;
+	if (MountedAssetPack()) import.SetIOHandler(new AssetIOSystem()); // the importer takes ownership
 	const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
-		std::cerr << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl; return;
+		std::cerr << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl; return false;
 	}
 
-	directory = path.substr(0, path.find_last_of('\\'));
-	processNode(scene->mRootNode, scene);
+	processScene(scene, out);
+	out.importer = "ASSIMP";
+	return true;
+}
+
+/// <summary>
+/// Take over the bounds of an imported model and count its vertices. With packTextureArrays the model's textures are
+/// packed here, before any of its meshes are created. GL thread only.
+/// </summary>
+void Model::applyImport(const ImportedModel& imported)
+{
+	minBounds = imported.minBounds;
+	maxBounds = imported.maxBounds;
 	modelCenter = (minBounds + maxBounds) * 0.5f; // Calculate the center of the model
 
-	std::cout << "DEBUG LOG: ASSIMP MODEL LOAD SUCCESSFUL" << std::endl;
-	glfwSetTime(0.0);
+	totalVertices = 0;
+	for (const MeshData& mesh : imported.meshes)
+		totalVertices += static_cast<unsigned int>(mesh.vertices.size());
+
+	if (options.packTextureArrays) packTextures(UniqueTexturePaths(imported.meshes));
+}
+
+/// <summary>
+/// Pack the model's textures into texture arrays (see TextureArraySet), replacing per-mesh texture objects.
+/// </summary>
+/// <param name="texturePaths"> texture paths relative to the model directory. </param>
+void Model::packTextures(const std::vector<std::string>& texturePaths)
+{
+	std::vector<std::string> paths;
+	paths.reserve(texturePaths.size());
+	for (const std::string& path : texturePaths)
+		paths.push_back(directory + "\\" + path);
+	textureArrays.pack(paths);
+}
+
+/// <summary>
+/// Load options that change the processed geometry. A mesh cache written with different flags is not reused.
+/// </summary>
+unsigned int Model::cacheFlags(const ModelLoadOptions& options)
+{
+	unsigned int flags = 0;
+	if (options.useObjLoader) flags |= MESH_CACHE_FLAG_OBJ_LOADER;
+	if (options.optimizeMeshes) flags |= MESH_CACHE_FLAG_OPTIMIZED;
+	if (options.generateLods) flags |= MESH_CACHE_FLAG_LODS;
+	return flags;
+}
+
+/// <summary>
+/// Process all meshes of the ASSIMP scene. 
+/// Vertex, index and material extraction runs on the shared ThreadPool with one task per aiMesh, each writing into its
+/// own preallocated slot.
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="out"> receives the processed meshes (in scene order) and their bounds. </param>
+void Model::processScene(const aiScene* scene, ImportedModel& out)
+{
+	std::vector<aiMesh*> sceneMeshes;
+	processNode(scene->mRootNode, scene, sceneMeshes);
+
+	std::vector<MeshData>& meshData = out.meshes;
+	meshData.resize(sceneMeshes.size());
+	std::vector<MeshBounds> meshBounds(sceneMeshes.size());
+	ThreadPool::shared().parallelFor(sceneMeshes.size(), [&](size_t i)
+	{
+		processMesh(sceneMeshes[i], scene, meshData[i], meshBounds[i]);
+	});
+
+	// Reduce the per-mesh bounds into the model bounds
+	for (size_t i = 0; i < meshData.size(); i++)
+	{
+		out.minBounds = glm::min(out.minBounds, meshBounds[i].min);
+		out.maxBounds = glm::max(out.maxBounds, meshBounds[i].max);
+	}
 }
 
 /// <summary>
-/// Process each node of the ASSIMP scene. 
-/// This includes processing the models and meshes of each node. 
+/// Collect the meshes of each node of the ASSIMP scene, depth first, so the mesh order is the same on every load. 
 /// </summary>
 /// <param name="node"></param>
 /// <param name="scene"></param>
-void Model::processNode(aiNode* node, const aiScene* scene)
+/// <param name="sceneMeshes"> receives the meshes in traversal order. </param>
+void Model::processNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes)
 {
-	// process all the node's meshes (if any)
+	// gather all the node's meshes (if any)
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 
 	// recursively go into the children and do the same
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, sceneMeshes);
 	}
 }
 
 /// <summary>
-/// Get the vertices (position, normal, texture coordinate), indices, and texture data from the mesh.
+/// Get the vertices (position, normal, texture coordinate), indices, and texture paths/ material data from the mesh.
+/// This runs on a worker thread, so it must not touch any GL state or shared model data.
 /// </summary>
 /// <param name="mesh"></param>
 /// <param name="scene"></param>
-/// <returns></returns>
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+/// <param name="out"> output slot for this mesh. </param>
+/// <param name="bounds"> receives the bounds of this mesh's vertices. </param>
+void Model::processMesh(aiMesh* mesh, const aiScene* scene, MeshData& out, MeshBounds& bounds)
 {
-	totalVertices += mesh->mNumVertices;
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
-	std::vector<Texture> textures;
-	Material mat;
+	std::vector<Vertex>& vertices = out.vertices;
+	std::vector<unsigned int>& indices = out.indices;
+	Material& mat = out.material;
+	bounds.min = glm::vec3(FLT_MAX);
+	bounds.max = glm::vec3(-FLT_MAX);
 
 	// process vertices
+	vertices.reserve(mesh->mNumVertices);
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
 		Vertex vertex;
@@ -82,8 +643,8 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		vector.y = mesh->mVertices[i].y;
 		vector.z = mesh->mVertices[i].z;
 		vertex.Position = vector;
-		minBounds = glm::min(minBounds, vertex.Position);
-		maxBounds = glm::max(maxBounds, vertex.Position);
+		bounds.min = glm::min(bounds.min, vertex.Position);
+		bounds.max = glm::max(bounds.max, vertex.Position);
 
 		vector.x = mesh->mNormals[i].x;
 		vector.y = mesh->mNormals[i].y;
@@ -104,9 +665,10 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	//std::cout << "DEBUG LOG: VERTEX PROCESSING SUCCESSFUL" << std::endl;
 
 	// process indices
+	indices.reserve(size_t(mesh->mNumFaces) * 3);
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
+		const aiFace& face = mesh->mFaces[i]; // a copy would allocate its own index array
 		for (unsigned int j = 0; j < face.mNumIndices; j++)
 		{
 			indices.push_back(face.mIndices[j]);
@@ -114,19 +676,14 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	}
 	//std::cout << "DEBUG LOG: INDEX PROCESSING SUCCESSFUL" << std::endl;
 
-	// process textures and materials
+	// process texture paths and materials
 	if (mesh->mMaterialIndex >= 0)
 	{
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-		// --- load textures
-		// Get diffuse maps and insert them into the textures vector
-		std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-		// Get specular maps and insert them into the textures vector
-		std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+		// --- collect texture paths, the textures themselves are loaded on the GL thread
+		getMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", out.textures);
+		getMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", out.textures);
 
 		// --- load material properties (ambience, diffuse, specular, shininess values) 
 		aiColor3D color(0.0f, 0.0f, 0.0f);
@@ -145,94 +702,138 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		mat.shininess = shininess;
 	}
 	//std::cout << "DEBUG LOG: MATERIAL PROCESSING SUCCESSFUL" << std::endl;
-
-	return Mesh(vertices, indices, textures, mat);
 }
 
 /// <summary>
-/// Load the materials' textures. 
+/// Run the mesh optimizer (see MeshOptimizer) and/ or the LOD generator (see MeshSimplifier) over all processed meshes
+/// on the shared ThreadPool, and report the post-transform cache efficiency and LOD triangle counts of the whole model.
 /// </summary>
-/// <param name="mat"> assimp material. </param>
-/// <param name="type"> material type (e.g., diffuse, specular, etc.) </param>
-/// <param name="typeName"></param>
-/// <returns></returns>
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+/// <param name="meshData"> processed meshes, modified in place. </param>
+void Model::postProcessMeshData(std::vector<MeshData>& meshData, const ModelLoadOptions& options)
 {
-	std::vector<Texture> textures;
-	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+	TRACE_SCOPE("post-process");
+	auto processStart = std::chrono::high_resolution_clock::now();
+	std::vector<MeshOptimizationReport> reports(meshData.size());
+	Arena* arena = Arena::current();
+	ThreadPool::shared().parallelFor(meshData.size(), [&](size_t i)
 	{
-		aiString str;
-		mat->GetTexture(type, i, &str);
-
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
+		// Per-mesh temporaries go to a child of the load arena, whose blocks the next mesh reuses
+		Arena meshScratch(arena);
+		ArenaScope scratch(arena ? &meshScratch : nullptr);
+		TRACE_SCOPE("process mesh");
+		if (options.optimizeMeshes) reports[i] = OptimizeMesh(meshData[i]);
+		if (options.generateLods) GenerateLods(meshData[i]);
+	});
+	double elapsedMs = ElapsedMs(processStart);
+
+	if (options.optimizeMeshes)
+	{
+		VertexCacheStats before, after;
+		for (const MeshOptimizationReport& report : reports)
 		{
-			// See if we have already loaded in the material's texture. If so, we can skip loading it back in again since it is memoized 
-			if (std::strcmp(textures_loaded[j].path.c_str(), str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
+			before.add(report.before);
+			after.add(report.after);
 		}
 
-		// If this is the first time loading it, then load it normally 
-		if (!skip)
+		std::cout << "DEBUG LOG: MESH OPTIMIZATION "
+			<< "vertices " << before.vertices << " -> " << after.vertices
+			<< ", ACMR " << before.acmr() << " -> " << after.acmr()
+			<< ", ATVR " << before.atvr() << " -> " << after.atvr() << std::endl;
+	}
+
+	if (options.generateLods)
+	{
+		size_t lodTriangles[MAX_MESH_LODS] = {};
+		for (const MeshData& mesh : meshData)
 		{
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory);
-			texture.type = typeName;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			textures_loaded.push_back(texture);
+			for (unsigned int lod = 0; lod < MAX_MESH_LODS; lod++)
+				lodTriangles[lod] += mesh.lods[lod < mesh.lods.size() ? lod : mesh.lods.size() - 1].indexCount / 3;
 		}
+
+		std::cout << "DEBUG LOG: LOD TRIANGLES";
+		for (unsigned int lod = 0; lod < MAX_MESH_LODS; lod++) std::cout << " " << lodTriangles[lod];
+		std::cout << std::endl;
 	}
 
-	//std::cout << "DEBUG LOG: MATERIAL TEXTURES OF TYPE " << typeName << " LOADED SUCCESSFUL" << std::endl;
-	return textures;
+	std::cout << "DEBUG LOG: MESH POST-PROCESSING (" << elapsedMs << " ms)" << std::endl;
 }
 
 /// <summary>
-/// Generate and bind textures. 
+/// Load the textures of a processed mesh and create its GL buffers. Must run on the GL context thread.
 /// </summary>
-/// <param name="textureName"></param>
-/// <param name="directory"></param>
-/// <returns></returns>
-unsigned int Model::TextureFromFile(const char *textureName, const std::string &directory)
+/// <param name="mesh"> processed mesh, its vertex/ index arrays are moved into the new mesh. </param>
+/// <param name="deferUpload"> only allocate the buffers, the data is streamed in by Mesh::uploadStep(). </param>
+void Model::addMesh(MeshData& mesh, bool deferUpload)
 {
-	std::string path = directory + "\\" + textureName;
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+	meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), loadMeshTextures(mesh.textures), mesh.material, std::move(mesh.lods),
+		options.quantizeVertices, deferUpload);
+	assignTextureLayers(meshes.back(), mesh.textures);
+	meshes.back().setResidency(options.residency); // deferred meshes drop their CPU copies once the upload completes
+}
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
+/// <summary>
+/// Get the paths of the materials' textures. 
+/// </summary>
+/// <param name="mat"> assimp material. </param>
+/// <param name="type"> material type (e.g., diffuse, specular, etc.) </param>
+/// <param name="typeName"></param>
+/// <param name="textures"> texture references (without GL ids) are appended here. </param>
+void Model::getMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<Texture>& textures)
+{
+	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
+		aiString str;
+		mat->GetTexture(type, i, &str);
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = str.C_Str();
+		textures.push_back(std::move(texture));
+	}
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+/// <summary>
+/// Texture objects for a new mesh, loaded through the TextureCache. Empty when the model packs its textures, the mesh
+/// then samples the texture arrays instead (see assignTextureLayers).
+/// </summary>
+/// <param name="references"> the mesh's texture types and paths. </param>
+std::vector<Texture> Model::loadMeshTextures(const std::vector<Texture>& references)
+{
+	std::vector<Texture> textures;
+	if (options.packTextureArrays) return textures;
+	textures.reserve(references.size());
+	for (const Texture& texture : references)
+		textures.push_back(loadTexture(texture.path, texture.type));
+	return textures;
+}
 
-		stbi_image_free(data);
-	}
-	else
+/// <summary>
+/// Point a mesh of a model with packed textures at the array layers of its first diffuse and specular map.
+/// </summary>
+void Model::assignTextureLayers(Mesh& mesh, const std::vector<Texture>& references) const
+{
+	if (!options.packTextureArrays) return;
+	for (const Texture& texture : references)
 	{
-		std::cerr << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		TextureLayer layer = textureArrays.find(directory + "\\" + texture.path);
+		if (texture.type == "texture_diffuse" && mesh.diffuseLayer.layer < 0) mesh.diffuseLayer = layer;
+		else if (texture.type == "texture_specular" && mesh.specularLayer.layer < 0) mesh.specularLayer = layer;
 	}
+}
 
-	return textureID;
+/// <summary>
+/// Load a single texture through the process-wide TextureCache, which reuses it if any model has already loaded it. 
+/// </summary>
+/// <param name="textureName"> texture path relative to the model directory. </param>
+/// <param name="typeName"></param>
+/// <returns></returns>
+Texture Model::loadTexture(const std::string& textureName, const std::string& typeName)
+{
+	Texture texture;
+	texture.handle = TextureCache::instance().acquire(directory + "\\" + textureName, options.asyncTextures);
+	texture.id = texture.handle->id;
+	texture.type = typeName;
+	texture.path = textureName;
+	return texture;
 }
\ No newline at end of file
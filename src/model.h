@@ -5,10 +5,73 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <memory>
 #include <vector>
+#include "FrustumCulling.h"
 #include "mesh.h"
 #include "stb_image.h"
 
+/// <summary>
+/// Settings that control how a Model is imported.
+/// </summary>
+struct ModelLoadOptions
+{
+	bool useMeshCache = true;   // Load from / write to the binary mesh cache next to the source asset
+	bool useObjLoader = false;  // Import .obj files with the built-in multithreaded OBJ loader instead of ASSIMP
+	bool asyncTextures = true;  // Decode textures in the background, showing a placeholder until they are uploaded
+	bool optimizeMeshes = false; // Weld vertices and reorder them for vertex cache, overdraw and fetch locality
+	bool generateLods = false;  // Build simplified index buffers per mesh, picked by Draw from the screen size (welds vertices, changing the vertex count)
+	bool quantizeVertices = false; // Store GPU vertices in the 16 byte QuantizedVertex layout instead of 32 byte floats
+	bool incremental = false;   // Import on a worker thread and upload over several frames, driven by updateLoad()
+	bool packTextureArrays = false; // Pack same-sized material textures into texture arrays, so meshes draw without texture binds
+	GeometryResidency residency = GeometryResidency::Full; // CPU-side geometry each mesh keeps after upload
+};
+
+/// <summary>
+/// Axis aligned bounds of a single mesh, reduced into the model bounds after parallel processing.
+/// </summary>
+struct MeshBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+/// <summary>
+/// CPU-side result of importing a model file (from the mesh cache, the OBJ loader or ASSIMP), before any GL objects exist.
+/// </summary>
+struct ImportedModel
+{
+	std::vector<MeshData> meshes;
+	glm::vec3 minBounds;
+	glm::vec3 maxBounds;
+	const char* importer = ""; // for the load log
+	bool fromCache = false;
+	bool objFallback = false;  // the OBJ loader failed and ASSIMP imported the file instead, see writeCache
+};
+
+enum class ModelLoadState
+{
+	Loading,
+	Ready,
+	Failed
+};
+
+/// <summary>
+/// Camera state Model::Draw needs to place the model, pick a level of detail for each mesh and cull its meshlets.
+/// </summary>
+struct ViewInfo
+{
+	glm::mat4 model;
+	glm::mat4 view;
+	glm::mat4 projection;
+	float viewportHeight; // in pixels
+	bool cullMeshes = true;              // skip meshes whose bounding box or sphere is outside the view
+	bool cullMeshlets = true;            // skip the meshlets of full detail meshes that are outside the view
+	float displacement = 0.0f;           // world space distance shaders move vertices by after culling (e.g. the implosion)
+	bool cullBackfaces = false;          // GL_CULL_FACE is on, so meshlets facing away can be skipped as well
+	Shader* meshletCullShader = nullptr; // cull meshlets with this compute shader (meshletCull.COMP) instead of on the CPU
+};
+
 /// <summary>
 /// This class handles importing models using ASSIMP and processing its Mesh information. 
 /// </summary>
@@ -18,21 +81,65 @@ public:
 	unsigned int totalVertices;
 	glm::vec3 modelCenter;
 	std::vector<Mesh> meshes;
-	Model(const char* path);
-	void Draw(Shader& shader);
+	Model(const char* path, const ModelLoadOptions& options = ModelLoadOptions());
+	~Model();
+	Model(const Model&) = delete; // meshes share their GL objects with any copy
+	Model& operator=(const Model&) = delete;
+	void Draw(DrawBatch& batch, Shader& shader, const glm::mat4& transform = glm::mat4(1.0f));
+	void Draw(DrawBatch& batch, Shader& shader, const ViewInfo& view);
+	unsigned int selectLod(const Mesh& mesh, const ViewInfo& view) const;
+	float projectedPixelsPerUnit(const Mesh& mesh, const ViewInfo& view) const;
+
+	// Incremental loading (ModelLoadOptions::incremental). Meshes can be drawn as soon as they are uploaded.
+	bool updateLoad(double budgetMs);
+	ModelLoadState loadState() const { return state; }
+	float loadProgress() const;
+
+	// CPU and GPU bytes of all meshes, and a per-mesh breakdown logged under the given name
+	GeometryMemory memoryUsage() const;
+	void logMemoryReport(const std::string& name) const;
 
 private:
+	struct IncrementalLoad;
+	friend class SceneLoader; // drives the import stages itself and hands the result over with finishImport()
+
 	// model data
 	std::string directory;
-	std::vector<Texture> textures_loaded;
 	glm::vec3 minBounds;
 	glm::vec3 maxBounds;
+	ModelLoadOptions options;
+	ModelLoadState state;
+	std::shared_ptr<IncrementalLoad> pendingLoad;
+	TextureArraySet textureArrays; // only used with packTextureArrays
+	BoundsSet meshBounds;          // bounds of meshes[i] in object space, appended to as meshes are added
+	std::vector<uint8_t> visibleMeshes; // cull result of the last Draw, see IsBoundsVisible
 
+	Model(std::string const& path, const ModelLoadOptions& options, bool startLoad);
 	void loadModel(std::string const path);
-	void processNode(aiNode *node, const aiScene *scene);
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene);
-	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
-	unsigned int TextureFromFile(const char *textureName, const std::string &directory);
+	void beginIncrementalLoad(std::string const& path);
+	void beginUpload(IncrementalLoad& load);
+	void finishImport(const std::shared_ptr<ImportedModel>& imported);
+	bool loadFromCache(std::string const& path);
+	void applyImport(const ImportedModel& imported);
+	void addMesh(MeshData& mesh, bool deferUpload);
+	void requestTextureDetail(const Mesh& mesh, const ViewInfo& view) const;
+	void updateMeshBounds();
+	void packTextures(const std::vector<std::string>& texturePaths);
+	std::vector<Texture> loadMeshTextures(const std::vector<Texture>& references);
+	void assignTextureLayers(Mesh& mesh, const std::vector<Texture>& references) const;
+	Texture loadTexture(const std::string& textureName, const std::string& typeName);
+
+	// CPU-side import and mesh processing, safe to run on worker threads
+	static bool importModel(std::string const& path, const ModelLoadOptions& options, ImportedModel& out);
+	static bool parseModel(std::string const& path, const ModelLoadOptions& options, ImportedModel& out);
+	static void writeCache(std::string const& path, const ModelLoadOptions& options, const ImportedModel& imported);
+	static bool readCache(std::string const& path, const ModelLoadOptions& options, ImportedModel& out);
+	static unsigned int cacheFlags(const ModelLoadOptions& options);
+	static void processScene(const aiScene *scene, ImportedModel& out);
+	static void postProcessMeshData(std::vector<MeshData>& meshData, const ModelLoadOptions& options);
+	static void processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh*>& sceneMeshes);
+	static void processMesh(aiMesh *mesh, const aiScene *scene, MeshData& out, MeshBounds& bounds);
+	static void getMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<Texture>& textures);
 };
 
 #endif
\ No newline at end of file